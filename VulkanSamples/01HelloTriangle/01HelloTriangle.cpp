@@ -6,6 +6,43 @@
 #include <fstream>
 #include <algorithm>
 #include <set>
+#include <cstring>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+
+// the SPIR-V of the shaders as uint32_t arrays, generated by shaders/compile.sh (compile.bat 
+// on Windows, also run as the pre-build event). Nothing is loaded from disk at startup, 
+// and the code can't get out of sync with the executable.
+#include "shaders/generated/HelloTriangleVertSpv.h"
+#include "shaders/generated/HelloTriangleFragSpv.h"
+#include "shaders/generated/HelloTriangleCullCompSpv.h"
+
+// the pipeline cache blob is stored next to the executable (working directory).
+static const char* PIPELINE_CACHE_FILE = "pipeline_cache.bin";
+
+// must match local_size_x in shaders/01HelloTriangleCull.comp.
+static const uint32_t CULL_GROUP_SIZE = 64;
+
+// the instances are laid out on a square grid in [-1, 1], each one in the center of its cell.
+static void getGridCell(size_t index, size_t count, glm::vec3& center, float& cellSize) {
+	size_t gridSize = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+	cellSize = 2.0f / gridSize;
+	center = glm::vec3(-1.0f + cellSize * (index % gridSize + 0.5f), -1.0f + cellSize * (index / gridSize + 0.5f), 0.0f);
+}
+
+static bool isInstanceExtensionAvailable(const char* extensionName) {
+	uint32_t extensionCount = 0;
+	vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+	std::vector<VkExtensionProperties> extensions(extensionCount);
+	vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, extensions.data());
+
+	for (const auto& extension : extensions) {
+		if (strcmp(extension.extensionName, extensionName) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
 
 // Unfortunately, because the debugCallback function is an extension function, it is not automatically loaded. We have to look up its address ourselves.
 VkResult CreateDebugReportCallbackEXT(VkInstance instance, const VkDebugReportCallbackCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugReportCallbackEXT* pCallback) {
@@ -41,27 +78,58 @@ void HelloTriangle::initWindow() {
 }
 
 void HelloTriangle::initVulkan() {
+	// before the instance, the callbacks of an object can't change until it is destroyed.
+	if (options.trackHostAllocations) {
+		hostAllocator.init(options.commandArenaSize);
+		allocationCallbacks = hostAllocator.getCallbacks();
+	}
 	createInstance();
 	setupDebugCallback();
 	createSurface();
 	pickPhysicalDevice();
 	createLogicalDevice();
+	createPipelineCache();
+	chooseRenderTargetFormats();
 
 	createSwapChain();
 	createImageViews();
 
 	createRenderPass();
 	createGraphicsPipeline();
+	if (options.gpuCulling) {
+		createCullPipeline();
+	}
+	if (options.hotReload) {
+		// asked for explicitly, running without it would look like a reload that never happens.
+		if (!shaderHotReload.init(options.shaderDirectory, { "01HelloTriangle.vert", "01HelloTriangle.frag" })) {
+			throw std::runtime_error("failed to start shader hot reload!");
+		}
+	}
 	createFramebuffers();
 
 	createCommandPool();
+	createDrawList();
+	createUploader();
+	createVertexBuffer();
+	createIndexBuffer();
+	if (options.gpuCulling) {
+		createBoundingSpheres();
+	}
+	// the first frame waits for these copies, the startup doesn't.
+	uploader.flush();
+	createFrameCommandPools();
 	createCommandBuffers();
 
-	createSemaphores();
+	createSyncObjects();
 }
 
 void HelloTriangle::mainLoop() {
-	while (!glfwWindowShouldClose(window)) {
+	int frame = 0;
+	while (!glfwWindowShouldClose(window) && (options.frameCount == 0 || frame++ < options.frameCount)) {
+		// the frame rate limit sleeps before the input is polled, not after.
+		frameTimer.beginWait();
+		framePacer.waitForNextFrame();
+		frameTimer.endWait();
 		glfwPollEvents();
 		drawFrame();
 	}
@@ -70,43 +138,124 @@ void HelloTriangle::mainLoop() {
 	vkDeviceWaitIdle(device);
 }
 
-// the disadvantage of this approach is that we need to stop all rendering before creating the new swap chain. 
+// only the objects that depend on the swap chain images are destroyed here.
+// The render pass and the pipeline survive a resize: viewport and scissor are dynamic states, 
+// and the render pass only depends on the image format, which normally doesn't change.
 // It is possible to create a new swap chain while drawing commands on an image from the old swap chain are still in-flight. 
 // You need to pass the previous swap chain to the oldSwapChain field in the VkSwapchainCreateInfoKHR struct and
-// destroy the old swap chain as soon as you've finished using it.
+// destroy the old swap chain as soon as you've finished using it, see HelloTriangleExt::recreateSwapChain.
+// The same goes for everything else here: the frames in flight may still use it, so it goes to 
+// the deletion queue, and the new objects are created next to the old ones.
 void HelloTriangle::cleanupSwapChain() {
-	for (size_t i = 0; i < swapChainFramebuffers.size(); i++) {
-		vkDestroyFramebuffer(device, swapChainFramebuffers[i], nullptr);
-	}
+	VkDevice device = this->device;
+	const VkAllocationCallbacks* allocationCallbacks = this->allocationCallbacks;
+	std::vector<VkFramebuffer> framebuffers = swapChainFramebuffers;
+	std::vector<VkImageView> imageViews = swapChainImageViews;
+	deletionQueue.push([device, allocationCallbacks, framebuffers, imageViews]() {
+		for (size_t i = 0; i < framebuffers.size(); i++) {
+			vkDestroyFramebuffer(device, framebuffers[i], allocationCallbacks);
+		}
+		for (size_t i = 0; i < imageViews.size(); i++) {
+			vkDestroyImageView(device, imageViews[i], allocationCallbacks);
+		}
+	});
+	swapChainFramebuffers.clear();
+	swapChainImageViews.clear();
+
+	// the size of the swap chain images.
+	RenderTarget oldMsaaColorTarget = msaaColorTarget;
+	RenderTarget oldDepthTarget = depthTarget;
+	deletionQueue.push([this, oldMsaaColorTarget, oldDepthTarget]() mutable {
+		destroyRenderTarget(oldMsaaColorTarget);
+		destroyRenderTarget(oldDepthTarget);
+	});
+	msaaColorTarget = RenderTarget();
+	depthTarget = RenderTarget();
+	// built again with the new images and extent.
+	renderGraph.reset(&deletionQueue);
 
 	// free the cmd buffer, reuse the pool.
-	vkFreeCommandBuffers(device, commandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
-
-	vkDestroyPipeline(device, graphicsPipeline, nullptr);
-	vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-	vkDestroyRenderPass(device, renderPass, nullptr);
-
-	for (size_t i = 0; i < swapChainImageViews.size(); i++) {
-		vkDestroyImageView(device, swapChainImageViews[i], nullptr);
+	if (!commandBuffers.empty()) {
+		VkCommandPool commandPool = this->commandPool;
+		std::vector<VkCommandBuffer> oldCommandBuffers = commandBuffers;
+		deletionQueue.push([device, commandPool, oldCommandBuffers]() {
+			vkFreeCommandBuffers(device, commandPool, static_cast<uint32_t>(oldCommandBuffers.size()), oldCommandBuffers.data());
+		});
+		commandBuffers.clear();
+	}
+	// created together with the command buffers.
+	destroyInstanceBuffers();
+	destroyCullSlots();
+	destroyDescriptorSlots();
+
+	// VK_KHR_swapchain is not enabled when rendering headless.
+	if (swapChain != VK_NULL_HANDLE) {
+		VkSwapchainKHR oldSwapChain = swapChain;
+		deletionQueue.push([device, allocationCallbacks, oldSwapChain]() { vkDestroySwapchainKHR(device, oldSwapChain, allocationCallbacks); });
+		swapChain = VK_NULL_HANDLE;
 	}
-
-	vkDestroySwapchainKHR(device, swapChain, nullptr);
 }
 
 void HelloTriangle::cleanup() {
+	// the swap chain can only go once its last presents are done, vkDeviceWaitIdle doesn't cover them.
+	destroyPresentFences();
 	cleanupSwapChain();
-	vkDestroySemaphore(device, renderFinishedSemaphore, nullptr);
-	vkDestroySemaphore(device, imageAvailableSemaphore, nullptr);
-	vkDestroyCommandPool(device, commandPool, nullptr);
-	vkDestroyDevice(device, nullptr);
-	DestroyDebugReportCallbackEXT(instance1, callback, nullptr);
-	vkDestroySurfaceKHR(instance1, surface, nullptr);
-	vkDestroyInstance(instance1, nullptr);
-	vkDestroyInstance(instance2, nullptr);
+	// mainLoop waited for the device to be idle.
+	deletionQueue.flush();
+	renderGraph.destroy();
+	shaderHotReload.destroy();
+	// graphicsPipeline and the material pipelines are owned by the library.
+	pipelineLibrary.destroy();
+	vkDestroyPipelineLayout(device, pipelineLayout, allocationCallbacks);
+	vkDestroyRenderPass(device, renderPass, allocationCallbacks);
+	// VK_NULL_HANDLE without GPU culling, which is fine for vkDestroy*.
+	vkDestroyPipeline(device, cullPipeline, allocationCallbacks);
+	vkDestroyPipelineLayout(device, cullPipelineLayout, allocationCallbacks);
+	vkDestroyCommandPool(device, computeCommandPool, allocationCallbacks);
+	slotDescriptorAllocator.destroy();
+	descriptorLayoutCache.destroy();
+	for (size_t i = 0; i < inFlightFences.size(); i++) {
+		vkDestroySemaphore(device, renderFinishedSemaphores[i], allocationCallbacks);
+		vkDestroySemaphore(device, imageAvailableSemaphores[i], allocationCallbacks);
+		vkDestroyFence(device, inFlightFences[i], allocationCallbacks);
+	}
+	vkDestroyCommandPool(device, commandPool, allocationCallbacks);
+	recordThreadPool.destroy();
+	for (size_t i = 0; i < frameCommandPools.size(); i++) {
+		vkDestroyCommandPool(device, frameCommandPools[i], allocationCallbacks);
+	}
+	allocator.destroyBuffer(boundingSpheresBuffer, boundingSpheresMemory);
+	allocator.destroyBuffer(indexBuffer, indexBufferMemory);
+	allocator.destroyBuffer(vertexBuffer, vertexBufferMemory);
+	uploader.destroy();
+	// VK_NULL_HANDLE when they were not created.
+	graphicsTimeline.destroy();
+	transferTimeline.destroy();
+	computeTimeline.destroy();
+	gpuProfiler.destroy();
+	// everything allocated from it should have been destroyed by now, leaks are reported.
+	allocator.destroy();
+	savePipelineCache();
+	vkDestroyPipelineCache(device, pipelineCache, allocationCallbacks);
+	vkDestroyDevice(device, allocationCallbacks);
+	DestroyDebugReportCallbackEXT(instance1, callback, allocationCallbacks);
+	if (surface != VK_NULL_HANDLE) {
+		vkDestroySurfaceKHR(instance1, surface, allocationCallbacks);
+	}
+	vkDestroyInstance(instance1, allocationCallbacks);
+	vkDestroyInstance(instance2, allocationCallbacks);
+	// everything created with the callbacks is gone, whatever is still live was leaked by the driver.
+	if (allocationCallbacks != nullptr) {
+		hostAllocator.printStats();
+		hostAllocator.destroy();
+		allocationCallbacks = nullptr;
+	}
 
-	glfwDestroyWindow(window);
+	if (window != nullptr) {
+		glfwDestroyWindow(window);
 
-	glfwTerminate();
+		glfwTerminate();
+	}
 }
 
 void HelloTriangle::createInstance() {
@@ -128,6 +277,27 @@ void HelloTriangle::createInstance() {
 	createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
 	createInfo.pApplicationInfo = &appInfo;
 	auto glfwExtensions = getRequiredExtensions();
+	bool wantProperties2 = options.timelineSemaphores;
+#ifdef VK_EXT_swapchain_maintenance1
+	// for VK_EXT_swapchain_maintenance1 on the device, only with a surface (not headless).
+	bool surfaceExtension = std::find_if(glfwExtensions.begin(), glfwExtensions.end(), [](const char* name) {
+		return strcmp(name, VK_KHR_SURFACE_EXTENSION_NAME) == 0;
+	}) != glfwExtensions.end();
+	if (surfaceExtension && isInstanceExtensionAvailable(VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME) &&
+		isInstanceExtensionAvailable(VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME)) {
+		glfwExtensions.push_back(VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME);
+		glfwExtensions.push_back(VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME);
+		instanceSurfaceMaintenance1 = true;
+		wantProperties2 = true;
+	}
+#endif
+#ifdef VK_KHR_timeline_semaphore
+	// the instance is Vulkan 1.0, where VK_KHR_timeline_semaphore and VK_EXT_swapchain_maintenance1 depend on this one.
+	if (wantProperties2 && isInstanceExtensionAvailable(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME)) {
+		glfwExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+		instanceProperties2 = true;
+	}
+#endif
 	createInfo.enabledExtensionCount = static_cast<uint32_t>(glfwExtensions.size());
 	createInfo.ppEnabledExtensionNames = glfwExtensions.data();
 	if (enableValidationLayers) {
@@ -137,7 +307,7 @@ void HelloTriangle::createInstance() {
 		createInfo.enabledLayerCount = 0;
 	}
 
-	if (vkCreateInstance(&createInfo, nullptr, &instance1) != VK_SUCCESS) {
+	if (vkCreateInstance(&createInfo, allocationCallbacks, &instance1) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create instance1!");
 	}
 
@@ -160,7 +330,7 @@ void HelloTriangle::createInstance() {
 
 		createInfo.enabledExtensionCount = extensionCount;
 		createInfo.ppEnabledExtensionNames = extensionsName.data();
-		if (vkCreateInstance(&createInfo, nullptr, &instance2) != VK_SUCCESS) {
+		if (vkCreateInstance(&createInfo, allocationCallbacks, &instance2) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create instance2!");
 		}
 	}
@@ -180,13 +350,13 @@ void HelloTriangle::setupDebugCallback() {
 	createInfo.flags = VK_DEBUG_REPORT_ERROR_BIT_EXT | VK_DEBUG_REPORT_WARNING_BIT_EXT;
 	createInfo.pfnCallback = debugCallback;
 
-	if (CreateDebugReportCallbackEXT(instance1, &createInfo, nullptr, &callback) != VK_SUCCESS) {
+	if (CreateDebugReportCallbackEXT(instance1, &createInfo, allocationCallbacks, &callback) != VK_SUCCESS) {
 		throw std::runtime_error("failed to set up debug callback!");
 	}
 }
 
 void HelloTriangle::createSurface() {
-	if (glfwCreateWindowSurface(instance1, window, nullptr, &surface) != VK_SUCCESS) {
+	if (glfwCreateWindowSurface(instance1, window, allocationCallbacks, &surface) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create window surface!");
 	}
 }
@@ -214,16 +384,42 @@ void HelloTriangle::pickPhysicalDevice() {
 	std::vector<VkPhysicalDevice> devices(deviceCount);
 	vkEnumeratePhysicalDevices(instance1, &deviceCount, devices.data());
 
-	// only pick the first suitable phy device.
+	// pick the suitable phy device with the best rank for the policy, the first one wins a tie.
+	int bestRank = -1;
 	for (const auto& device : devices) {
+		// findQueueFamilies and querySwapChainSupport remember their result, 
+		// make sure the result of the previous device is not reused.
+		this->indices = QueueFamilyIndices();
+		this->details = SwapChainSupportDetails();
+
 		if (isDeviceSuitable(device)) {
-			physicalDevice = device;
-			break;
+			VkPhysicalDeviceProperties deviceProperties;
+			vkGetPhysicalDeviceProperties(device, &deviceProperties);
+			int rank = rankPhysicalDevice(deviceProperties);
+			if (rank > bestRank) {
+				bestRank = rank;
+				physicalDevice = device;
+			}
 		}
 	}
+	this->indices = QueueFamilyIndices();
+	this->details = SwapChainSupportDetails();
 	if (physicalDevice == VK_NULL_HANDLE) {
 		throw std::runtime_error("failed to find a suitable GPU!");
 	}
+	vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
+	std::cout << "picked physical device: " << physicalDeviceProperties.deviceName << std::endl;
+}
+
+// higher is better.
+int HelloTriangle::rankPhysicalDevice(const VkPhysicalDeviceProperties& deviceProperties) {
+	switch (deviceProperties.deviceType) {
+	case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: return 4;
+	case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return 3;
+	case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: return 2;
+	case VK_PHYSICAL_DEVICE_TYPE_CPU: return 1;
+	default: return 0;
+	}
 }
 
 // need the QueueFamilyIndices to create the logical device.
@@ -231,7 +427,7 @@ void HelloTriangle::createLogicalDevice() {
 	QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
 
 	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-	std::set<int> uniqueQueueFamilies = { indices.graphicsFamilyIdx, indices.presentFamilyIdx };
+	std::set<int> uniqueQueueFamilies = { indices.graphicsFamilyIdx, indices.presentFamilyIdx, indices.transferFamilyIdx, indices.computeFamilyIdx };
 
 	// priorities to queues to influence the scheduling of command buffer execution using floating point numbers between 0.0 and 1.0
 	float queuePriority = 1.0f;
@@ -244,16 +440,67 @@ void HelloTriangle::createLogicalDevice() {
 		queueCreateInfos.push_back(queueCreateInfo);
 	}
 
-	// currently,do not need nay features
 	VkPhysicalDeviceFeatures deviceFeatures = {};
+	std::vector<const char*> requiredExtensions = getRequiredDeviceExtensions();
+	if (options.gpuCulling) {
+		VkPhysicalDeviceFeatures supportedFeatures;
+		vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+		// every indirect command draws one instance, selected by its firstInstance.
+		if (!supportedFeatures.drawIndirectFirstInstance) {
+			throw std::runtime_error("GPU culling needs the drawIndirectFirstInstance feature!");
+		}
+		deviceFeatures.drawIndirectFirstInstance = VK_TRUE;
+		// all the commands in one call, otherwise one vkCmdDrawIndexedIndirect per command.
+		multiDrawIndirect = supportedFeatures.multiDrawIndirect == VK_TRUE;
+		deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+#ifdef VK_KHR_draw_indirect_count
+		// the GPU also decides how many commands are read, so the culled objects cost nothing at all.
+		drawIndirectCount = multiDrawIndirect && isDeviceExtensionAvailable(physicalDevice, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+		if (drawIndirectCount) {
+			requiredExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+		}
+#endif
+	}
 
 	VkDeviceCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+#ifdef VK_KHR_timeline_semaphore
+	// the extension requires the device to support the feature, it only has to be enabled.
+	VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineFeatures = {};
+	timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+	if (options.timelineSemaphores) {
+		timelineSemaphores = instanceProperties2 && isDeviceExtensionAvailable(physicalDevice, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+		if (timelineSemaphores) {
+			requiredExtensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+			timelineFeatures.timelineSemaphore = VK_TRUE;
+			createInfo.pNext = &timelineFeatures;
+		}
+	}
+#endif
+	if (options.timelineSemaphores && !timelineSemaphores) {
+		printf("VK_KHR_timeline_semaphore is not supported, using fences\n");
+	}
+#ifdef VK_EXT_swapchain_maintenance1
+	// like the timeline semaphores, the extension requires the feature.
+	VkPhysicalDeviceSwapchainMaintenance1FeaturesEXT swapchainMaintenance1Features = {};
+	swapchainMaintenance1Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_EXT;
+	swapchainMaintenance1 = surface != VK_NULL_HANDLE && instanceSurfaceMaintenance1 && instanceProperties2 &&
+		isDeviceExtensionAvailable(physicalDevice, VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME);
+	if (swapchainMaintenance1) {
+		requiredExtensions.push_back(VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME);
+		swapchainMaintenance1Features.swapchainMaintenance1 = VK_TRUE;
+		swapchainMaintenance1Features.pNext = const_cast<void*>(createInfo.pNext);
+		createInfo.pNext = &swapchainMaintenance1Features;
+	}
+#endif
+	if (surface != VK_NULL_HANDLE && !swapchainMaintenance1) {
+		printf("VK_EXT_swapchain_maintenance1 is not supported, a resize waits for the present queue\n");
+	}
 	createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 	createInfo.pQueueCreateInfos = queueCreateInfos.data();
 	createInfo.pEnabledFeatures = &deviceFeatures;
-	createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-	createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+	createInfo.enabledExtensionCount = static_cast<uint32_t>(requiredExtensions.size());
+	createInfo.ppEnabledExtensionNames = requiredExtensions.data();
 	if (enableValidationLayers) {
 		createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
 		createInfo.ppEnabledLayerNames = validationLayers.data();
@@ -263,20 +510,128 @@ void HelloTriangle::createLogicalDevice() {
 
 	// Logical devices don't interact directly with instances, which is why it's not included as a parameter.
 	// The queues are automatically created along with the logical device
-	if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &device) != VK_SUCCESS) {
+	if (vkCreateDevice(physicalDevice, &createInfo, allocationCallbacks, &device) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create logical device!");
 	}
 
 	vkGetDeviceQueue(device, indices.graphicsFamilyIdx/*which QueueFamily*/,
 		0/*which queueCount in that QF*/, &graphicsQueue);
 	vkGetDeviceQueue(device, indices.presentFamilyIdx, 0, &presentQueue);
+	vkGetDeviceQueue(device, indices.transferFamilyIdx, 0, &transferQueue);
+	vkGetDeviceQueue(device, indices.computeFamilyIdx, 0, &computeQueue);
+
+	if (timelineSemaphores) {
+		graphicsTimeline.init(device);
+		transferTimeline.init(device);
+		if (options.asyncCompute) {
+			computeTimeline.init(device);
+		}
+	}
+
+#ifdef VK_KHR_draw_indirect_count
+	// an extension command, not exported by the loader.
+	if (drawIndirectCount) {
+		pfnCmdDrawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCountKHR)vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCountKHR");
+		drawIndirectCount = pfnCmdDrawIndexedIndirectCount != nullptr;
+	}
+#endif
+
+	// the timestamps are written by the command buffers of the graphics queue.
+	gpuProfiler.init(physicalDevice, device, indices.graphicsFamilyIdx);
+	allocator.init(physicalDevice, device);
+	renderGraph.init(device, &allocator);
+	descriptorLayoutCache.init(device);
+	slotDescriptorAllocator.init(device);
+}
+
+// Compiling the pipelines is the biggest part of the startup time. The driver can 
+// reuse the compiled results through a VkPipelineCache, and the cache content can be 
+// saved to disk and fed back in the next run.
+void HelloTriangle::createPipelineCache() {
+	std::vector<char> data;
+	std::ifstream file(PIPELINE_CACHE_FILE, std::ios::ate | std::ios::binary);
+	if (file.is_open()) {
+		size_t fileSize = (size_t)file.tellg();
+		data.resize(fileSize);
+		file.seekg(0);
+		file.read(data.data(), fileSize);
+		file.close();
+	}
+
+	// a blob from another GPU/driver is useless, some drivers even crash on it. 
+	if (!data.empty() && !isPipelineCacheCompatible(data)) {
+		std::cout << "pipeline cache: " << PIPELINE_CACHE_FILE << " was created by another device, ignore it." << std::endl;
+		data.clear();
+	}
+
+	VkPipelineCacheCreateInfo createInfo = {};
+	createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	createInfo.initialDataSize = data.size();
+	createInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+	if (vkCreatePipelineCache(device, &createInfo, allocationCallbacks, &pipelineCache) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create pipeline cache!");
+	}
+	std::cout << "pipeline cache: loaded " << data.size() << " bytes from " << PIPELINE_CACHE_FILE << std::endl;
+
+	// the library compiles through the cache, also on its background thread.
+	pipelineLibrary.init(device, pipelineCache);
+}
+
+void HelloTriangle::savePipelineCache() {
+	if (pipelineCache == VK_NULL_HANDLE) return;
+
+	size_t dataSize = 0;
+	if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0) {
+		return;
+	}
+	std::vector<char> data(dataSize);
+	if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, data.data()) != VK_SUCCESS) {
+		std::cerr << "pipeline cache: failed to get the cache data" << std::endl;
+		return;
+	}
+
+	std::ofstream file(PIPELINE_CACHE_FILE, std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		std::cerr << "pipeline cache: failed to open " << PIPELINE_CACHE_FILE << " for writing" << std::endl;
+		return;
+	}
+	file.write(data.data(), dataSize);
+	file.close();
+	std::cout << "pipeline cache: saved " << dataSize << " bytes to " << PIPELINE_CACHE_FILE << std::endl;
 }
 
-void HelloTriangle::createSwapChain(bool redoQuery) {
+// The cache data always starts with the header (VK_PIPELINE_CACHE_HEADER_VERSION_ONE):
+//		uint32_t headerSize (32)
+//		uint32_t headerVersion
+//		uint32_t vendorID
+//		uint32_t deviceID
+//		uint8_t  pipelineCacheUUID[VK_UUID_SIZE]
+// the same values printAllProperties prints, they all need to match the current device.
+bool HelloTriangle::isPipelineCacheCompatible(const std::vector<char>& data) {
+	const size_t headerSize = 4 * sizeof(uint32_t) + VK_UUID_SIZE;
+	if (data.size() < headerSize) {
+		return false;
+	}
+
+	uint32_t header[4];
+	memcpy(header, data.data(), sizeof(header));
+	uint8_t uuid[VK_UUID_SIZE];
+	memcpy(uuid, data.data() + sizeof(header), VK_UUID_SIZE);
+
+	return header[0] >= headerSize &&
+		header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+		header[2] == physicalDeviceProperties.vendorID &&
+		header[3] == physicalDeviceProperties.deviceID &&
+		memcmp(uuid, physicalDeviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+void HelloTriangle::createSwapChain(bool redoQuery, VkSwapchainKHR oldSwapChain) {
 	SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice, redoQuery);
 
 	VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
 	VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
+	printf("present mode = %d\n", (int)presentMode);
 	VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
 
 	// choose image number in the swap chain
@@ -329,9 +684,12 @@ void HelloTriangle::createSwapChain(bool redoQuery) {
 	createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 	createInfo.presentMode = presentMode;
 	createInfo.clipped = VK_TRUE;
-	createInfo.oldSwapchain = VK_NULL_HANDLE;
+	// When the window is resized, the old swap chain is handed over here. It is retired, 
+	// but the images already acquired from it can still be presented, so presentation 
+	// keeps going during the switch and the driver can reuse its resources.
+	createInfo.oldSwapchain = oldSwapChain;
 
-	if (vkCreateSwapchainKHR(device, &createInfo, nullptr, &swapChain) != VK_SUCCESS) {
+	if (vkCreateSwapchainKHR(device, &createInfo, allocationCallbacks, &swapChain) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create swap chain!");
 	}
 
@@ -339,6 +697,9 @@ void HelloTriangle::createSwapChain(bool redoQuery) {
 	vkGetSwapchainImagesKHR(device, swapChain, &imageCount, nullptr);
 	swapChainImages.resize(imageCount);
 	vkGetSwapchainImagesKHR(device, swapChain, &imageCount, swapChainImages.data());
+	// no frame is using the new images yet.
+	imagesInFlight.assign(imageCount, VK_NULL_HANDLE);
+	imageTimelineValues.assign(imageCount, 0);
 	// save them for future use.
 	this->swapChainImageFormat = surfaceFormat.format;
 	this->swapChainExtent = extent;
@@ -371,13 +732,56 @@ void HelloTriangle::createImageViews() {
 		createInfo.subresourceRange.baseArrayLayer = 0;
 		createInfo.subresourceRange.layerCount = 1;
 
-		if (vkCreateImageView(device, &createInfo, nullptr, &swapChainImageViews[i]) != VK_SUCCESS) {
+		if (vkCreateImageView(device, &createInfo, allocationCallbacks, &swapChainImageViews[i]) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create image views!");
 		}
 	}
 }
 
+// the MSAA sample count and the depth format, from what the device supports.
+void HelloTriangle::chooseRenderTargetFormats() {
+	if (options.depthBuffer) {
+		// any depth format works for the test, the stencil is not used.
+		const VkFormat candidates[] = {
+			VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT, VK_FORMAT_D16_UNORM
+		};
+		depthFormat = VK_FORMAT_UNDEFINED;
+		for (VkFormat format : candidates) {
+			VkFormatProperties formatProperties;
+			vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
+			if (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
+				depthFormat = format;
+				break;
+			}
+		}
+		if (depthFormat == VK_FORMAT_UNDEFINED) {
+			throw std::runtime_error("failed to find a depth format!");
+		}
+	}
+
+	// the color and depth attachments of a subpass must have the same sample count.
+	VkSampleCountFlags supported = physicalDeviceProperties.limits.framebufferColorSampleCounts;
+	if (options.depthBuffer) {
+		supported &= physicalDeviceProperties.limits.framebufferDepthSampleCounts;
+	}
+	msaaSamples = VK_SAMPLE_COUNT_1_BIT;
+	for (int samples = 64; samples > 1; samples /= 2) {
+		if (samples <= options.sampleCount && (supported & samples)) {
+			msaaSamples = static_cast<VkSampleCountFlagBits>(samples);
+			break;
+		}
+	}
+	printf("samples = %d%s, depth format = %d\n", (int)msaaSamples,
+		(int)msaaSamples < options.sampleCount ? " (the most the device supports)" : "", (int)depthFormat);
+}
+
+// The attachments in framebuffer order: the swap chain image, the MSAA color image 
+// (msaaSamples > 1), the depth image (with a depthFormat).
+// The MSAA color and the depth are never needed after the render pass: they are cleared 
+// on load and DONT_CARE on store, so a tiled GPU keeps them in tile memory and never 
+// writes them out, and their LAZILY_ALLOCATED memory is never committed.
 void HelloTriangle::createRenderPass() {
+	bool msaa = msaaSamples != VK_SAMPLE_COUNT_1_BIT;
 	VkAttachmentDescription colorAttachment = {};
 	// The format of the color attachment should match the format of the swap chain images
 	colorAttachment.format = swapChainImageFormat;
@@ -397,13 +801,51 @@ void HelloTriangle::createRenderPass() {
 	// specifies which layout the image will have before the render pass begins.
 	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 	// specifies the layout to automatically transition to when the render pass finishes.
-	// for presentation using the swap chain after rendering,
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	// for presentation using the swap chain after rendering (VK_IMAGE_LAYOUT_PRESENT_SRC_KHR), 
+	// or for the copy to host memory when rendering headless (VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL).
+	colorAttachment.finalLayout = colorFinalLayout;
+	// with MSAA the swap chain image is the resolve attachment: all of it is overwritten, 
+	// there is nothing to clear.
+	if (msaa) {
+		colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	}
+	std::vector<VkAttachmentDescription> attachments = { colorAttachment };
+
+	VkAttachmentReference swapChainAttachmentRef = {};
+	swapChainAttachmentRef.attachment = 0;
+	swapChainAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
 	// Subpasses and attachment references
-	VkAttachmentReference colorAttachmentRef = {};
-	colorAttachmentRef.attachment = 0;
-	colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	VkAttachmentReference colorAttachmentRef = swapChainAttachmentRef;
+	if (msaa) {
+		VkAttachmentDescription msaaAttachment = {};
+		msaaAttachment.format = swapChainImageFormat;
+		msaaAttachment.samples = msaaSamples;
+		msaaAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		msaaAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE; // resolved, then thrown away.
+		msaaAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		msaaAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		msaaAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		msaaAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		colorAttachmentRef.attachment = static_cast<uint32_t>(attachments.size());
+		attachments.push_back(msaaAttachment);
+	}
+
+	VkAttachmentReference depthAttachmentRef = {};
+	if (depthFormat != VK_FORMAT_UNDEFINED) {
+		VkAttachmentDescription depthAttachment = {};
+		depthAttachment.format = depthFormat;
+		depthAttachment.samples = msaaSamples;
+		depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		depthAttachmentRef.attachment = static_cast<uint32_t>(attachments.size());
+		depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		attachments.push_back(depthAttachment);
+	}
 
 	VkSubpassDescription subpass = {};
 	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
@@ -415,6 +857,8 @@ void HelloTriangle::createRenderPass() {
 	//		pDepthStencilAttachment : Attachments for depth and stencil data
 	//		pPreserveAttachments : Attachments that are not used by this subpass, but for which the data must be preserved
 	subpass.pColorAttachments = &colorAttachmentRef;
+	subpass.pResolveAttachments = msaa ? &swapChainAttachmentRef : nullptr;
+	subpass.pDepthStencilAttachment = depthFormat != VK_FORMAT_UNDEFINED ? &depthAttachmentRef : nullptr;
 
 	// Subpass dependencies, ﲻǺܶ...
 	VkSubpassDependency dependency = {};
@@ -424,266 +868,425 @@ void HelloTriangle::createRenderPass() {
 	dependency.srcAccessMask = 0;
 	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	// the MSAA and depth images are shared by the frames: the clear of this frame has to wait 
+	// for the writes of the previous one.
+	if (msaa) {
+		dependency.srcAccessMask |= VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	}
+	if (depthFormat != VK_FORMAT_UNDEFINED) {
+		dependency.srcStageMask |= VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependency.srcAccessMask |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependency.dstStageMask |= VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+		dependency.dstAccessMask |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	}
+
+	// --render-graph: the graph transitions the attachments and orders them against the rest 
+	// of the frame (see buildRenderGraph), the render pass neither changes a layout nor has a dependency.
+	if (options.renderGraph) {
+		for (auto& attachment : attachments) {
+			attachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+			attachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		}
+		if (depthFormat != VK_FORMAT_UNDEFINED) {
+			attachments[depthAttachmentRef.attachment].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+			attachments[depthAttachmentRef.attachment].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		}
+	}
 
 	// Render pass
 	VkRenderPassCreateInfo renderPassInfo = {};
 	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-	renderPassInfo.attachmentCount = 1;
-	renderPassInfo.pAttachments = &colorAttachment;
+	renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+	renderPassInfo.pAttachments = attachments.data();
 	renderPassInfo.subpassCount = 1;
 	renderPassInfo.pSubpasses = &subpass;
-	renderPassInfo.dependencyCount = 1;
+	renderPassInfo.dependencyCount = options.renderGraph ? 0 : 1;
 	renderPassInfo.pDependencies = &dependency;
 
-	if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
+	if (vkCreateRenderPass(device, &renderPassInfo, allocationCallbacks, &renderPass) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create render pass!");
 	}
 }
 
 void HelloTriangle::createGraphicsPipeline() {
-	// setup shaders.
-	auto vertShaderCode = readFile("shaders/01HelloTriangleVert.spv");
-	auto fragShaderCode = readFile("shaders/01HelloTriangleFrag.spv");
-
-	VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-	VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
-
-	VkPipelineShaderStageCreateInfo vertShaderStageInfo = {};
-	vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-	vertShaderStageInfo.module = vertShaderModule;
-	// That means that it's possible to combine multiple fragment shaders into 
-	// a single shader module and use different entry points to differentiate 
-	// between their behaviors. Here use the main.
-	vertShaderStageInfo.pName = "main";
-	// It allows you to specify values for shader constants. 
-	// You can use a single shader module where its behavior can be configured 
-	// at pipeline creation by specifying different values for the constants used in it. 
-	// This is more efficient than configuring the shader using variables at render time, 
-	// because the compiler can do optimizations like eliminating if statements that 
-	// depend on these values.
-	vertShaderStageInfo.pSpecializationInfo = nullptr;
-
-	VkPipelineShaderStageCreateInfo fragShaderStageInfo = {};
-	fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-	fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-	fragShaderStageInfo.module = fragShaderModule;
-	fragShaderStageInfo.pName = "main";
-
-	VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
-
-	// Vertex input
-	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
-	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertexInputInfo.vertexBindingDescriptionCount = 0;
-	vertexInputInfo.pVertexBindingDescriptions = nullptr; // Optional
-	vertexInputInfo.vertexAttributeDescriptionCount = 0;
-	vertexInputInfo.pVertexAttributeDescriptions = nullptr; // Optional
-
-	// Input assembly
-	// 1, what kind of geometry will be drawn from the vertices and 
-	//		VK_PRIMITIVE_TOPOLOGY_POINT_LIST: points from vertices
-	//		VK_PRIMITIVE_TOPOLOGY_LINE_LIST: line from every 2 vertices without reuse
-	//		VK_PRIMITIVE_TOPOLOGY_LINE_STRIP : the end vertex of every line is used as start vertex for the next line
-	//		VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST : triangle from every 3 vertices without reuse
-	//		VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP : the second and third vertex of every triangle are 
-	//												used as first two vertices of the next triangle
-	// 2, if primitive restart should be enabled
-	// Normally, the vertices are loaded from the vertex buffer by index in sequential order, 
-	// but with an element buffer you can specify the indices to use yourself.
-	// If you set the primitiveRestartEnable member to VK_TRUE, then it's possible to break up 
-	// lines and triangles in the _STRIP topology modes by using a special index of 0xFFFF or 0xFFFFFFFF.
-	VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
-	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-	inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-	// Viewports and scissors
-	VkViewport viewport = {};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = (float)swapChainExtent.width;
-	viewport.height = (float)swapChainExtent.height;
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-
-	VkRect2D scissor = {};
-	scissor.offset = { 0, 0 };
-	scissor.extent = swapChainExtent;
+	// setup shaders. The modules are created once and owned by the pipeline library.
+	PipelineDesc desc;
+	desc.vertShader = pipelineLibrary.registerShader(HelloTriangleVertSpv, sizeof(HelloTriangleVertSpv));
+	desc.fragShader = pipelineLibrary.registerShader(HelloTriangleFragSpv, sizeof(HelloTriangleFragSpv));
+	// rebuilt for a new render pass: keep the shaders swapped in by the hot reload.
+	if (reloadPending) {
+		desc.vertShader = reloadDesc.vertShader;
+		desc.fragShader = reloadDesc.fragShader;
+		reloadPending = false;
+	} else if (!materialDescs.empty()) {
+		desc.vertShader = materialDescs[0].vertShader;
+		desc.fragShader = materialDescs[0].fragShader;
+	}
 
-	VkPipelineViewportStateCreateInfo viewportState = {};
-	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-	viewportState.viewportCount = 1;
-	viewportState.pViewports = &viewport;
-	viewportState.scissorCount = 1;
-	viewportState.pScissors = &scissor;
-
-	// Rasterizer
-	VkPipelineRasterizationStateCreateInfo rasterizer = {};
-	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-	// If depthClampEnable is set to VK_TRUE, then fragments that are beyond the near 
-	// and far planes are clamped to them as opposed to discarding them. 
-	// This is useful in some special cases like shadow maps.
-	rasterizer.depthClampEnable = VK_FALSE;
-	// If rasterizerDiscardEnable is set to VK_TRUE, then geometry never passes through 
-	// the rasterizer stage. This basically disables any output to the framebuffer.
-	rasterizer.rasterizerDiscardEnable = VK_FALSE;
-	// The polygonMode determines how fragments are generated for geometry.
-	//		VK_POLYGON_MODE_FILL: fill the area of the polygon with fragments
-	//		VK_POLYGON_MODE_LINE: polygon edges are drawn as lines
-	//		VK_POLYGON_MODE_POINT : polygon vertices are drawn as points
-	// Using any mode other than fill requires enabling a GPU feature.
-	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-	// any line thicker than 1.0f requires you to enable the wideLines GPU feature.
-	rasterizer.lineWidth = 1.0f;
-	rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-	rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
-	// This is sometimes used for shadow mapping
-	rasterizer.depthBiasEnable = VK_FALSE;
-	rasterizer.depthBiasConstantFactor = 0.0f; // Optional
-	rasterizer.depthBiasClamp = 0.0f; // Optional
-	rasterizer.depthBiasSlopeFactor = 0.0f; // Optional
-
-	// Multisampling
-	VkPipelineMultisampleStateCreateInfo multisampling = {};
-	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	multisampling.sampleShadingEnable = VK_FALSE;
-	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-	multisampling.minSampleShading = 1.0f; // Optional
-	multisampling.pSampleMask = nullptr; // Optional
-	multisampling.alphaToCoverageEnable = VK_FALSE; // Optional
-	multisampling.alphaToOneEnable = VK_FALSE; // Optional
-
-	// Depth and stencil testing
-	// skip
-
-	// Color blending, two steps
-	//		1, Mix the old and new value to produce a final color
-	//		2, Combine the old and new value using a bitwise operation
-	// 1,
-	VkPipelineColorBlendAttachmentState colorBlendAttachment = {}; // configuration per attached framebuffer
-	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-	colorBlendAttachment.blendEnable = VK_FALSE;
-	colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE; // Optional
-	colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO; // Optional
-	colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD; // Optional
-	colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE; // Optional
-	colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO; // Optional
-	colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD; // Optional
-	// pseudocode:
-	// if (blendEnable) {
-	//		finalColor.rgb = (srcColorBlendFactor * newColor.rgb) <colorBlendOp> (dstColorBlendFactor * oldColor.rgb);
-	//		finalColor.a = (srcAlphaBlendFactor * newColor.a) <alphaBlendOp> (dstAlphaBlendFactor * oldColor.a);
-	// } else {
-	//		finalColor = newColor;
-	// }
-	//
-	// finalColor = finalColor & colorWriteMask;
-	// 
-	// most common way:
-	// finalColor.rgb = newAlpha * newColor + (1 - newAlpha) * oldColor;
-	// finalColor.a = newAlpha.a;
-	// code:
-	// colorBlendAttachment.blendEnable = VK_TRUE;
-	// colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-	// colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-	// colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-	// colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-	// colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-	// colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
-
-	// 2, 
-	VkPipelineColorBlendStateCreateInfo colorBlending = {};
-	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	colorBlending.logicOpEnable = VK_FALSE;
-	colorBlending.logicOp = VK_LOGIC_OP_COPY; // Optional
-	colorBlending.attachmentCount = 1;
-	colorBlending.pAttachments = &colorBlendAttachment;
-	colorBlending.blendConstants[0] = 0.0f; // Optional
-	colorBlending.blendConstants[1] = 0.0f; // Optional
-	colorBlending.blendConstants[2] = 0.0f; // Optional
-	colorBlending.blendConstants[3] = 0.0f; // Optional
-
-	// Dynamic state
-	// A limited amount of the state that we've specified in the previous structs can actually be changed without recreating the pipeline.
-	// Ϊ󲿷ֶǲܱ, Ҫֻ´pipeline, ͿԶ̬
-	//VkDynamicState dynamicStates[] = {
-	//	VK_DYNAMIC_STATE_VIEWPORT,
-	//	VK_DYNAMIC_STATE_LINE_WIDTH
-	//};
-
-	//VkPipelineDynamicStateCreateInfo dynamicState = {};
-	//dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-	//dynamicState.dynamicStateCount = 2;
-	//dynamicState.pDynamicStates = dynamicStates;
+	// the vertex input state and the layout are derived from the shaders, instead of 
+	// repeating them here by hand. A mismatch with the CPU side throws right here.
+	std::vector<VkPushConstantRange> reflectedPushConstants;
+	VkDescriptorSetLayout reflectedSetLayout = reflectShaderInterface(desc, reflectedPushConstants);
 
 	// Pipeline layout
-	// specify uniform, push constants etc... here we use nothing, but still need to create one.
-	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
-	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfo.setLayoutCount = 0; // Optional
-	pipelineLayoutInfo.pSetLayouts = nullptr; // Optional
-	pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
-	pipelineLayoutInfo.pPushConstantRanges = 0; // Optional
-
-	if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create pipeline layout!");
-	}
-
-	// final gfx pipeline.
-	VkGraphicsPipelineCreateInfo pipelineInfo = {};
-	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-	pipelineInfo.stageCount = 2;
-	pipelineInfo.pStages = shaderStages;
-	pipelineInfo.pVertexInputState = &vertexInputInfo;
-	pipelineInfo.pInputAssemblyState = &inputAssembly;
-	pipelineInfo.pViewportState = &viewportState;
-	pipelineInfo.pRasterizationState = &rasterizer;
-	pipelineInfo.pMultisampleState = &multisampling;
-	pipelineInfo.pDepthStencilState = nullptr; // Optional
-	pipelineInfo.pColorBlendState = &colorBlending;
-	pipelineInfo.pDynamicState = nullptr; // Optional
-	pipelineInfo.layout = pipelineLayout;
-	pipelineInfo.renderPass = renderPass;
-	pipelineInfo.subpass = 0; // why it is 0?
-	// Vulkan allows you to create a new graphics pipeline by deriving from an existing pipeline.
-	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
-	pipelineInfo.basePipelineIndex = -1; // Optional
-
-	// can take multiple VkGraphicsPipelineCreateInfo objects and create multiple VkPipeline objects in a single call.
-	// VK_NULL_HANDLE: A pipeline cache can be used to store and reuse data relevant to pipeline creation across multiple calls to 
-	// vkCreateGraphicsPipelines and even across program executions if the cache is stored to a file. 
-	if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create graphics pipeline!");
-	}
-
-	vkDestroyShaderModule(device, fragShaderModule, nullptr);
-	vkDestroyShaderModule(device, vertShaderModule, nullptr);
+	// specify uniform, push constants etc... 
+	// it doesn't depend on the render pass, so it is kept when only the render pass is recreated.
+	if (pipelineLayout == VK_NULL_HANDLE) {
+		// set 0: the ObjectUniforms of the draw, the offset is given to vkCmdBindDescriptorSets.
+		objectSetLayout = reflectedSetLayout;
+		pushConstantRanges = reflectedPushConstants;
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &objectSetLayout;
+		pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(pushConstantRanges.size());
+		pipelineLayoutInfo.pPushConstantRanges = pushConstantRanges.data();
+
+		if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, allocationCallbacks, &pipelineLayout) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create pipeline layout!");
+		}
+	}
+
+	// everything else keeps the defaults of PipelineDesc: a triangle list, back faces culled, 
+	// clockwise front faces, one sample and no blending. The Vk*CreateInfo structs are filled 
+	// in PipelineLibrary::compile.
+	desc.layout = pipelineLayout;
+	desc.renderPass = renderPass;
+	desc.colorFormat = swapChainImageFormat;
+	desc.depthFormat = depthFormat;
+	desc.samples = msaaSamples;
+	desc.subpass = 0;
+	// the triangles are all at the same depth, LESS_OR_EQUAL (the default) lets later draws pass.
+	desc.depthTestEnable = depthFormat != VK_FORMAT_UNDEFINED;
+	desc.depthWriteEnable = depthFormat != VK_FORMAT_UNDEFINED;
+	// where the vertex shader reads the per draw transform from.
+	desc.setSpecConstant(VK_SHADER_STAGE_VERTEX_BIT, SPEC_PER_DRAW_SOURCE, static_cast<uint32_t>(options.perDrawMode));
+
+	// a second call with the same desc (e.g. the render pass was recreated with the same format) 
+	// returns the pipeline built the first time.
+	graphicsPipeline = pipelineLibrary.get(desc);
+	createMaterialDescs(desc);
+}
+
+// Fill the vertex input of desc from the reflection of its vertex shader, and return the 
+// layout of set 0 the shaders need (from the cache, equal bindings give the same layout).
+// Throws if the shaders don't fit the buffers and descriptors the CPU side provides.
+VkDescriptorSetLayout HelloTriangle::reflectShaderInterface(PipelineDesc& desc, std::vector<VkPushConstantRange>& reflectedPushConstants) {
+	// parsed once at registration.
+	ShaderReflection vert = pipelineLibrary.getReflection(desc.vertShader);
+	ShaderReflection frag = pipelineLibrary.getReflection(desc.fragShader);
+	std::vector<const ShaderReflection*> stages = { &vert, &frag };
+
+	// binding 0: per vertex from location 0, binding 1: per instance from location 2.
+	SpirvReflect::buildVertexInput(vert, { { VK_VERTEX_INPUT_RATE_VERTEX, 0 }, { VK_VERTEX_INPUT_RATE_INSTANCE, 2 } },
+		desc.vertexBindings, desc.vertexAttributes);
+
+	// the buffers are filled from Vertex and InstanceData, which have to have the same layout.
+	std::vector<VkVertexInputAttributeDescription> expected;
+	for (const auto& attribute : Vertex::getAttributeDescriptions()) expected.push_back(attribute);
+	for (const auto& attribute : InstanceData::getAttributeDescriptions()) expected.push_back(attribute);
+	bool matches = desc.vertexBindings[0].stride == sizeof(Vertex) && desc.vertexBindings[1].stride == sizeof(InstanceData) &&
+		desc.vertexAttributes.size() == expected.size();
+	for (size_t i = 0; matches && i < expected.size(); i++) {
+		const VkVertexInputAttributeDescription& a = desc.vertexAttributes[i];
+		const VkVertexInputAttributeDescription& b = expected[i];
+		matches = a.location == b.location && a.binding == b.binding && a.format == b.format && a.offset == b.offset;
+	}
+	if (!matches) {
+		throw std::runtime_error("vertex shader inputs don't match Vertex and InstanceData!");
+	}
+
+	if (SpirvReflect::getSetCount(stages) > 1) {
+		throw std::runtime_error("shaders use descriptor sets other than set 0!");
+	}
+	std::vector<VkDescriptorSetLayoutBinding> bindings = SpirvReflect::getSetBindings(stages, 0);
+	// the buffers of set 0 are bound with dynamic offsets (per draw, or per frame for the start 
+	// of the array), the shader can't tell the difference.
+	for (auto& binding : bindings) {
+		if (binding.descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) {
+			binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		} else if (binding.descriptorType == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER) {
+			binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+		}
+	}
+	reflectedPushConstants = SpirvReflect::getPushConstantRanges(stages);
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+	return descriptorLayoutCache.getLayout(layoutInfo);
+}
+
+// material m > 0 is a variation of the base state, picked by its bits. They are only 
+// compiled when a draw uses them for the first time, see recordDraws.
+//		bit 0: additive blending
+//		bit 1: no blue channel writes
+//		bit 2: no face culling
+//		bit 3: spot light shading, a specialization constant of the fragment shader
+void HelloTriangle::createMaterialDescs(const PipelineDesc& desc) {
+	int materialCount = std::max(1, std::min(options.materialCount, MAX_MATERIALS));
+	materialDescs.assign(static_cast<size_t>(materialCount), desc);
+	for (int m = 1; m < materialCount; m++) {
+		PipelineDesc& material = materialDescs[m];
+		if (m & 1) {
+			material.blendEnable = true;
+			material.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+			material.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+		}
+		if (m & 2) {
+			material.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_A_BIT;
+		}
+		if (m & 4) {
+			material.cullMode = VK_CULL_MODE_NONE;
+		}
+		if (m & 8) {
+			material.setSpecConstant(VK_SHADER_STAGE_FRAGMENT_BIT, SPEC_SHADING_MODEL, SHADING_SPOT);
+		}
+	}
+}
+
+// Called at the start of a frame, before it is recorded. A recompiled shader gives a new 
+// base desc, which is compiled in the background while the old pipeline keeps rendering. 
+// Once it is ready, it replaces the old one for all the following frames: no vkDeviceWaitIdle, 
+// the frames in flight still use the old pipelines, which are destroyed after they retired.
+void HelloTriangle::updateShaderHotReload() {
+	std::vector<ShaderHotReload::Shader> shaders = shaderHotReload.poll();
+	if (!shaders.empty()) {
+		PipelineDesc desc = reloadPending ? reloadDesc : materialDescs[0];
+		try {
+			for (const ShaderHotReload::Shader& shader : shaders) {
+				uint64_t id = pipelineLibrary.registerShader(shader.code.data(), shader.code.size() * sizeof(uint32_t));
+				if (shader.name == "01HelloTriangle.vert") {
+					desc.vertShader = id;
+				} else {
+					desc.fragShader = id;
+				}
+			}
+			// the pipeline layout and the buffers stay, only the code can change.
+			std::vector<VkPushConstantRange> reflectedPushConstants;
+			VkDescriptorSetLayout reflectedSetLayout = reflectShaderInterface(desc, reflectedPushConstants);
+			bool samePushConstants = reflectedPushConstants.size() == pushConstantRanges.size();
+			for (size_t i = 0; samePushConstants && i < pushConstantRanges.size(); i++) {
+				samePushConstants = reflectedPushConstants[i].stageFlags == pushConstantRanges[i].stageFlags &&
+					reflectedPushConstants[i].size == pushConstantRanges[i].size;
+			}
+			if (reflectedSetLayout != objectSetLayout || !samePushConstants) {
+				throw std::runtime_error("descriptor bindings or push constants changed, restart to use them");
+			}
+			reloadDesc = desc;
+			reloadPending = true;
+		} catch (const std::exception& e) {
+			fprintf(stderr, "shader hot reload: %s, keeping the old version\n", e.what());
+		}
+	}
+	if (!reloadPending) return;
+
+	// VK_NULL_HANDLE until it is compiled, also when the shaders don't link (e.g. a changed 
+	// interface between the stages), then the next save is the next try.
+	VkPipeline pipeline = pipelineLibrary.getOrQueue(reloadDesc, VK_NULL_HANDLE);
+	if (pipeline == VK_NULL_HANDLE) return;
+
+	// the old pipelines are not in the library anymore, a later desc can't return them.
+	// nothing of this frame has been submitted yet, the last use is in the last submitted frame.
+	VkDevice device = this->device;
+	for (const PipelineDesc& desc : materialDescs) {
+		VkPipeline oldPipeline = pipelineLibrary.remove(desc);
+		if (oldPipeline != VK_NULL_HANDLE) {
+			deletionQueue.push([device, oldPipeline]() { vkDestroyPipeline(device, oldPipeline, nullptr); });
+		}
+	}
+	graphicsPipeline = pipeline;
+	createMaterialDescs(reloadDesc);
+	reloadPending = false;
+	printf("shader hot reload: pipelines swapped at frame %llu\n", (unsigned long long)frameNumber);
+}
+
+// The frame as a render graph (--render-graph): the passes declare what they read and write, 
+// the graph schedules the barriers and layout transitions between them and owns the MSAA and 
+// depth images. The swap chain image is the output, everything else only lives inside the frame.
+void HelloTriangle::buildRenderGraph() {
+	renderGraph.reset();
+
+	// acquired: drawFrame waits for the semaphore in COLOR_ATTACHMENT_OUTPUT, the contents are discarded.
+	// presented: the renderFinished semaphore orders the rest, nothing waits for the barrier itself.
+	RenderGraph::AccessState acquired;
+	acquired.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+	acquired.stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	RenderGraph::AccessState presented;
+	presented.layout = colorFinalLayout;
+	presented.stages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+	swapChainResource = renderGraph.importImage("swap chain image", VK_IMAGE_ASPECT_COLOR_BIT, acquired, presented);
+	renderGraph.markOutput(swapChainResource);
+
+	RenderGraph::ImageDesc imageDesc;
+	imageDesc.extent = swapChainExtent;
+	imageDesc.samples = msaaSamples;
+	if (msaaSamples != VK_SAMPLE_COUNT_1_BIT) {
+		imageDesc.format = swapChainImageFormat;
+		imageDesc.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+		imageDesc.aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+		msaaColorResource = renderGraph.createImage("msaa color", imageDesc);
+	}
+	if (depthFormat != VK_FORMAT_UNDEFINED) {
+		imageDesc.format = depthFormat;
+		imageDesc.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+		imageDesc.aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+		depthResource = renderGraph.createImage("depth", imageDesc);
+	}
+
+	if (options.gpuCulling) {
+		// a slot's buffers are only reused after the fence of its previous frame, nothing to wait for.
+		// With async compute the cull passes run on the compute queue, outside of the graph, 
+		// and drawFrame waits for their semaphore in DRAW_INDIRECT.
+		RenderGraph::AccessState unused;
+		cullCommandsResource = renderGraph.importBuffer("cull commands", unused);
+		cullCountResource = renderGraph.importBuffer("cull count", unused);
+
+		if (!options.asyncCompute) {
+			RenderGraph::PassId clearPass = renderGraph.addPass("clear count", RenderGraph::PASS_TRANSFER,
+				[this](VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t slot) { recordCullClear(commandBuffer, slot); });
+			renderGraph.write(clearPass, cullCountResource, RenderGraph::USAGE_TRANSFER);
+
+			RenderGraph::PassId cullPass = renderGraph.addPass("cull", RenderGraph::PASS_COMPUTE,
+				[this](VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t slot) {
+				gpuProfiler.beginRegion(commandBuffer, slot, "cull");
+				recordCullDispatch(commandBuffer, slot);
+				gpuProfiler.endRegion(commandBuffer, slot, "cull");
+			});
+			// the visible objects are counted with atomics.
+			renderGraph.read(cullPass, cullCountResource, RenderGraph::USAGE_STORAGE);
+			renderGraph.write(cullPass, cullCountResource, RenderGraph::USAGE_STORAGE);
+			renderGraph.write(cullPass, cullCommandsResource, RenderGraph::USAGE_STORAGE);
+		}
+	}
+
+	RenderGraph::PassId mainPass = renderGraph.addPass("main", RenderGraph::PASS_GRAPHICS,
+		[this](VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t slot) { recordMainPass(commandBuffer, imageIndex, slot); });
+	// with MSAA the swap chain image is the resolve attachment, written all the same.
+	renderGraph.write(mainPass, swapChainResource, RenderGraph::USAGE_COLOR_ATTACHMENT);
+	if (msaaSamples != VK_SAMPLE_COUNT_1_BIT) {
+		renderGraph.write(mainPass, msaaColorResource, RenderGraph::USAGE_COLOR_ATTACHMENT);
+	}
+	if (depthFormat != VK_FORMAT_UNDEFINED) {
+		renderGraph.write(mainPass, depthResource, RenderGraph::USAGE_DEPTH_ATTACHMENT);
+	}
+	if (options.gpuCulling) {
+		renderGraph.read(mainPass, cullCommandsResource, RenderGraph::USAGE_INDIRECT);
+		if (drawIndirectCount) {
+			renderGraph.read(mainPass, cullCountResource, RenderGraph::USAGE_INDIRECT);
+		}
+	}
+
+	renderGraph.compile();
+	renderGraph.printStats();
 }
 
 void HelloTriangle::createFramebuffers() {
+	VkImageView msaaColorView = VK_NULL_HANDLE;
+	VkImageView depthView = VK_NULL_HANDLE;
+	if (options.renderGraph) {
+		buildRenderGraph();
+		if (msaaSamples != VK_SAMPLE_COUNT_1_BIT) msaaColorView = renderGraph.getImageView(msaaColorResource);
+		if (depthFormat != VK_FORMAT_UNDEFINED) depthView = renderGraph.getImageView(depthResource);
+	} else {
+		if (msaaSamples != VK_SAMPLE_COUNT_1_BIT) {
+			createRenderTarget(swapChainImageFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_IMAGE_ASPECT_COLOR_BIT, msaaColorTarget);
+			msaaColorView = msaaColorTarget.view;
+		}
+		if (depthFormat != VK_FORMAT_UNDEFINED) {
+			createRenderTarget(depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT, depthTarget);
+			depthView = depthTarget.view;
+		}
+	}
+
 	swapChainFramebuffers.resize(swapChainImageViews.size());
 
 	for (size_t i = 0; i < swapChainImageViews.size(); i++) {
-		VkImageView attachments[] = {
-			swapChainImageViews[i]
-		};
+		// in the order of the render pass attachments.
+		std::vector<VkImageView> attachments = { swapChainImageViews[i] };
+		if (msaaColorView != VK_NULL_HANDLE) attachments.push_back(msaaColorView);
+		if (depthView != VK_NULL_HANDLE) attachments.push_back(depthView);
 
 		VkFramebufferCreateInfo framebufferInfo = {};
 		framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
 		framebufferInfo.renderPass = renderPass;
-		framebufferInfo.attachmentCount = 1;
-		framebufferInfo.pAttachments = attachments;
+		framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+		framebufferInfo.pAttachments = attachments.data();
 		framebufferInfo.width = swapChainExtent.width;
 		framebufferInfo.height = swapChainExtent.height;
 		framebufferInfo.layers = 1;
 
-		if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &swapChainFramebuffers[i]) != VK_SUCCESS) {
+		if (vkCreateFramebuffer(device, &framebufferInfo, allocationCallbacks, &swapChainFramebuffers[i]) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create framebuffer!");
 		}
 	}
 }
 
+// An image that only lives inside the render pass. TRANSIENT_ATTACHMENT allows LAZILY_ALLOCATED 
+// memory: on a tiled GPU the pages are only committed if the attachment ever has to leave the 
+// tile memory, which a cleared/DONT_CARE attachment never does.
+// Without such a memory type (desktop GPUs) it is an ordinary DEVICE_LOCAL image.
+void HelloTriangle::createRenderTarget(VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect, RenderTarget& target) {
+	VkImageCreateInfo imageInfo = {};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.format = format;
+	imageInfo.extent = { swapChainExtent.width, swapChainExtent.height, 1 };
+	imageInfo.mipLevels = 1;
+	imageInfo.arrayLayers = 1;
+	imageInfo.samples = msaaSamples;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.usage = usage | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	allocator.createImage(imageInfo, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		target.image, target.memory);
+
+	VkImageViewCreateInfo viewInfo = {};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.image = target.image;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewInfo.format = format;
+	viewInfo.subresourceRange.aspectMask = aspect;
+	viewInfo.subresourceRange.baseMipLevel = 0;
+	viewInfo.subresourceRange.levelCount = 1;
+	viewInfo.subresourceRange.baseArrayLayer = 0;
+	viewInfo.subresourceRange.layerCount = 1;
+	if (vkCreateImageView(device, &viewInfo, allocationCallbacks, &target.view) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create render target view!");
+	}
+}
+
+void HelloTriangle::destroyRenderTarget(RenderTarget& target) {
+	if (target.image == VK_NULL_HANDLE) return;
+	vkDestroyImageView(device, target.view, allocationCallbacks);
+	target.view = VK_NULL_HANDLE;
+	allocator.destroyImage(target.image, target.memory);
+}
+
+// how much of the transient attachments actually got memory. vkGetDeviceMemoryCommitment 
+// reports the whole VkDeviceMemory, which is the image itself unless it was sub-allocated.
+void HelloTriangle::printRenderTargetStats() {
+	const RenderTarget* targets[] = { &msaaColorTarget, &depthTarget };
+	const char* names[] = { "msaa color", "depth" };
+	for (int i = 0; i < 2; i++) {
+		const RenderTarget& target = *targets[i];
+		if (target.image == VK_NULL_HANDLE) continue;
+
+		if (allocator.getMemoryProperties(target.memory) & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) {
+			// the target has the VkDeviceMemory to itself, see MemoryAllocator::createImage.
+			VkDeviceSize committed = 0;
+			vkGetDeviceMemoryCommitment(device, target.memory.memory, &committed);
+			printf("%s target: %.2f MB lazily allocated, %.2f MB committed\n", names[i],
+				target.memory.size / (1024.0 * 1024.0), committed / (1024.0 * 1024.0));
+		} else {
+			printf("%s target: %.2f MB device local\n", names[i], target.memory.size / (1024.0 * 1024.0));
+		}
+	}
+}
+
 void HelloTriangle::createCommandPool() {
 	// Each command pool can only allocate command buffers that are submitted on a single type of queue. 
 	QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
@@ -695,13 +1298,49 @@ void HelloTriangle::createCommandPool() {
 	// VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT: Allow command buffers to be rerecorded individually, without this flag they all have to be reset together
 	poolInfo.flags = 0; // Optional
 
-	if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
+	if (vkCreateCommandPool(device, &poolInfo, allocationCallbacks, &commandPool) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create command pool!");
 	}
 }
 
+void HelloTriangle::createUploader() {
+	QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+	uploader.init(device, &allocator, queueFamilyIndices.transferFamilyIdx, transferQueue,
+		queueFamilyIndices.graphicsFamilyIdx, STAGING_RING_SIZE, timelineSemaphores ? &transferTimeline : nullptr);
+}
+
+// The most optimal memory for the GPU to read from has the VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT flag 
+// and is usually not accessible by the CPU on dedicated graphics cards. 
+// So the data goes through the staging ring and is copied by the transfer queue.
+void HelloTriangle::createVertexBuffer() {
+	VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
+	allocator.createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
+
+	uploader.upload(vertexBuffer, 0, vertices.data(), bufferSize,
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+}
+
+void HelloTriangle::createIndexBuffer() {
+	VkDeviceSize bufferSize = sizeof(vertexIndices[0]) * vertexIndices.size();
+	allocator.createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
+
+	uploader.upload(indexBuffer, 0, vertexIndices.data(), bufferSize,
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
+}
+
 // just record, not execute the cmd buffer.
 void HelloTriangle::createCommandBuffers() {
+	if (options.recordMode != RECORD_STATIC) {
+		// recorded in drawFrame, the timestamp queries and instance buffers belong to the frames in flight.
+		gpuProfiler.createSlots(static_cast<uint32_t>(frameCommandBuffers.size()), &deletionQueue);
+		createInstanceBuffers(static_cast<uint32_t>(frameCommandBuffers.size()));
+		createDescriptorSlots(static_cast<uint32_t>(frameCommandBuffers.size()));
+		createCullSlots(static_cast<uint32_t>(frameCommandBuffers.size()));
+		return;
+	}
+
 	// Command buffers will be automatically freed when their command pool is destroyed
 	commandBuffers.resize(swapChainFramebuffers.size());
 
@@ -718,6 +1357,12 @@ void HelloTriangle::createCommandBuffers() {
 		throw std::runtime_error("failed to allocate command buffers!");
 	}
 
+	// the command buffers are recorded once per image, so are their timestamp queries and instance buffers.
+	gpuProfiler.createSlots(static_cast<uint32_t>(commandBuffers.size()), &deletionQueue);
+	createInstanceBuffers(static_cast<uint32_t>(commandBuffers.size()));
+	createDescriptorSlots(static_cast<uint32_t>(commandBuffers.size()));
+	createCullSlots(static_cast<uint32_t>(commandBuffers.size()));
+
 	// Starting command buffer recording
 	for (size_t i = 0; i < commandBuffers.size(); i++) {
 		VkCommandBufferBeginInfo beginInfo = {};
@@ -735,35 +1380,7 @@ void HelloTriangle::createCommandBuffers() {
 		// It's not possible to append commands to a buffer at a later time.
 		vkBeginCommandBuffer(commandBuffers[i], &beginInfo);
 
-		// Starting a render pass
-		VkRenderPassBeginInfo renderPassInfo = {};
-		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassInfo.renderPass = renderPass;
-		renderPassInfo.framebuffer = swapChainFramebuffers[i];
-		// The render area defines where shader loads and stores will take place.
-		renderPassInfo.renderArea.offset = { 0, 0 };
-		renderPassInfo.renderArea.extent = swapChainExtent;
-		VkClearValue clearColor = { 0.0f, 0.0f, 0.0f, 1.0f };
-		renderPassInfo.clearValueCount = 1;
-		renderPassInfo.pClearValues = &clearColor;
-
-		// The final parameter controls how the drawing commands within the render pass will be provided.
-		//		VK_SUBPASS_CONTENTS_INLINE: The render pass commands will be embedded in the primary 
-		//			command buffer itself and no secondary command buffers will be executed.
-		//		VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS: The render pass commands will be executed from secondary command buffers.
-		vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-		// Basic drawing commands
-		vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
-
-		// vertexCount: Even though we don't have a vertex buffer, we technically still have 3 vertices to draw.
-		// instanceCount: Used for instanced rendering, use 1 if you're not doing that.
-		// firstVertex : Used as an offset into the vertex buffer, defines the lowest value of gl_VertexIndex.
-		// firstInstance : Used as an offset for instanced rendering, defines the lowest value of gl_InstanceIndex.
-		vkCmdDraw(commandBuffers[i], 3, 1, 0, 0);
-
-		// Finishing up
-		vkCmdEndRenderPass(commandBuffers[i]);
+		recordFrame(commandBuffers[i], static_cast<uint32_t>(i), static_cast<uint32_t>(i));
 
 		if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS) {
 			throw std::runtime_error("failed to record command buffer!");
@@ -771,73 +1388,948 @@ void HelloTriangle::createCommandBuffers() {
 	}
 }
 
-void HelloTriangle::createSemaphores() {
+// the commands of one frame, used by all the record modes. 
+// slot: the GpuProfiler slot and instance buffer of the command buffer, which must not be in use by the GPU.
+void HelloTriangle::recordFrame(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t slot) {
+	gpuProfiler.resetSlot(commandBuffer, slot);
+	gpuProfiler.beginRegion(commandBuffer, slot, "frame");
+
+	if (options.renderGraph) {
+		// the same passes, with the barriers in between from the graph.
+		renderGraph.bindImage(swapChainResource, swapChainImages[imageIndex]);
+		if (options.gpuCulling) {
+			renderGraph.bindBuffer(cullCommandsResource, cullSlots[slot].commandsBuffer);
+			renderGraph.bindBuffer(cullCountResource, cullSlots[slot].countBuffer);
+		}
+		renderGraph.execute(commandBuffer, imageIndex, slot);
+	} else {
+		// a dispatch is not allowed inside a render pass.
+		if (options.gpuCulling && !options.asyncCompute) {
+			gpuProfiler.beginRegion(commandBuffer, slot, "cull");
+			recordCull(commandBuffer, slot);
+			gpuProfiler.endRegion(commandBuffer, slot, "cull");
+		}
+		recordMainPass(commandBuffer, imageIndex, slot);
+	}
+
+	gpuProfiler.endRegion(commandBuffer, slot, "frame");
+}
+
+// the render pass with the draws.
+void HelloTriangle::recordMainPass(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t slot) {
+	bool threaded = options.recordMode == RECORD_THREADED;
+
+	// Starting a render pass
+	VkRenderPassBeginInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = renderPass;
+	renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
+	// The render area defines where shader loads and stores will take place.
+	renderPassInfo.renderArea.offset = { 0, 0 };
+	renderPassInfo.renderArea.extent = swapChainExtent;
+	// one per attachment, in the same order. The resolve attachment is not cleared, its value is ignored.
+	VkClearValue clearValues[3] = {};
+	uint32_t clearValueCount = 0;
+	clearValues[clearValueCount++].color = { 0.0f, 0.0f, 0.0f, 1.0f };
+	if (msaaSamples != VK_SAMPLE_COUNT_1_BIT) {
+		clearValues[clearValueCount++].color = { 0.0f, 0.0f, 0.0f, 1.0f };
+	}
+	if (depthFormat != VK_FORMAT_UNDEFINED) {
+		clearValues[clearValueCount++].depthStencil = { 1.0f, 0 };
+	}
+	renderPassInfo.clearValueCount = clearValueCount;
+	renderPassInfo.pClearValues = clearValues;
+
+	// The final parameter controls how the drawing commands within the render pass will be provided.
+	//		VK_SUBPASS_CONTENTS_INLINE: The render pass commands will be embedded in the primary 
+	//			command buffer itself and no secondary command buffers will be executed.
+	//		VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS: The render pass commands will be executed from secondary command buffers.
+	// outside of the render pass, so the load (clear) and store operations are included.
+	gpuProfiler.beginRegion(commandBuffer, slot, "render pass");
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, threaded ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+
+	if (threaded) {
+		// the secondaries don't know the render pass and framebuffer they will be executed in,
+		// the inheritance info tells them (the framebuffer is optional, but may allow driver optimizations).
+		VkCommandBufferInheritanceInfo inheritanceInfo = {};
+		inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritanceInfo.renderPass = renderPass;
+		inheritanceInfo.subpass = 0;
+		inheritanceInfo.framebuffer = swapChainFramebuffers[imageIndex];
+
+		std::vector<VkCommandBuffer> secondaries;
+		recordThreadPool.record(static_cast<uint32_t>(currentFrame), inheritanceInfo, drawList.size(),
+			[this, slot](VkCommandBuffer secondary, size_t first, size_t last) { recordDraws(secondary, slot, first, last); },
+			secondaries);
+		vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+	} else {
+		recordDraws(commandBuffer, slot, 0, drawList.size());
+	}
+
+	// Finishing up
+	vkCmdEndRenderPass(commandBuffer);
+	gpuProfiler.endRegion(commandBuffer, slot, "render pass");
+}
+
+// the draws [first, last) of the draw list, with all the state they need:
+// a secondary command buffer does not inherit any state from the primary.
+void HelloTriangle::recordDraws(VkCommandBuffer commandBuffer, uint32_t slot, size_t first, size_t last) {
+	// Basic drawing commands
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+
+	// the dynamic states of the pipeline.
+	VkViewport viewport = {};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = (float)swapChainExtent.width;
+	viewport.height = (float)swapChainExtent.height;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+	VkRect2D scissor = {};
+	scissor.offset = { 0, 0 };
+	scissor.extent = swapChainExtent;
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+	VkBuffer vertexBuffers[] = { vertexBuffer, instanceBuffers[slot] };
+	VkDeviceSize offsets[] = { 0, 0 };
+	vkCmdBindVertexBuffers(commandBuffer, 0, 2, vertexBuffers, offsets);
+	vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT16);
+
+	const DescriptorSlot& descriptorSlot = descriptorSlots[slot];
+
+	// two dynamic offsets, in binding order: the ObjectUniforms of the draw (binding 0), 
+	// and the start of the ObjectUniforms array (binding 1).
+	uint32_t dynamicOffsets[] = {
+		static_cast<uint32_t>(descriptorSlot.firstObjectOffset), static_cast<uint32_t>(descriptorSlot.firstObjectOffset)
+	};
+	VkShaderStageFlags pushConstantStages = pushConstantRanges.empty() ? 0 : pushConstantRanges[0].stageFlags;
+
+	// the draw list is replaced by the commands of the cull shader, they all use the per draw data of draw 0.
+	if (options.gpuCulling) {
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSlot.objectSet, 2, dynamicOffsets);
+		PerDrawConstants constants = { drawList[0].transform, 0 };
+		vkCmdPushConstants(commandBuffer, pipelineLayout, pushConstantStages, 0, sizeof(constants), &constants);
+		recordIndirectDraws(commandBuffer, slot);
+		return;
+	}
+
+	// the shader reads the per draw data through push constants or the storage buffer 
+	// array, the set is bound once. The shader still references it either way.
+	// With the uniform buffer the push constants are never read, but they are pushed 
+	// once so nothing the shader declares is left undefined.
+	if (options.perDrawMode != PER_DRAW_UNIFORM_BUFFER) {
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSlot.objectSet, 2, dynamicOffsets);
+	} else {
+		PerDrawConstants constants = { glm::mat4(1.0f), 0 };
+		vkCmdPushConstants(commandBuffer, pipelineLayout, pushConstantStages, 0, sizeof(constants), &constants);
+	}
+
+	// indexCount: the number of indices to draw.
+	// instanceCount: Used for instanced rendering, use 1 if you're not doing that.
+	// firstIndex : Used as an offset into the index buffer.
+	// vertexOffset : added to the index before indexing into the vertex buffer.
+	// firstInstance : Used as an offset for instanced rendering, defines the lowest value of gl_InstanceIndex.
+	uint32_t instanceCount = static_cast<uint32_t>(instances.size());
+	VkPipeline boundPipeline = graphicsPipeline;
+	for (size_t i = first; i < last; i++) {
+		// the draw list is sorted by nothing, so only rebind when the pipeline actually changes.
+		// Pre-recorded command buffers need the real pipeline right away; when recording every frame 
+		// a missing one is compiled in the background, and the draw uses the base pipeline until it is done.
+		uint32_t material = drawList[i].material;
+		VkPipeline pipeline = graphicsPipeline;
+		if (material != 0) {
+			pipeline = options.recordMode == RECORD_STATIC ? pipelineLibrary.get(materialDescs[material]) :
+				pipelineLibrary.getOrQueue(materialDescs[material], graphicsPipeline);
+		}
+		if (pipeline != boundPipeline) {
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+			boundPipeline = pipeline;
+		}
+
+		if (options.perDrawMode == PER_DRAW_UNIFORM_BUFFER) {
+			// the same set for every draw, only the offset into the uniform buffer changes.
+			dynamicOffsets[0] = static_cast<uint32_t>(descriptorSlot.firstObjectOffset + objectUniformsStride * i);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSlot.objectSet, 2, dynamicOffsets);
+		} else if (options.perDrawMode == PER_DRAW_PUSH_CONSTANTS) {
+			// the data goes into the command buffer itself: no memory write, no descriptor.
+			PerDrawConstants constants = { drawList[i].transform, static_cast<uint32_t>(i) };
+			vkCmdPushConstants(commandBuffer, pipelineLayout, pushConstantStages, 0, sizeof(constants), &constants);
+		} else {
+			// only the index, the transform is read from the array.
+			uint32_t objectIndex = static_cast<uint32_t>(i);
+			vkCmdPushConstants(commandBuffer, pipelineLayout, pushConstantStages, offsetof(PerDrawConstants, objectIndex), sizeof(objectIndex), &objectIndex);
+		}
+		vkCmdDrawIndexed(commandBuffer, drawList[i].indexCount, instanceCount, drawList[i].firstIndex, drawList[i].vertexOffset, 0);
+	}
+}
+
+// the same triangle drawCount times, as a stand-in for a scene with many objects.
+void HelloTriangle::createDrawList() {
+	drawList.resize(static_cast<size_t>(std::max(1, options.drawCount)));
+	uint32_t materialCount = static_cast<uint32_t>(std::max(1, std::min(options.materialCount, MAX_MATERIALS)));
+	for (size_t i = 0; i < drawList.size(); i++) {
+		DrawItem& draw = drawList[i];
+		draw.indexCount = static_cast<uint32_t>(vertexIndices.size());
+		draw.firstIndex = 0;
+		draw.vertexOffset = 0;
+		draw.material = static_cast<uint32_t>(i) % materialCount;
+		// each draw of the list rotated a bit further, so they don't all cover each other.
+		float angle = glm::radians(360.0f) * i / drawList.size();
+		draw.transform = glm::rotate(glm::mat4(1.0f), angle, glm::vec3(0.0f, 0.0f, 1.0f));
+	}
+	printf("draws = %d, materials = %d\n", (int)drawList.size(), (int)materialCount);
+
+	instances.resize(static_cast<size_t>(std::max(1, options.instanceCount)));
+	if (options.gpuCulling) {
+		printf("instances = %d, culled on the GPU\n", (int)instances.size());
+	} else {
+		printf("instances = %d per draw, %lld triangles per frame\n", (int)instances.size(),
+			(long long)instances.size() * (long long)drawList.size());
+	}
+}
+
+// Each instance buffer is written by the CPU every frame and read once by the GPU, 
+// so there is no point in a DEVICE_LOCAL copy: the vertex fetch reads the host memory directly.
+void HelloTriangle::createInstanceBuffers(uint32_t slotCount) {
+	VkDeviceSize bufferSize = sizeof(InstanceData) * instances.size();
+	instanceBuffers.resize(slotCount);
+	instanceBuffersMemory.resize(slotCount);
+	for (uint32_t i = 0; i < slotCount; i++) {
+		allocator.createBuffer(bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, instanceBuffers[i], instanceBuffersMemory[i]);
+	}
+}
+
+// the frames in flight may still read them, see cleanupSwapChain.
+void HelloTriangle::destroyInstanceBuffers() {
+	std::vector<VkBuffer> buffers = instanceBuffers;
+	std::vector<MemoryAllocator::Allocation> buffersMemory = instanceBuffersMemory;
+	deletionQueue.push([this, buffers, buffersMemory]() mutable {
+		for (size_t i = 0; i < buffers.size(); i++) {
+			allocator.destroyBuffer(buffers[i], buffersMemory[i]);
+		}
+	});
+	instanceBuffers.clear();
+	instanceBuffersMemory.clear();
+}
+
+void HelloTriangle::createDescriptorSlots(uint32_t slotCount) {
+	// the dynamic uniform buffer offset of each draw has to be aligned, the storage buffer 
+	// is a plain array that only needs its start aligned.
+	VkDeviceSize alignment = physicalDeviceProperties.limits.minUniformBufferOffsetAlignment;
+	if (options.perDrawMode == PER_DRAW_STORAGE_BUFFER) {
+		objectUniformsStride = sizeof(ObjectUniforms);
+	} else {
+		objectUniformsStride = (sizeof(ObjectUniforms) + alignment - 1) / alignment * alignment;
+	}
+
+	descriptorSlots.resize(slotCount);
+	for (uint32_t i = 0; i < slotCount; i++) {
+		DescriptorSlot& descriptorSlot = descriptorSlots[i];
+		descriptorSlot.frameAllocator.init(device);
+		// one extra alignment, for the aligned start of the array.
+		descriptorSlot.objectUniforms = allocator.createLinearRegion(objectUniformsStride * drawList.size() + getObjectUniformsAlignment(),
+			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+
+		// the command buffers of the slot are recorded once, so are their descriptors.
+		// With push constants the buffer is only there for the descriptors, it's never rewritten.
+		if (options.recordMode == RECORD_STATIC || options.perDrawMode == PER_DRAW_PUSH_CONSTANTS) {
+			writeObjectUniforms(i, slotDescriptorAllocator);
+		}
+	}
+}
+
+// the start of the ObjectUniforms is a dynamic offset of both a uniform and a storage buffer.
+VkDeviceSize HelloTriangle::getObjectUniformsAlignment() const {
+	return std::max(physicalDeviceProperties.limits.minUniformBufferOffsetAlignment,
+		physicalDeviceProperties.limits.minStorageBufferOffsetAlignment);
+}
+
+void HelloTriangle::destroyDescriptorSlots() {
+	// the slot sets of this and the other per slot resources. Resetting the pools would 
+	// pull the sets out from under the frames in flight, so the new slots get new pools.
+	std::vector<DescriptorSlot> slots = descriptorSlots;
+	DescriptorAllocator slotAllocator = slotDescriptorAllocator;
+	deletionQueue.push([this, slots, slotAllocator]() mutable {
+		for (auto& descriptorSlot : slots) {
+			descriptorSlot.frameAllocator.destroy();
+			allocator.destroyLinearRegion(descriptorSlot.objectUniforms);
+		}
+		slotAllocator.destroy();
+	});
+	descriptorSlots.clear();
+	slotDescriptorAllocator = DescriptorAllocator();
+	slotDescriptorAllocator.init(device);
+}
+
+// the ObjectUniforms of every draw, and the one descriptor set they are read through.
+void HelloTriangle::writeObjectUniforms(uint32_t slot, DescriptorAllocator& descriptorAllocator) {
+	DescriptorSlot& descriptorSlot = descriptorSlots[slot];
+	descriptorSlot.objectUniforms.reset();
+	if (!descriptorSlot.objectUniforms.allocate(objectUniformsStride * drawList.size(), getObjectUniformsAlignment(), descriptorSlot.firstObjectOffset)) {
+		throw std::runtime_error("object uniforms don't fit into their region!");
+	}
+
+	char* mapped = static_cast<char*>(descriptorSlot.objectUniforms.allocation.mapped) + descriptorSlot.firstObjectOffset;
+	for (size_t i = 0; i < drawList.size(); i++) {
+		ObjectUniforms uniforms;
+		uniforms.transform = drawList[i].transform;
+		memcpy(mapped + objectUniformsStride * i, &uniforms, sizeof(uniforms));
+	}
+	allocator.flush(descriptorSlot.objectUniforms.allocation);
+
+	// binding 0: the range is one ObjectUniforms, the dynamic offset selects which one.
+	// binding 1: all of them, the dynamic offset is the start of the array.
+	descriptorSlot.objectSet = descriptorAllocator.allocate(objectSetLayout);
+	VkDescriptorBufferInfo bufferInfos[2] = {};
+	bufferInfos[0].buffer = descriptorSlot.objectUniforms.buffer;
+	bufferInfos[0].offset = 0;
+	bufferInfos[0].range = sizeof(ObjectUniforms);
+	bufferInfos[1].buffer = descriptorSlot.objectUniforms.buffer;
+	bufferInfos[1].offset = 0;
+	bufferInfos[1].range = objectUniformsStride * drawList.size();
+
+	VkWriteDescriptorSet descriptorWrites[2] = {};
+	for (uint32_t binding = 0; binding < 2; binding++) {
+		descriptorWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[binding].dstSet = descriptorSlot.objectSet;
+		descriptorWrites[binding].dstBinding = binding;
+		descriptorWrites[binding].descriptorCount = 1;
+		descriptorWrites[binding].pBufferInfo = &bufferInfos[binding];
+	}
+	descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	vkUpdateDescriptorSets(device, 2, descriptorWrites, 0, nullptr);
+}
+
+// the previous frame that used this slot must have finished on the GPU.
+void HelloTriangle::writeFrameData(uint32_t slot) {
+	memcpy(instanceBuffersMemory[slot].mapped, instances.data(), sizeof(InstanceData) * instances.size());
+	allocator.flush(instanceBuffersMemory[slot]);
+
+	// recorded every frame: the frame's descriptors are thrown away with one vkResetDescriptorPool.
+	// Push constants are recorded with the draws, there is nothing to write.
+	if (options.recordMode != RECORD_STATIC && options.perDrawMode != PER_DRAW_PUSH_CONSTANTS) {
+		descriptorSlots[slot].frameAllocator.reset();
+		writeObjectUniforms(slot, descriptorSlots[slot].frameAllocator);
+	}
+
+	if (options.gpuCulling) {
+		// the frustum planes of viewProj (Gribb/Hartmann), in world space. 
+		// glm is column major: row i of the matrix is (m[0][i], m[1][i], m[2][i], m[3][i]).
+		glm::vec4 row[4];
+		for (int i = 0; i < 4; i++) {
+			row[i] = glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]);
+		}
+		CullParams params = {};
+		params.planes[0] = row[3] + row[0];	// left:	-w <= x
+		params.planes[1] = row[3] - row[0];	// right:	x <= w
+		params.planes[2] = row[3] + row[1];	// top:		-w <= y
+		params.planes[3] = row[3] - row[1];	// bottom:	y <= w
+		params.planes[4] = row[2];			// near:	0 <= z (Vulkan clip space)
+		params.planes[5] = row[3] - row[2];	// far:		z <= w
+		for (auto& plane : params.planes) {
+			// normalized, so the distance can be compared with the sphere radius.
+			plane /= glm::length(glm::vec3(plane));
+		}
+		params.objectCount = static_cast<uint32_t>(instances.size());
+		params.indexCount = static_cast<uint32_t>(vertexIndices.size());
+		params.compact = drawIndirectCount ? 1 : 0;
+
+		memcpy(cullSlots[slot].paramsMemory.mapped, &params, sizeof(params));
+		allocator.flush(cullSlots[slot].paramsMemory);
+	}
+}
+
+// The cull shader runs on the graphics queue, in the same command buffer right before 
+// the render pass that consumes its commands: a pipeline barrier is all the sync it needs.
+void HelloTriangle::createCullPipeline() {
+	// Every graphics queue family of the real world supports compute, but the spec doesn't promise it.
+	QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+	if (!(queueFamilies[queueFamilyIndices.graphicsFamilyIdx].queueFlags & VK_QUEUE_COMPUTE_BIT)) {
+		throw std::runtime_error("GPU culling needs a graphics queue that supports compute!");
+	}
+
+	// binding 0: CullParams, 1: bounding spheres, 2: draw commands, 3: draw count.
+	std::array<VkDescriptorSetLayoutBinding, 4> bindings = {};
+	for (uint32_t i = 0; i < bindings.size(); i++) {
+		bindings[i].binding = i;
+		bindings[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+	cullDescriptorSetLayout = descriptorLayoutCache.getLayout(layoutInfo);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &cullDescriptorSetLayout;
+	if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, allocationCallbacks, &cullPipelineLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create cull pipeline layout!");
+	}
+
+	VkShaderModule compShaderModule = createShaderModule(HelloTriangleCullCompSpv, sizeof(HelloTriangleCullCompSpv));
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = compShaderModule;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = cullPipelineLayout;
+	if (vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, allocationCallbacks, &cullPipeline) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create cull pipeline!");
+	}
+
+	vkDestroyShaderModule(device, compShaderModule, allocationCallbacks);
+
+	if (options.asyncCompute) {
+		if (queueFamilyIndices.computeFamilyIdx == queueFamilyIndices.graphicsFamilyIdx) {
+			std::cout << "no compute-only queue family, the async cull pass shares the graphics queue" << std::endl;
+		}
+
+		VkCommandPoolCreateInfo poolInfo = {};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.queueFamilyIndex = queueFamilyIndices.computeFamilyIdx;
+		if (vkCreateCommandPool(device, &poolInfo, allocationCallbacks, &computeCommandPool) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create compute command pool!");
+		}
+	}
+}
+
+// The instances only spin around their centers, so their bounding spheres never change: 
+// uploaded once, the per-frame data is the frustum.
+void HelloTriangle::createBoundingSpheres() {
+	// the radius of the triangle around its origin, before the instance transform.
+	float vertexRadius = 0.0f;
+	for (const auto& vertex : vertices) {
+		vertexRadius = std::max(vertexRadius, glm::length(vertex.pos));
+	}
+
+	std::vector<glm::vec4> spheres(instances.size());
+	for (size_t i = 0; i < spheres.size(); i++) {
+		glm::vec3 center;
+		float cellSize;
+		getGridCell(i, spheres.size(), center, cellSize);
+		spheres[i] = glm::vec4(center, vertexRadius * cellSize);
+	}
+
+	VkDeviceSize bufferSize = sizeof(glm::vec4) * spheres.size();
+	allocator.createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, boundingSpheresBuffer, boundingSpheresMemory);
+
+	if (options.asyncCompute) {
+		// only read by the compute queue. The uploader hands its buffers over to the graphics 
+		// queue family, so this one is copied once on the compute queue itself, at startup.
+		VkBuffer stagingBuffer;
+		MemoryAllocator::Allocation stagingMemory;
+		allocator.createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+			stagingBuffer, stagingMemory);
+		memcpy(stagingMemory.mapped, spheres.data(), static_cast<size_t>(bufferSize));
+		allocator.flush(stagingMemory);
+
+		VkCommandBufferAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = computeCommandPool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+		VkCommandBuffer commandBuffer;
+		if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate command buffer!");
+		}
+
+		VkCommandBufferBeginInfo beginInfo = {};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		vkBeginCommandBuffer(commandBuffer, &beginInfo);
+		VkBufferCopy copyRegion = {};
+		copyRegion.size = bufferSize;
+		vkCmdCopyBuffer(commandBuffer, stagingBuffer, boundingSpheresBuffer, 1, &copyRegion);
+		vkEndCommandBuffer(commandBuffer);
+
+		VkSubmitInfo submitInfo = {};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &commandBuffer;
+		if (vkQueueSubmit(computeQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+			throw std::runtime_error("failed to submit bounding sphere copy!");
+		}
+		vkQueueWaitIdle(computeQueue);
+
+		vkFreeCommandBuffers(device, computeCommandPool, 1, &commandBuffer);
+		allocator.destroyBuffer(stagingBuffer, stagingMemory);
+	} else {
+		// 1M spheres are 16MB, more than the staging ring holds at once.
+		const VkDeviceSize chunkSize = STAGING_RING_SIZE / 2;
+		for (VkDeviceSize offset = 0; offset < bufferSize; offset += chunkSize) {
+			uploader.upload(boundingSpheresBuffer, offset, reinterpret_cast<const char*>(spheres.data()) + offset,
+				std::min(chunkSize, bufferSize - offset), VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+		}
+	}
+
+	// maxDrawIndirectCount can be as low as 65535, then the draws are split into several calls.
+	uint32_t maxDrawIndirectCount = physicalDeviceProperties.limits.maxDrawIndirectCount;
+	if (drawIndirectCount && instances.size() > maxDrawIndirectCount) {
+		drawIndirectCount = false;
+	}
+	printf("GPU culling: %s\n", drawIndirectCount ? "vkCmdDrawIndexedIndirectCountKHR" :
+		multiDrawIndirect ? "vkCmdDrawIndexedIndirect" : "vkCmdDrawIndexedIndirect per object (no multiDrawIndirect)");
+}
+
+void HelloTriangle::createCullSlots(uint32_t slotCount) {
+	if (!options.gpuCulling) return;
+
+	// with async compute, the commands are written by the compute queue and read by the graphics queue.
+	// CONCURRENT sharing instead of a queue family ownership transfer every frame.
+	QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+	uint32_t sharedFamilies[] = {
+		static_cast<uint32_t>(queueFamilyIndices.graphicsFamilyIdx), static_cast<uint32_t>(queueFamilyIndices.computeFamilyIdx)
+	};
+	VkBufferCreateInfo outputBufferInfo = {};
+	outputBufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	outputBufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	if (options.asyncCompute && sharedFamilies[0] != sharedFamilies[1]) {
+		outputBufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		outputBufferInfo.queueFamilyIndexCount = 2;
+		outputBufferInfo.pQueueFamilyIndices = sharedFamilies;
+	} else {
+		outputBufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	}
+
 	VkSemaphoreCreateInfo semaphoreInfo = {};
 	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-	if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphore) != VK_SUCCESS ||
-		vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphore) != VK_SUCCESS) {
+	cullSlots.resize(slotCount);
+	for (uint32_t i = 0; i < slotCount; i++) {
+		CullSlot& cullSlot = cullSlots[i];
+		// written once, freed with the other slot sets in destroyDescriptorSlots.
+		cullSlot.descriptorSet = slotDescriptorAllocator.allocate(cullDescriptorSetLayout);
+		allocator.createBuffer(sizeof(CullParams), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, cullSlot.paramsBuffer, cullSlot.paramsMemory);
+		outputBufferInfo.size = sizeof(VkDrawIndexedIndirectCommand) * instances.size();
+		allocator.createBuffer(outputBufferInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, cullSlot.commandsBuffer, cullSlot.commandsMemory);
+		outputBufferInfo.size = sizeof(uint32_t);
+		allocator.createBuffer(outputBufferInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, cullSlot.countBuffer, cullSlot.countMemory);
+
+		VkDescriptorBufferInfo bufferInfos[4] = {
+			{ cullSlot.paramsBuffer, 0, VK_WHOLE_SIZE },
+			{ boundingSpheresBuffer, 0, VK_WHOLE_SIZE },
+			{ cullSlot.commandsBuffer, 0, VK_WHOLE_SIZE },
+			{ cullSlot.countBuffer, 0, VK_WHOLE_SIZE }
+		};
+		VkWriteDescriptorSet descriptorWrites[4] = {};
+		for (uint32_t binding = 0; binding < 4; binding++) {
+			descriptorWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptorWrites[binding].dstSet = cullSlot.descriptorSet;
+			descriptorWrites[binding].dstBinding = binding;
+			descriptorWrites[binding].descriptorCount = 1;
+			descriptorWrites[binding].descriptorType = binding == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			descriptorWrites[binding].pBufferInfo = &bufferInfos[binding];
+		}
+		vkUpdateDescriptorSets(device, 4, descriptorWrites, 0, nullptr);
+
+		if (options.asyncCompute) {
+			VkCommandBufferAllocateInfo commandBufferInfo = {};
+			commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			commandBufferInfo.commandPool = computeCommandPool;
+			commandBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			commandBufferInfo.commandBufferCount = 1;
+			if (vkAllocateCommandBuffers(device, &commandBufferInfo, &cullSlot.computeCommandBuffer) != VK_SUCCESS ||
+				(!timelineSemaphores && vkCreateSemaphore(device, &semaphoreInfo, allocationCallbacks, &cullSlot.cullFinishedSemaphore) != VK_SUCCESS)) {
+				throw std::runtime_error("failed to create async compute objects!");
+			}
 
-		throw std::runtime_error("failed to create semaphores!");
+			// everything that changes per frame is in the params buffer, so it is recorded once.
+			VkCommandBufferBeginInfo beginInfo = {};
+			beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			vkBeginCommandBuffer(cullSlot.computeCommandBuffer, &beginInfo);
+			recordCull(cullSlot.computeCommandBuffer, i);
+			if (vkEndCommandBuffer(cullSlot.computeCommandBuffer) != VK_SUCCESS) {
+				throw std::runtime_error("failed to record compute command buffer!");
+			}
+		}
 	}
 }
+
+void HelloTriangle::destroyCullSlots() {
+	if (cullSlots.empty()) return;
+
+	std::vector<CullSlot> slots = cullSlots;
+	deletionQueue.push([this, slots]() mutable {
+		for (auto& cullSlot : slots) {
+			allocator.destroyBuffer(cullSlot.paramsBuffer, cullSlot.paramsMemory);
+			allocator.destroyBuffer(cullSlot.commandsBuffer, cullSlot.commandsMemory);
+			allocator.destroyBuffer(cullSlot.countBuffer, cullSlot.countMemory);
+			if (cullSlot.computeCommandBuffer != VK_NULL_HANDLE) {
+				vkFreeCommandBuffers(device, computeCommandPool, 1, &cullSlot.computeCommandBuffer);
+			}
+			vkDestroySemaphore(device, cullSlot.cullFinishedSemaphore, allocationCallbacks);
+		}
+	});
+	cullSlots.clear();
+}
+
+// clear the count, cull, and make the commands visible to the indirect draws.
+void HelloTriangle::recordCull(VkCommandBuffer commandBuffer, uint32_t slot) {
+	recordCullClear(commandBuffer, slot);
+
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	recordCullDispatch(commandBuffer, slot);
+
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+		0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void HelloTriangle::recordCullClear(VkCommandBuffer commandBuffer, uint32_t slot) {
+	vkCmdFillBuffer(commandBuffer, cullSlots[slot].countBuffer, 0, sizeof(uint32_t), 0);
+}
+
+void HelloTriangle::recordCullDispatch(VkCommandBuffer commandBuffer, uint32_t slot) {
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &cullSlots[slot].descriptorSet, 0, nullptr);
+	uint32_t objectCount = static_cast<uint32_t>(instances.size());
+	vkCmdDispatch(commandBuffer, (objectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+}
+
+// The previous submission of the slot has finished: the graphics submit that waited on it is done.
+// While the graphics queue is still busy with the previous frame, the compute queue can already cull 
+// this one, the graphics submit of the frame waits on cullFinishedSemaphore before its indirect draws.
+// Returns the computeTimeline value to wait for instead, 0 without timelineSemaphores.
+uint64_t HelloTriangle::submitAsyncCull(uint32_t slot) {
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &cullSlots[slot].computeCommandBuffer;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &cullSlots[slot].cullFinishedSemaphore;
+
+	uint64_t value = 0;
+	VkSemaphore timelineSemaphore = computeTimeline.get();
+	TimelineSubmitInfo timelineInfo;
+	if (timelineSemaphores) {
+		value = computeTimeline.nextValue();
+		timelineInfo.signalValues.push_back(value);
+		timelineInfo.attach(submitInfo);
+		submitInfo.pSignalSemaphores = &timelineSemaphore;
+	}
+	if (vkQueueSubmit(computeQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+		throw std::runtime_error("failed to submit cull command buffer!");
+	}
+	return value;
+}
+
+// one command per object, written by the cull shader.
+void HelloTriangle::recordIndirectDraws(VkCommandBuffer commandBuffer, uint32_t slot) {
+	const CullSlot& cullSlot = cullSlots[slot];
+	uint32_t objectCount = static_cast<uint32_t>(instances.size());
+	uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+
+#ifdef VK_KHR_draw_indirect_count
+	if (drawIndirectCount) {
+		// the number of commands is read from the count buffer, objectCount is only the upper bound.
+		pfnCmdDrawIndexedIndirectCount(commandBuffer, cullSlot.commandsBuffer, 0, cullSlot.countBuffer, 0, objectCount, stride);
+		return;
+	}
+#endif
+	if (multiDrawIndirect) {
+		uint32_t maxDraws = physicalDeviceProperties.limits.maxDrawIndirectCount;
+		for (uint32_t first = 0; first < objectCount; first += maxDraws) {
+			vkCmdDrawIndexedIndirect(commandBuffer, cullSlot.commandsBuffer, first * stride, std::min(maxDraws, objectCount - first), stride);
+		}
+	} else {
+		for (uint32_t i = 0; i < objectCount; i++) {
+			vkCmdDrawIndexedIndirect(commandBuffer, cullSlot.commandsBuffer, i * stride, 1, stride);
+		}
+	}
+}
+
+void HelloTriangle::createFrameCommandPools() {
+	if (options.recordMode == RECORD_STATIC) return;
+
+	QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+	size_t framesInFlight = static_cast<size_t>(std::max(1, options.framesInFlight));
+
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamilyIdx;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+	frameCommandPools.resize(framesInFlight);
+	frameCommandBuffers.resize(framesInFlight);
+	for (size_t i = 0; i < framesInFlight; i++) {
+		if (vkCreateCommandPool(device, &poolInfo, allocationCallbacks, &frameCommandPools[i]) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create frame command pool!");
+		}
+
+		VkCommandBufferAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = frameCommandPools[i];
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+		if (vkAllocateCommandBuffers(device, &allocInfo, &frameCommandBuffers[i]) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate frame command buffer!");
+		}
+	}
+
+	if (options.recordMode == RECORD_THREADED) {
+		recordThreadPool.init(device, queueFamilyIndices.graphicsFamilyIdx,
+			static_cast<uint32_t>(std::max(0, options.recordThreads)), static_cast<uint32_t>(framesInFlight));
+	}
+}
+
+// record the primary command buffer of currentFrame, its previous submission must have finished.
+VkCommandBuffer HelloTriangle::recordFrameCommandBuffer(uint32_t imageIndex) {
+	// reset the pool as a whole instead of the command buffer, it can keep its memory for the next recording.
+	vkResetCommandPool(device, frameCommandPools[currentFrame], 0);
+
+	VkCommandBuffer commandBuffer = frameCommandBuffers[currentFrame];
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+	recordFrame(commandBuffer, imageIndex, static_cast<uint32_t>(currentFrame));
+
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to record command buffer!");
+	}
+	return commandBuffer;
+}
+
+void HelloTriangle::createSyncObjects() {
+	size_t framesInFlight = static_cast<size_t>(std::max(1, options.framesInFlight));
+	printf("frames in flight = %d\n", (int)framesInFlight);
+	imageAvailableSemaphores.resize(framesInFlight);
+	renderFinishedSemaphores.resize(framesInFlight);
+	inFlightFences.assign(framesInFlight, VK_NULL_HANDLE);
+	frameTimelineValues.assign(framesInFlight, 0);
+
+	VkSemaphoreCreateInfo semaphoreInfo = {};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	// create it signaled, otherwise the first wait in drawFrame would never return.
+	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+	for (size_t i = 0; i < framesInFlight; i++) {
+		if (vkCreateSemaphore(device, &semaphoreInfo, allocationCallbacks, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
+			vkCreateSemaphore(device, &semaphoreInfo, allocationCallbacks, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
+			(!timelineSemaphores && vkCreateFence(device, &fenceInfo, allocationCallbacks, &inFlightFences[i]) != VK_SUCCESS)) {
+
+			throw std::runtime_error("failed to create synchronization objects for a frame!");
+		}
+	}
+}
+
+// Frame N signals the value N + 1 of the graphics timeline, so its counter is the number 
+// of finished frames. With fences, only what drawFrame waited for is known: the previous 
+// frame of the current slot, and everything submitted before it.
+uint64_t HelloTriangle::getCompletedFrames() {
+	if (timelineSemaphores) {
+		return graphicsTimeline.getCompleted();
+	}
+	uint64_t framesInFlight = inFlightFences.size();
+	return frameNumber >= framesInFlight ? frameNumber - framesInFlight + 1 : 0;
+}
+
 void HelloTriangle::updateAppState() {
 	// do sth in CPU while the previous frame is being rendered. 
 	// That way you keep both the GPU and CPU busy at all times.
+	float time = std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count();
+
+	// with GPU culling the camera zooms in and pans around, so a part of the grid is outside of the view.
+	if (options.gpuCulling) {
+		float zoom = 2.0f + std::sin(time * 0.5f);
+		glm::vec3 pan(0.5f * std::cos(time * 0.3f), 0.5f * std::sin(time * 0.3f), 0.0f);
+		viewProj = glm::scale(glm::mat4(1.0f), glm::vec3(zoom, zoom, 1.0f)) * glm::translate(glm::mat4(1.0f), -pan);
+	}
+
+	// the instances on a square grid, each one shrunk into its cell and spinning.
+	size_t instanceCount = instances.size();
+	for (size_t i = 0; i < instanceCount; i++) {
+		glm::vec3 center;
+		float cellSize;
+		getGridCell(i, instanceCount, center, cellSize);
+		float angle = time + 0.1f * i;
+		instances[i].model = viewProj * glm::translate(glm::mat4(1.0f), center) *
+			glm::rotate(glm::mat4(1.0f), angle, glm::vec3(0.0f, 0.0f, 1.0f)) *
+			glm::scale(glm::mat4(1.0f), glm::vec3(cellSize, cellSize, 1.0f));
+	}
 }
 // There are two ways of synchronizing swap chain events: fences and semaphores.
 // Fences are mainly designed to synchronize your application itself with rendering operation, 
 // whereas semaphores are used to synchronize operations within or across command queues. 
 void HelloTriangle::drawFrame() {
+	frameTimer.beginFrame();
 
 	updateAppState();
 
-	// waiting for presentation to finish before starting to draw the next frame,
-	// otherwise, mem leak?
-	vkQueueWaitIdle(presentQueue);
+	// Instead of vkQueueWaitIdle (CPU and GPU never overlap), only wait until the 
+	// GPU has finished the frame that used this slot framesInFlight frames ago.
+	// This also bounds the queued work, so the semaphores of this slot are free again.
+	frameTimer.beginWait();
+	if (timelineSemaphores) {
+		// the exact value the slot's previous frame signals.
+		graphicsTimeline.wait(frameTimelineValues[currentFrame]);
+	} else {
+		vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max());
+	}
+	frameTimer.endWait();
+
+	// whatever was replaced while the frames that are done now were in flight.
+	deletionQueue.collect(getCompletedFrames());
+	// the COMMAND scope allocations of the previous frame ended with their commands.
+	if (allocationCallbacks != nullptr) {
+		hostAllocator.resetCommandArena();
+	}
+
+	// the previous frame of this slot also consumed the uploads handed to it.
+	uploader.beginFrame(static_cast<uint32_t>(currentFrame));
+
+	// dev mode: swap in the recompiled shaders before anything of this frame is recorded.
+	if (options.hotReload) {
+		updateShaderHotReload();
+	}
 
 	// Acquire an image from the swap chain
-	uint32_t imageIndex;
-	// the swap chain from which we wish to acquire an image
-	// specifies a timeout in nanoseconds for an image to become available. 
-	vkAcquireNextImageKHR(device, swapChain, std::numeric_limits<uint64_t>::max(),
-		imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+	uint32_t imageIndex = acquireNextImage();
+
+	// the image may still be used by an older frame (the swap chain returned it 
+	// out of order), then we have to wait for that frame too.
+	if (timelineSemaphores) {
+		if (!graphicsTimeline.isCompleted(imageTimelineValues[imageIndex])) {
+			frameTimer.beginWait();
+			graphicsTimeline.wait(imageTimelineValues[imageIndex]);
+			frameTimer.endWait();
+		}
+	} else {
+		if (imagesInFlight[imageIndex] != VK_NULL_HANDLE) {
+			frameTimer.beginWait();
+			vkWaitForFences(device, 1, &imagesInFlight[imageIndex], VK_TRUE, std::numeric_limits<uint64_t>::max());
+			frameTimer.endWait();
+		}
+		imagesInFlight[imageIndex] = inFlightFences[currentFrame];
+	}
+
+	// the previous submission of this image's command buffer has finished (or never happened), 
+	// its timestamps can be read without waiting, before the command buffer resets them again, 
+	// and its instance buffer can be overwritten.
+	// When recording every frame, the slot (and the command buffer) belongs to the frame in flight instead.
+	bool recordStatic = options.recordMode == RECORD_STATIC;
+	uint32_t profilerSlot = recordStatic ? imageIndex : static_cast<uint32_t>(currentFrame);
+	gpuProfiler.collect(profilerSlot);
+	writeFrameData(profilerSlot);
+
+	VkCommandBuffer frameCommandBuffer = recordStatic ? commandBuffers[imageIndex] : recordFrameCommandBuffer(imageIndex);
 
 	// Execute the command buffer with that image as attachment in the framebuffer
 	// Submitting the command buffer
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-	VkSemaphore waitSemaphores[] = { imageAvailableSemaphore };
-	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+	// the values of the timeline semaphores in the submit, only chained in with timelineSemaphores.
+	TimelineSubmitInfo timelineInfo;
+	std::vector<VkSemaphore> waitSemaphores = { imageAvailableSemaphores[currentFrame] };
+	std::vector<VkPipelineStageFlags> waitStages = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+	timelineInfo.waitValues.push_back(0);
+	// finished uploads: wait for their semaphore, and acquire the buffers from the 
+	// transfer queue family before the frame's command buffer uses them.
+	std::vector<VkCommandBuffer> submitCommandBuffers;
+	uploader.addFrameWork(static_cast<uint32_t>(currentFrame), waitSemaphores, waitStages, timelineInfo.waitValues, submitCommandBuffers);
+	submitCommandBuffers.push_back(frameCommandBuffer);
+	// only the indirect draws have to wait for the cull pass, not the whole frame.
+	if (options.asyncCompute) {
+		uint64_t cullValue = submitAsyncCull(profilerSlot);
+		waitSemaphores.push_back(timelineSemaphores ? computeTimeline.get() : cullSlots[profilerSlot].cullFinishedSemaphore);
+		waitStages.push_back(VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT);
+		timelineInfo.waitValues.push_back(cullValue);
+	}
+
 	// specify which semaphores to wait on before execution begins
-	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pWaitSemaphores = waitSemaphores;
+	submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+	submitInfo.pWaitSemaphores = waitSemaphores.data();
 	// in which stage(s) of the pipeline to wait.
 	// That means that theoretically the implementation can already start executing 
 	// our vertex shader and such while the image is not available yet.
 	// Each entry in the waitStages array corresponds to the semaphore with the same index in pWaitSemaphores.
-	submitInfo.pWaitDstStageMask = waitStages;
+	submitInfo.pWaitDstStageMask = waitStages.data();
 
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffers[imageIndex];
+	submitInfo.commandBufferCount = static_cast<uint32_t>(submitCommandBuffers.size());
+	submitInfo.pCommandBuffers = submitCommandBuffers.data();
 
 	// specify which semaphores to signal once the command buffer(s) have finished execution.
-	VkSemaphore signalSemaphores[] = { renderFinishedSemaphore };
-	submitInfo.signalSemaphoreCount = 1;
-	submitInfo.pSignalSemaphores = signalSemaphores;
+	std::vector<VkSemaphore> signalSemaphores = { renderFinishedSemaphores[currentFrame] };
+	timelineInfo.signalValues.push_back(0);
+
+	if (timelineSemaphores) {
+		// the next value of the graphics timeline takes the place of the fence.
+		uint64_t frameValue = graphicsTimeline.nextValue();
+		frameTimelineValues[currentFrame] = frameValue;
+		imageTimelineValues[imageIndex] = frameValue;
+		signalSemaphores.push_back(graphicsTimeline.get());
+		timelineInfo.signalValues.push_back(frameValue);
+		timelineInfo.attach(submitInfo);
+	} else {
+		// the fence is signaled when the command buffer finished, so it has to be unsignaled right before the submit.
+		vkResetFences(device, 1, &inFlightFences[currentFrame]);
+	}
+	submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+	submitInfo.pSignalSemaphores = signalSemaphores.data();
 
-	if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+	// VK_NULL_HANDLE with timelineSemaphores.
+	if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
 		throw std::runtime_error("failed to submit draw command buffer!");
 	}
+	gpuProfiler.submitted(profilerSlot);
 
 	// Presentation
+	presentImage(imageIndex);
+	framePacer.presented();
+
+	currentFrame = (currentFrame + 1) % inFlightFences.size();
+	frameNumber++;
+	// anything replaced from now on may be used by this frame.
+	deletionQueue.setRetireValue(frameNumber);
+
+	frameTimer.endFrame();
+}
+
+uint32_t HelloTriangle::acquireNextImage() {
+	uint32_t imageIndex;
+	// the swap chain from which we wish to acquire an image
+	// specifies a timeout in nanoseconds for an image to become available. 
+	vkAcquireNextImageKHR(device, swapChain, std::numeric_limits<uint64_t>::max(),
+		imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+	return imageIndex;
+}
+
+void HelloTriangle::presentImage(uint32_t imageIndex) {
 	VkPresentInfoKHR presentInfo = {};
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
 	// specify which semaphores to wait on before presentation can happen
 	presentInfo.waitSemaphoreCount = 1;
-	presentInfo.pWaitSemaphores = signalSemaphores;
+	presentInfo.pWaitSemaphores = &renderFinishedSemaphores[currentFrame];
 
 	VkSwapchainKHR swapChains[] = { swapChain };
 	presentInfo.swapchainCount = 1;
@@ -845,17 +2337,74 @@ void HelloTriangle::drawFrame() {
 	presentInfo.pImageIndices = &imageIndex;
 	presentInfo.pResults = nullptr; // Optional
 
+	VkFence presentFence = VK_NULL_HANDLE;
+#ifdef VK_EXT_swapchain_maintenance1
+	VkSwapchainPresentFenceInfoEXT presentFenceInfo = {};
+	if (swapchainMaintenance1) {
+		presentFence = getPresentFence();
+		presentFenceInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_PRESENT_FENCE_INFO_EXT;
+		presentFenceInfo.swapchainCount = 1;
+		presentFenceInfo.pFences = &presentFence;
+		presentInfo.pNext = &presentFenceInfo;
+	}
+#endif
+
 	vkQueuePresentKHR(presentQueue, &presentInfo);
+	// also signaled when the present failed with VK_ERROR_OUT_OF_DATE_KHR, it was still queued.
+	if (presentFence != VK_NULL_HANDLE) {
+		pendingPresentFences.push_back(presentFence);
+	}
+}
+
+VkFence HelloTriangle::getPresentFence() {
+	// a queue finishes its presents in order, so only the oldest ones need to be checked.
+	while (!pendingPresentFences.empty() && vkGetFenceStatus(device, pendingPresentFences.front()) == VK_SUCCESS) {
+		vkResetFences(device, 1, &pendingPresentFences.front());
+		freePresentFences.push_back(pendingPresentFences.front());
+		pendingPresentFences.pop_front();
+	}
+	if (!freePresentFences.empty()) {
+		VkFence fence = freePresentFences.back();
+		freePresentFences.pop_back();
+		return fence;
+	}
+
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	VkFence fence;
+	if (vkCreateFence(device, &fenceInfo, allocationCallbacks, &fence) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create present fence!");
+	}
+	return fence;
+}
+
+std::vector<VkFence> HelloTriangle::takePresentFences() {
+	std::vector<VkFence> fences(pendingPresentFences.begin(), pendingPresentFences.end());
+	pendingPresentFences.clear();
+	return fences;
+}
+
+void HelloTriangle::destroyPresentFences() {
+	std::vector<VkFence> fences = takePresentFences();
+	if (!fences.empty()) {
+		vkWaitForFences(device, static_cast<uint32_t>(fences.size()), fences.data(), VK_TRUE, std::numeric_limits<uint64_t>::max());
+	}
+	fences.insert(fences.end(), freePresentFences.begin(), freePresentFences.end());
+	freePresentFences.clear();
+	for (size_t i = 0; i < fences.size(); i++) {
+		vkDestroyFence(device, fences[i], allocationCallbacks);
+	}
 }
 
-VkShaderModule HelloTriangle::createShaderModule(const std::vector<char>& code) {
+// codeSize in bytes. pCode has to be 4 byte aligned, which a uint32_t array always is.
+VkShaderModule HelloTriangle::createShaderModule(const uint32_t* code, size_t codeSize) {
 	VkShaderModuleCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	createInfo.codeSize = code.size();
-	createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+	createInfo.codeSize = codeSize;
+	createInfo.pCode = code;
 
 	VkShaderModule shaderModule;
-	if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
+	if (vkCreateShaderModule(device, &createInfo, allocationCallbacks, &shaderModule) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create shader module!");
 	}
 
@@ -876,18 +2425,28 @@ VkSurfaceFormatKHR HelloTriangle::chooseSwapSurfaceFormat(const std::vector<VkSu
 	return availableFormats[0];
 }
 
+// the first mode of options.presentPolicy the surface supports. FIFO is the only one that is 
+// guaranteed to be available.
 VkPresentModeKHR HelloTriangle::chooseSwapPresentMode(const std::vector<VkPresentModeKHR> availablePresentModes) {
-	VkPresentModeKHR bestMode = VK_PRESENT_MODE_FIFO_KHR;
+	std::vector<VkPresentModeKHR> preferredModes;
+	switch (options.presentPolicy) {
+	case PRESENT_LOW_LATENCY:
+		preferredModes = { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR };
+		break;
+	case PRESENT_POWER_SAVING:
+		break;
+	case PRESENT_UNCAPPED:
+		// MAILBOX is uncapped too, but it renders frames that are never shown.
+		preferredModes = { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR };
+		break;
+	}
 
-	for (const auto& availablePresentMode : availablePresentModes) {
-		if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-			return availablePresentMode;
-		} else if (availablePresentMode == VK_PRESENT_MODE_IMMEDIATE_KHR) {
-			bestMode = availablePresentMode;
+	for (VkPresentModeKHR mode : preferredModes) {
+		if (std::find(availablePresentModes.begin(), availablePresentModes.end(), mode) != availablePresentModes.end()) {
+			return mode;
 		}
 	}
-
-	return bestMode;
+	return VK_PRESENT_MODE_FIFO_KHR;
 }
 
 VkExtent2D HelloTriangle::chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities) {
@@ -970,14 +2529,32 @@ bool HelloTriangle::isDeviceSuitable(VkPhysicalDevice device) {
 	// to verify that swap chain support is adequate. 
 	// Swap chain support is sufficient if there is at least one supported image format 
 	// and one supported presentation mode given the window surface we have.
+	// Without a surface (headless) there is nothing to present to.
 	bool swapChainAdequate = false;
 	if (extensionsSupported) {
-		SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
-		swapChainAdequate = swapChainSupport.isComplete();
+		if (surface == VK_NULL_HANDLE) {
+			swapChainAdequate = true;
+		} else {
+			SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
+			swapChainAdequate = swapChainSupport.isComplete();
+		}
 	}
 
-	return deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU &&
-		deviceFeatures.geometryShader &&
+	bool typeAccepted = false;
+	switch (options.devicePolicy) {
+	case DEVICE_DISCRETE_ONLY:
+		typeAccepted = deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU &&
+			deviceFeatures.geometryShader;
+		break;
+	case DEVICE_PREFER_GPU:
+		typeAccepted = true; // pickPhysicalDevice ranks them.
+		break;
+	case DEVICE_CPU_ONLY:
+		typeAccepted = deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU;
+		break;
+	}
+
+	return typeAccepted &&
 		indices.isComplete() && // here we require a device can represent the image.
 		extensionsSupported && swapChainAdequate;  // VK_KHR_swapchain
 }
@@ -989,6 +2566,7 @@ bool HelloTriangle::checkDeviceExtensionSupport(VkPhysicalDevice device) {
 	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
 	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
 
+	std::vector<const char*> deviceExtensions = getRequiredDeviceExtensions();
 	std::set<std::string> requiredExtensions(deviceExtensions.begin(), deviceExtensions.end());
 
 	std::cout << "all the available DEVICE extensions:" << std::endl;
@@ -1000,6 +2578,21 @@ bool HelloTriangle::checkDeviceExtensionSupport(VkPhysicalDevice device) {
 	return requiredExtensions.empty();
 }
 
+bool HelloTriangle::isDeviceExtensionAvailable(VkPhysicalDevice device, const char* extensionName) {
+	uint32_t extensionCount;
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+	for (const auto& extension : availableExtensions) {
+		if (strcmp(extension.extensionName, extensionName) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
 QueueFamilyIndices HelloTriangle::findQueueFamilies(VkPhysicalDevice device) {
 	if (this->indices.isComplete()) {
 		return this->indices;
@@ -1033,8 +2626,13 @@ QueueFamilyIndices HelloTriangle::findQueueFamilies(VkPhysicalDevice device) {
 		}
 
 		// look for a queue family that has the capability of presenting to our window surface.
+		// headless, the "presentation" is a copy on the graphics queue.
 		VkBool32 presentSupport = false;
-		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+		if (surface != VK_NULL_HANDLE) {
+			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+		} else {
+			presentSupport = (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+		}
 
 		if (queueFamily.queueCount > 0 && presentSupport) {
 			indices.presentFamilyIdx = i;
@@ -1047,11 +2645,43 @@ QueueFamilyIndices HelloTriangle::findQueueFamilies(VkPhysicalDevice device) {
 		i++;
 	}
 
+	// a transfer-only family is usually a DMA engine, its copies don't compete with the rendering.
+	i = 0;
+	for (const auto& queueFamily : queueFamilies) {
+		if (queueFamily.queueCount > 0 && (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) &&
+			!(queueFamily.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+			this->indices.transferFamilyIdx = i;
+			break;
+		}
+		i++;
+	}
+	// graphics queues always support transfers, even if VK_QUEUE_TRANSFER_BIT is not reported.
+	if (this->indices.transferFamilyIdx < 0) {
+		this->indices.transferFamilyIdx = this->indices.graphicsFamilyIdx;
+	}
+
+	// a compute family without graphics is usually backed by its own hardware queue (AMD's ACEs), 
+	// its work can fill the gaps the rasterization leaves in the shader cores.
+	i = 0;
+	for (const auto& queueFamily : queueFamilies) {
+		if (queueFamily.queueCount > 0 && (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT) &&
+			!(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+			this->indices.computeFamilyIdx = i;
+			break;
+		}
+		i++;
+	}
+	if (this->indices.computeFamilyIdx < 0) {
+		this->indices.computeFamilyIdx = this->indices.graphicsFamilyIdx;
+	}
+
 	// print which fimily we use.
 	// for improved performance, it is better to use one if available.
 	{
 		std::cout << "we choose graphicsFamilyIdx: " << this->indices.graphicsFamilyIdx << std::endl;
 		std::cout << "we choose presentFamilyIdx: " << this->indices.presentFamilyIdx << std::endl;
+		std::cout << "we choose transferFamilyIdx: " << this->indices.transferFamilyIdx << std::endl;
+		std::cout << "we choose computeFamilyIdx: " << this->indices.computeFamilyIdx << std::endl;
 	}
 	return this->indices;
 }
@@ -1078,6 +2708,10 @@ std::vector<const char*> HelloTriangle::getRequiredExtensions() {
 	return extensions;
 }
 
+std::vector<const char*> HelloTriangle::getRequiredDeviceExtensions() {
+	return deviceExtensions;
+}
+
 // Each layer in the validationLayers should be supported.
 bool HelloTriangle::checkValidationLayerSupport() {
 	uint32_t layerCount;
@@ -1104,28 +2738,6 @@ bool HelloTriangle::checkValidationLayerSupport() {
 	return true;
 }
 
-std::vector<char> HelloTriangle::readFile(const std::string& filename) {
-	// ate: Start reading at the end of the file
-	std::ifstream file(filename, std::ios::ate | std::ios::binary);
-
-	if (!file.is_open()) {
-		throw std::runtime_error("failed to open file!");
-	}
-
-	// we can use the read position to determine the size of the file and allocate a buffer
-	// as reading at the end of the file
-	size_t fileSize = (size_t)file.tellg();
-	std::vector<char> buffer(fileSize);
-
-	// seek back to the beginning of the file and read all of the bytes at once
-	file.seekg(0);
-	file.read(buffer.data(), fileSize);
-	file.close();
-
-	std::cout << filename.c_str() << ", size: " << fileSize << std::endl;
-	return buffer;
-}
-
 VKAPI_ATTR VkBool32 VKAPI_CALL HelloTriangle::debugCallback(
 	VkDebugReportFlagsEXT flags,
 	VkDebugReportObjectTypeEXT objType,  // eg. VK_DEBUG_REPORT_OBJECT_TYPE_DEVICE_EXT
@@ -5,14 +5,138 @@
 // api, otherwise will load gl api.
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
 
 //#include <vulkan/vulkan.h>
 
+#include "FrameTimer.h"
+#include "FramePacer.h"
+#include "GpuProfiler.h"
+#include "MemoryAllocator.h"
+#include "Uploader.h"
+#include "RecordThreadPool.h"
+#include "DescriptorAllocator.h"
+#include "PipelineLibrary.h"
+#include "ShaderHotReload.h"
+#include "RenderGraph.h"
+#include "TimelineSemaphore.h"
+#include "DeletionQueue.h"
+#include "HostAllocator.h"
+
 #include <vector>
+#include <deque>
+#include <string>
+#include <array>
+#include <chrono>
+#include <cstddef>
 
 const int WIDTH = 640;
 const int HEIGHT = 480;
 
+// how many frames can be processed concurrently. While the GPU is rendering
+// frame N, the CPU is already allowed to record and submit frame N+1, so the
+// frame time becomes max(CPU, GPU) instead of CPU + GPU.
+const int MAX_FRAMES_IN_FLIGHT = 2;
+
+// which kind of VkPhysicalDevice is accepted by pickPhysicalDevice.
+enum DeviceSelectionPolicy {
+	// only a discrete GPU with geometry shader support (what this sample was written for).
+	DEVICE_DISCRETE_ONLY,
+	// any device, ranked discrete > integrated > virtual > CPU.
+	DEVICE_PREFER_GPU,
+	// only CPU implementations like lavapipe or SwiftShader, e.g. for reproducible 
+	// images on build servers that have no GPU.
+	DEVICE_CPU_ONLY
+};
+
+// how the command buffers of a frame are recorded.
+enum RecordMode {
+	// once per swap chain image at startup (and after a resize), then resubmitted every frame.
+	RECORD_STATIC,
+	// every frame on the main thread, into a primary from a per-frame transient pool.
+	// Anything can change from frame to frame, for the price of the recording time.
+	RECORD_PER_FRAME,
+	// every frame: the draw list is split over worker threads, each recording a 
+	// secondary command buffer, executed from the frame's primary command buffer.
+	RECORD_THREADED
+};
+
+// where the vertex shader reads the transform of a draw from, see recordDraws.
+enum PerDrawMode {
+	// an ObjectUniforms per draw in a uniform buffer, rebinding the set with a dynamic offset 
+	// for every draw. The buffer is written every frame.
+	PER_DRAW_UNIFORM_BUFFER = 0,
+	// the whole PerDrawConstants with vkCmdPushConstants: nothing to write or bind per draw.
+	PER_DRAW_PUSH_CONSTANTS = 1,
+	// all the ObjectUniforms in one storage buffer bound once, only the index is pushed per draw.
+	PER_DRAW_STORAGE_BUFFER = 2
+};
+
+// which present mode chooseSwapPresentMode prefers, FIFO when the surface has none of them.
+enum PresentPolicy {
+	// MAILBOX (the newest frame at each vblank, no tearing), else IMMEDIATE.
+	PRESENT_LOW_LATENCY,
+	// FIFO: one frame per refresh, the CPU and GPU idle the rest of the time.
+	PRESENT_POWER_SAVING,
+	// IMMEDIATE (never waits for the display, may tear), else MAILBOX: the throughput of the GPU.
+	PRESENT_UNCAPPED
+};
+
+// settings that can be changed from the command line, see main.cpp.
+struct AppOptions {
+	int framesInFlight = MAX_FRAMES_IN_FLIGHT;
+	RecordMode recordMode = RECORD_STATIC;
+	// RECORD_THREADED: number of worker threads, 0 = one per hardware thread.
+	int recordThreads = 0;
+	// number of entries in the draw list, each one is a vkCmdDrawIndexed of the triangle.
+	int drawCount = 1;
+	// copies of the triangle per draw, each one with its own transform from the instance buffer.
+	int instanceCount = 1;
+	// pipeline variants the draws cycle through, 1 to MAX_MATERIALS. Not used by the GPU culling path.
+	int materialCount = 1;
+	PerDrawMode perDrawMode = PER_DRAW_UNIFORM_BUFFER;
+	// samples per pixel, rendered into a transient MSAA image and resolved into the swap chain 
+	// image. Clamped to what the device supports, 1 = no MSAA image.
+	int sampleCount = 1;
+	// a transient depth attachment, the draws test and write depth.
+	bool depthBuffer = false;
+	// build the frame as a RenderGraph: barriers, layouts and the MSAA/depth images come from 
+	// the graph instead of the render pass and hand written barriers.
+	bool renderGraph = false;
+	// cull the instances against the view frustum in a compute shader, which writes one 
+	// indirect draw per visible instance. Replaces the draw list with a single indirect draw.
+	bool gpuCulling = false;
+	// with gpuCulling: run the cull pass on the compute queue, overlapped with the rendering 
+	// of the previous frame, instead of in the frame's graphics command buffer.
+	bool asyncCompute = false;
+	// retire the frames, uploads and cull passes with one timeline semaphore per queue 
+	// (VK_KHR_timeline_semaphore) instead of fences. Falls back to the fences without the extension.
+	bool timelineSemaphores = false;
+	// dev mode: recompile the shaders in shaderDirectory when they are saved, and swap the 
+	// pipelines while running. Needs a record mode that records every frame.
+	bool hotReload = false;
+	std::string shaderDirectory = "shaders";
+	// route the host memory the driver allocates for our objects through a HostAllocator, 
+	// its counts and peaks per allocation scope are printed at exit.
+	bool trackHostAllocations = false;
+	// with trackHostAllocations: bytes of the arena the COMMAND scope allocations come from, 0 = the heap.
+	size_t commandArenaSize = 0;
+	PresentPolicy presentPolicy = PRESENT_LOW_LATENCY;
+	// frames per second the main loop is limited to by the FramePacer, <= 0 for no limit.
+	double frameRateLimit = 0.0;
+	// seconds between the FrameTimer/GpuProfiler/FramePacer reports, <= 0 to disable.
+	double reportInterval = 1.0;
+	DeviceSelectionPolicy devicePolicy = DEVICE_DISCRETE_ONLY;
+	// render into offscreen images instead of a window, see HelloTriangleHeadless.
+	bool headless = false;
+	// stop after this many frames, 0 = run until the window is closed.
+	int frameCount = 0;
+	// headless: copy every frame back to host memory, like a real present would read the image.
+	bool readbackEveryFrame = false;
+	// headless: write the last frame to this file (.ppm) for image diffs.
+	std::string dumpFile;
+};
+
 // more info, see VK_SDK/Config/xx.txt
 // this willbe used in create instance and logival device
 const std::vector<const char*> validationLayers = {
@@ -77,10 +201,139 @@ const bool enableValidationLayers = false;
 const bool enableValidationLayers = true;
 #endif
 
+struct Vertex {
+	glm::vec2 pos;
+	glm::vec3 color;
+
+	// A vertex binding describes at which rate to load data from memory 
+	// throughout the vertices. It specifies the number of bytes between 
+	// data entries and whether to move to the next data entry after each 
+	// vertex or after each instance.
+	static VkVertexInputBindingDescription getBindingDescription() {
+		VkVertexInputBindingDescription bindingDescription = {};
+		// The binding parameter specifies the index of the binding in the array of bindings.
+		bindingDescription.binding = 0;
+		// specifies the number of bytes from one entry to the next.
+		bindingDescription.stride = sizeof(Vertex);
+		// VK_VERTEX_INPUT_RATE_VERTEX: Move to the next data entry after each vertex
+		// VK_VERTEX_INPUT_RATE_INSTANCE: Move to the next data entry after each instance
+		bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+		return bindingDescription;
+	}
+
+	// how to extract a vertex attribute from a chunk of vertex data originating from a binding description.
+	static std::array<VkVertexInputAttributeDescription, 2> getAttributeDescriptions() {
+		std::array<VkVertexInputAttributeDescription, 2> attributeDescriptions = {};
+		// layout(location = 0) in vec2 inPosition;
+		attributeDescriptions[0].binding = 0;
+		attributeDescriptions[0].location = 0;
+		attributeDescriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
+		attributeDescriptions[0].offset = offsetof(Vertex, pos);
+		// layout(location = 1) in vec3 inColor;
+		attributeDescriptions[1].binding = 0;
+		attributeDescriptions[1].location = 1;
+		attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+		attributeDescriptions[1].offset = offsetof(Vertex, color);
+
+		return attributeDescriptions;
+	}
+};
+
+// the per-instance data, read from a second vertex buffer binding that advances once per instance.
+struct InstanceData {
+	glm::mat4 model;
+
+	static VkVertexInputBindingDescription getBindingDescription() {
+		VkVertexInputBindingDescription bindingDescription = {};
+		bindingDescription.binding = 1;
+		bindingDescription.stride = sizeof(InstanceData);
+		bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+		return bindingDescription;
+	}
+
+	// layout(location = 2) in mat4 inModel;
+	// A mat4 attribute takes 4 locations, one vec4 column each.
+	static std::array<VkVertexInputAttributeDescription, 4> getAttributeDescriptions() {
+		std::array<VkVertexInputAttributeDescription, 4> attributeDescriptions = {};
+		for (uint32_t i = 0; i < 4; i++) {
+			attributeDescriptions[i].binding = 1;
+			attributeDescriptions[i].location = 2 + i;
+			attributeDescriptions[i].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+			attributeDescriptions[i].offset = offsetof(InstanceData, model) + sizeof(glm::vec4) * i;
+		}
+
+		return attributeDescriptions;
+	}
+};
+
+const std::vector<Vertex> vertices = {
+	{ { 0.0f, -0.5f },{ 1.0f, 0.0f, 0.0f } },
+	{ { 0.5f, 0.5f },{ 0.0f, 1.0f, 0.0f } },
+	{ { -0.5f, 0.5f },{ 0.0f, 0.0f, 1.0f } }
+};
+
+// uint16_t is enough for less than 65535 unique vertices.
+const std::vector<uint16_t> vertexIndices = {
+	0, 1, 2
+};
+
+// per draw of the draw list, set 0 binding 0 of the graphics pipeline (UNIFORM_BUFFER_DYNAMIC).
+struct ObjectUniforms {
+	glm::mat4 transform;
+};
+
+// the push constant block of shaders/01HelloTriangle.vert, 68 bytes: well inside the 
+// 128 bytes maxPushConstantsSize guarantees.
+struct PerDrawConstants {
+	glm::mat4 transform;	// PER_DRAW_PUSH_CONSTANTS
+	uint32_t objectIndex;	// PER_DRAW_STORAGE_BUFFER
+};
+
+// the uniform buffer of the cull compute shader, std140 layout, see shaders/01HelloTriangleCull.comp.
+struct CullParams {
+	glm::vec4 planes[6];		// xyz: normal pointing inside, w: distance
+	uint32_t objectCount;
+	uint32_t indexCount;
+	uint32_t compact;			// 1: commands are packed at the front, their number in the count buffer.
+	uint32_t padding;
+};
+
+// one entry of the draw list, the arguments of a vkCmdDrawIndexed.
+struct DrawItem {
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+	// index into materialDescs, 0 is graphicsPipeline.
+	uint32_t material;
+	// copied into the ObjectUniforms, or pushed.
+	glm::mat4 transform;
+};
+
+// every combination of the state bits of a material, see createMaterialDescs.
+const int MAX_MATERIALS = 16;
+
+// constant_id of the specialization constants in shaders/01HelloTriangle.vert (a PerDrawMode)
+// and shaders/01HelloTriangle.frag.
+const uint32_t SPEC_PER_DRAW_SOURCE = 0;
+const uint32_t SPEC_SHADING_MODEL = 0;
+enum ShadingModel {
+	SHADING_VERTEX_COLOR = 0,
+	SHADING_SPOT = 1
+};
+
+// size of the persistently mapped staging ring used for all uploads.
+const VkDeviceSize STAGING_RING_SIZE = 4 * 1024 * 1024;
+
 // It's actually possible that the queue families supporting drawing commands and the ones supporting presentation do not overlap.
 struct QueueFamilyIndices {
 	int graphicsFamilyIdx = -1;
 	int presentFamilyIdx = -1;
+	// a transfer-only family if there is one (copies in parallel to rendering), the graphics family otherwise.
+	int transferFamilyIdx = -1;
+	// a compute family without graphics if there is one (runs next to the rasterization), the graphics family otherwise.
+	int computeFamilyIdx = -1;
 
 	bool isComplete() {
 		return graphicsFamilyIdx >= 0 && presentFamilyIdx >= 0;
@@ -102,82 +355,310 @@ struct SwapChainSupportDetails {
 
 class HelloTriangle {
 public:
-	void run();
+	virtual ~HelloTriangle() {}
+	virtual void run();
+	void setOptions(const AppOptions& options) {
+		this->options = options;
+		frameTimer.reportInterval = options.reportInterval;
+		gpuProfiler.reportInterval = options.reportInterval;
+		framePacer.reportInterval = options.reportInterval;
+		framePacer.setFrameRateLimit(options.frameRateLimit);
+	}
+	const FrameTimer& getFrameTimer() const { return frameTimer; }
+	const GpuProfiler& getGpuProfiler() const { return gpuProfiler; }
 
 	// to be used in the son.
 protected:
-	GLFWwindow* window;
+	AppOptions options;
+	GLFWwindow* window = nullptr;
 	VkInstance instance1;
 	VkInstance instance2; // not use this one
-	VkDebugReportCallbackEXT callback;
+	VkDebugReportCallbackEXT callback = VK_NULL_HANDLE;
 	// The window surface needs to be created right after the instance creation, 
 	// because it can actually influence the physical device selection. 
-	VkSurfaceKHR surface;
+	// VK_NULL_HANDLE when rendering headless.
+	VkSurfaceKHR surface = VK_NULL_HANDLE;
 	// This object will be implicitly destroyed when the VkInstance is destroyed, 
 	// so we won't need to do anything new in the cleanup function
 	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+	VkPhysicalDeviceProperties physicalDeviceProperties; // of the chosen physicalDevice.
 	QueueFamilyIndices indices; //prefer to do once.
 	VkDevice device;
 	// Device queues are implicitly cleaned up when the device is destroyed.
 	// In case the queue families are the same, the two handles will most likely have the same value now.
 	VkQueue graphicsQueue;
 	VkQueue presentQueue;
+	VkQueue transferQueue;
+	VkQueue computeQueue;
+	// buffers and images get their memory from here instead of their own vkAllocateMemory.
+	MemoryAllocator allocator;
+	// fills DEVICE_LOCAL buffers through the transfer queue.
+	Uploader uploader;
 
 	SwapChainSupportDetails details; //prefer to do once.
-	VkSwapchainKHR swapChain;
+	VkSwapchainKHR swapChain = VK_NULL_HANDLE;
 	std::vector<VkImage> swapChainImages; // refer to the images in the swapChain, no need to cleanup.
 	VkFormat swapChainImageFormat;
 	VkExtent2D swapChainExtent;
 	std::vector<VkImageView> swapChainImageViews;
+	// the layout the render pass leaves the color attachment in.
+	VkImageLayout colorFinalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
 	// one FB for each image in the swap chain.
 	std::vector<VkFramebuffer> swapChainFramebuffers;
+	// the attachments besides the swap chain image, only needed during the render pass: 
+	// TRANSIENT_ATTACHMENT images, in LAZILY_ALLOCATED memory where the device has it.
+	// A single one of each is shared by all the framebuffers, the frames use them one after 
+	// the other (see the subpass dependency in createRenderPass).
+	struct RenderTarget {
+		VkImage image = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		MemoryAllocator::Allocation memory;
+	};
+	VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;
+	VkFormat depthFormat = VK_FORMAT_UNDEFINED; // VK_FORMAT_UNDEFINED: no depth buffer
+	RenderTarget msaaColorTarget; // only with msaaSamples > 1, resolved into the swap chain image.
+	RenderTarget depthTarget;
+	// options.renderGraph: the passes of the frame, built with the framebuffers. 
+	// It owns the MSAA and depth images instead of the render targets above.
+	RenderGraph renderGraph;
+	RenderGraph::ResourceId swapChainResource = 0;
+	RenderGraph::ResourceId msaaColorResource = 0;
+	RenderGraph::ResourceId depthResource = 0;
+	RenderGraph::ResourceId cullCommandsResource = 0;
+	RenderGraph::ResourceId cullCountResource = 0;
 
 	VkRenderPass renderPass;
-	VkPipelineLayout pipelineLayout;
-	VkPipeline graphicsPipeline;
+	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+	// of pipelineLayout, reflected from the shaders.
+	std::vector<VkPushConstantRange> pushConstantRanges;
+	// material 0, owned by pipelineLibrary.
+	VkPipeline graphicsPipeline = VK_NULL_HANDLE;
+	// PipelineDesc -> VkPipeline, the same state is never compiled twice.
+	PipelineLibrary pipelineLibrary;
+	// the pipeline state of each material, the pipelines are looked up at record time.
+	std::vector<PipelineDesc> materialDescs;
+	ShaderHotReload shaderHotReload;
+	// the base desc with the recompiled shaders, until its pipeline is ready.
+	PipelineDesc reloadDesc;
+	bool reloadPending = false;
+	// shared by every pipeline build, loaded from disk at startup and written back at shutdown.
+	VkPipelineCache pipelineCache = VK_NULL_HANDLE;
 
 	VkCommandPool commandPool;
-	// allocates and records the commands for each swap chain image.
+
+	// DEVICE_LOCAL, filled by the uploader.
+	VkBuffer vertexBuffer = VK_NULL_HANDLE;
+	MemoryAllocator::Allocation vertexBufferMemory;
+	VkBuffer indexBuffer = VK_NULL_HANDLE;
+	MemoryAllocator::Allocation indexBufferMemory;
+	// allocates and records the commands for each swap chain image (RECORD_STATIC).
 	std::vector<VkCommandBuffer> commandBuffers;
+	// recorded every frame (not RECORD_STATIC): a transient pool and a primary per frame in flight, 
+	// the pool is reset as a whole when its frame comes around again, nothing is freed individually.
+	std::vector<VkCommandPool> frameCommandPools;
+	std::vector<VkCommandBuffer> frameCommandBuffers;
+	RecordThreadPool recordThreadPool;
+	std::vector<DrawItem> drawList;
+	// HOST_VISIBLE, rewritten every frame: one per command buffer, like the GpuProfiler slots.
+	std::vector<VkBuffer> instanceBuffers;
+	std::vector<MemoryAllocator::Allocation> instanceBuffersMemory;
+	// computed by updateAppState while the GPU is still busy, then copied to the instance buffer.
+	std::vector<InstanceData> instances;
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	// applied to the instance transforms on the CPU, the cull compute shader tests against its frustum.
+	glm::mat4 viewProj = glm::mat4(1.0f);
+
+	// every descriptor set layout comes from here, equal bindings give the same layout.
+	DescriptorLayoutCache descriptorLayoutCache;
+	// set 0 of the graphics pipeline, owned by descriptorLayoutCache.
+	VkDescriptorSetLayout objectSetLayout = VK_NULL_HANDLE;
+	// sets that live as long as the command buffer slots, replaced when the slots are recreated.
+	DescriptorAllocator slotDescriptorAllocator;
+	// per command buffer slot, like the instance buffers.
+	// All the draws share one descriptor set, each one binds it with the dynamic offset of its 
+	// ObjectUniforms, instead of allocating and writing a set per draw.
+	struct DescriptorSlot {
+		// RECORD_STATIC: unused, the set comes from slotDescriptorAllocator and is written once.
+		// otherwise: reset and allocated from every frame.
+		DescriptorAllocator frameAllocator;
+		// the ObjectUniforms of all the draws, HOST_VISIBLE.
+		MemoryAllocator::LinearRegion objectUniforms;
+		VkDescriptorSet objectSet = VK_NULL_HANDLE;
+		VkDeviceSize firstObjectOffset = 0; // the dynamic offset of draw 0
+	};
+	std::vector<DescriptorSlot> descriptorSlots;
+	// sizeof(ObjectUniforms) aligned to minUniformBufferOffsetAlignment.
+	VkDeviceSize objectUniformsStride = 0;
 
+	// GPU culling, only created with options.gpuCulling.
+	// per command buffer slot, like the instance buffers: the compute shader 
+	// of one frame must not overwrite the commands another frame is drawing.
+	struct CullSlot {
+		VkBuffer paramsBuffer = VK_NULL_HANDLE;		// CullParams, HOST_VISIBLE
+		MemoryAllocator::Allocation paramsMemory;
+		VkBuffer commandsBuffer = VK_NULL_HANDLE;	// VkDrawIndexedIndirectCommand per object
+		MemoryAllocator::Allocation commandsMemory;
+		VkBuffer countBuffer = VK_NULL_HANDLE;		// uint32_t number of visible objects
+		MemoryAllocator::Allocation countMemory;
+		VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+		// options.asyncCompute: the pre-recorded cull pass for the compute queue, and its signal for the graphics queue.
+		// No semaphore with timelineSemaphores, the graphics queue waits for a value of computeTimeline.
+		VkCommandBuffer computeCommandBuffer = VK_NULL_HANDLE;
+		VkSemaphore cullFinishedSemaphore = VK_NULL_HANDLE;
+	};
+	std::vector<CullSlot> cullSlots;
+	VkDescriptorSetLayout cullDescriptorSetLayout = VK_NULL_HANDLE; // owned by descriptorLayoutCache
+	VkPipelineLayout cullPipelineLayout = VK_NULL_HANDLE;
+	VkPipeline cullPipeline = VK_NULL_HANDLE;
+	VkCommandPool computeCommandPool = VK_NULL_HANDLE;
+	// world space bounding sphere per object (xyz: center, w: radius), DEVICE_LOCAL.
+	VkBuffer boundingSpheresBuffer = VK_NULL_HANDLE;
+	MemoryAllocator::Allocation boundingSpheresMemory;
+	// the optional device features and extension used for the indirect draws.
+	bool multiDrawIndirect = false;
+	bool drawIndirectCount = false;
+#ifdef VK_KHR_draw_indirect_count
+	PFN_vkCmdDrawIndexedIndirectCountKHR pfnCmdDrawIndexedIndirectCount = nullptr;
+#endif
+
+	// each frame in flight has its own semaphores, otherwise the CPU could
+	// signal a semaphore again before the GPU has waited on it.
 	// signal that an image has been acquired and is ready for rendering
-	VkSemaphore imageAvailableSemaphore;
+	std::vector<VkSemaphore> imageAvailableSemaphores;
 	// signal that rendering has finished and presentation can happen
-	VkSemaphore renderFinishedSemaphore;
+	std::vector<VkSemaphore> renderFinishedSemaphores;
+	// CPU-GPU sync, signaled when the frame's command buffer finished executing.
+	// VK_NULL_HANDLE with timelineSemaphores.
+	std::vector<VkFence> inFlightFences;
+	// which fence (frame) is currently using each swap chain image, VK_NULL_HANDLE if none.
+	// the swap chain may return images out of order, or have more images than frames in flight.
+	std::vector<VkFence> imagesInFlight;
+	// options.timelineSemaphores on a device that has them. One timeline per queue, each submit 
+	// signals the next value of its queue's timeline. The acquire and present semaphores stay 
+	// binary, the swap chain only takes those.
+	bool timelineSemaphores = false;
+	// VK_KHR_get_physical_device_properties2 is enabled on the instance, VK_KHR_timeline_semaphore needs it.
+	bool instanceProperties2 = false;
+	// VK_KHR_get_surface_capabilities2 and VK_EXT_surface_maintenance1 are enabled on the instance, 
+	// VK_EXT_swapchain_maintenance1 needs them.
+	bool instanceSurfaceMaintenance1 = false;
+	// VK_EXT_swapchain_maintenance1: every present signals a fence once the present engine is 
+	// done with it, so a retired swap chain can be destroyed without waiting for the queue.
+	bool swapchainMaintenance1 = false;
+	// the fences of the presents not known to be finished yet, in present order, and the ones 
+	// ready to be reused (unsignaled).
+	std::deque<VkFence> pendingPresentFences;
+	std::vector<VkFence> freePresentFences;
+	TimelineSemaphore graphicsTimeline;
+	TimelineSemaphore transferTimeline; // the uploader's
+	TimelineSemaphore computeTimeline;	// options.asyncCompute
+	// the graphicsTimeline value of the last submit of each frame slot / swap chain image, 0 if none. 
+	// They replace inFlightFences and imagesInFlight.
+	std::vector<uint64_t> frameTimelineValues;
+	std::vector<uint64_t> imageTimelineValues;
+	size_t currentFrame = 0;
+	// frames submitted so far.
+	uint64_t frameNumber = 0;
+	// objects the frames in flight may still use when they are replaced: the pipelines of a 
+	// hot reload, everything that belonged to the old swap chain after a resize. Tagged with 
+	// frameNumber, destroyed when getCompletedFrames() reaches it.
+	DeletionQueue deletionQueue;
+	// options.trackHostAllocations: the host memory the driver allocates for the objects created 
+	// in here. The modules (allocator, uploader, pipeline library, ...) still use the driver's own.
+	HostAllocator hostAllocator;
+	// hostAllocator's callbacks, nullptr for the driver's allocator. Every object has to be 
+	// destroyed with the callbacks it was created with.
+	const VkAllocationCallbacks* allocationCallbacks = nullptr;
+
+	FrameTimer frameTimer;
+	// the frame rate limit and the present-to-present intervals.
+	FramePacer framePacer;
+	// one slot per command buffer (swap chain image).
+	GpuProfiler gpuProfiler;
 
 	void initWindow();
 	void initVulkan();
-	void mainLoop();
+	virtual void mainLoop();
 
-	void cleanupSwapChain();
+	virtual void cleanupSwapChain();
 	void cleanup();
 	void createInstance();
 	void setupDebugCallback();
-	void createSurface();
+	virtual void createSurface();
 	void pickPhysicalDevice();
+	int rankPhysicalDevice(const VkPhysicalDeviceProperties& deviceProperties);
 	void createLogicalDevice();
-	void createSwapChain(bool redoQuery = false);
+	void createPipelineCache();
+	void savePipelineCache();
+	bool isPipelineCacheCompatible(const std::vector<char>& data);
+	virtual void createSwapChain(bool redoQuery = false, VkSwapchainKHR oldSwapChain = VK_NULL_HANDLE);
 	void createImageViews();
+	void chooseRenderTargetFormats();
 	void createRenderPass();
 	void createGraphicsPipeline();
+	VkDescriptorSetLayout reflectShaderInterface(PipelineDesc& desc, std::vector<VkPushConstantRange>& reflectedPushConstants);
+	void createMaterialDescs(const PipelineDesc& desc);
+	void updateShaderHotReload();
+	void buildRenderGraph();
 	void createFramebuffers();
+	void createRenderTarget(VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect, RenderTarget& target);
+	void destroyRenderTarget(RenderTarget& target);
+	void printRenderTargetStats();
 	void createCommandPool();
+	void createUploader();
+	void createVertexBuffer();
+	void createIndexBuffer();
 	void createCommandBuffers();
-	void createSemaphores();
+	void createDrawList();
+	void createFrameCommandPools();
+	void createInstanceBuffers(uint32_t slotCount);
+	void destroyInstanceBuffers();
+	void writeFrameData(uint32_t slot);
+	void createDescriptorSlots(uint32_t slotCount);
+	void destroyDescriptorSlots();
+	void writeObjectUniforms(uint32_t slot, DescriptorAllocator& descriptorAllocator);
+	VkDeviceSize getObjectUniformsAlignment() const;
+	void createCullPipeline();
+	void createBoundingSpheres();
+	void createCullSlots(uint32_t slotCount);
+	void destroyCullSlots();
+	void recordCull(VkCommandBuffer commandBuffer, uint32_t slot);
+	void recordCullClear(VkCommandBuffer commandBuffer, uint32_t slot);
+	void recordCullDispatch(VkCommandBuffer commandBuffer, uint32_t slot);
+	uint64_t submitAsyncCull(uint32_t slot);
+	void recordIndirectDraws(VkCommandBuffer commandBuffer, uint32_t slot);
+	void recordFrame(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t slot);
+	void recordMainPass(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t slot);
+	void recordDraws(VkCommandBuffer commandBuffer, uint32_t slot, size_t first, size_t last);
+	VkCommandBuffer recordFrameCommandBuffer(uint32_t imageIndex);
+	void createSyncObjects();
+	// the number of frames known to have finished on the GPU, without waiting.
+	uint64_t getCompletedFrames();
 	void updateAppState();
 	void drawFrame();
-	VkShaderModule createShaderModule(const std::vector<char>& code);
+	// get the next image to render to, imageAvailableSemaphores[currentFrame] is signaled when it is ready.
+	virtual uint32_t acquireNextImage();
+	// hand the rendered image over, waits on renderFinishedSemaphores[currentFrame].
+	virtual void presentImage(uint32_t imageIndex);
+	// with swapchainMaintenance1: an unsignaled fence for the next present, recycles the finished ones.
+	VkFence getPresentFence();
+	// hand the fences of all the presents so far to the caller, who waits on them and destroys them.
+	std::vector<VkFence> takePresentFences();
+	// waits for the pending presents.
+	void destroyPresentFences();
+	VkShaderModule createShaderModule(const uint32_t* code, size_t codeSize);
 	VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats);
 	VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR> availablePresentModes);
 	VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities);
 	SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device, bool redoQuery = false);
 	bool isDeviceSuitable(VkPhysicalDevice device);
 	bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+	bool isDeviceExtensionAvailable(VkPhysicalDevice device, const char* extensionName);
 	QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device);
-	std::vector<const char*> getRequiredExtensions();
+	virtual std::vector<const char*> getRequiredExtensions();
+	virtual std::vector<const char*> getRequiredDeviceExtensions();
 	bool checkValidationLayerSupport();
-	static std::vector<char> readFile(const std::string& filename);
 	static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
 		VkDebugReportFlagsEXT flags,
 		VkDebugReportObjectTypeEXT objType,  // eg. VK_DEBUG_REPORT_OBJECT_TYPE_DEVICE_EXT
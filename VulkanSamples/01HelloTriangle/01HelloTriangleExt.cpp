@@ -29,24 +29,60 @@ void HelloTriangleExt::onWindowResized(GLFWwindow* window, int width, int height
 
 void HelloTriangleExt::recreateSwapChain() {
 	// we shouldn't touch resources that may still be in use.
-	vkDeviceWaitIdle(device);
-
+	// The command buffers of the frames in flight reference the framebuffers and image views 
+	// replaced below, so cleanupSwapChain hands them to the deletion queue, which destroys them 
+	// once those frames are done. The old swap chain also has to outlive its queued presents, 
+	// which the frame numbers don't cover: see below.
 	this->swapChainChanged = true;
 
+	// keep the old swap chain alive, it is handed over to the new one.
+	VkSwapchainKHR oldSwapChain = swapChain;
+	VkFormat oldFormat = swapChainImageFormat;
+	swapChain = VK_NULL_HANDLE;
+
 	cleanupSwapChain();
-	createSwapChain(this->swapChainChanged);
+	createSwapChain(this->swapChainChanged, oldSwapChain);
+	// the old swap chain is retired now, nothing can be acquired from it anymore. 
+	// Its images may still be rendered to by the frames in flight, and presented: a frame is 
+	// retired when its command buffer finished, not its present, and the swap chain can't be 
+	// destroyed before all of its presents are done (VUID-vkDestroySwapchainKHR-swapchain-01282).
+	if (swapchainMaintenance1) {
+		// the fences of its presents. By the time the frames are retired they are usually signaled.
+		std::vector<VkFence> oldPresentFences = takePresentFences();
+		deletionQueue.push([this, oldSwapChain, oldPresentFences]() {
+			if (!oldPresentFences.empty()) {
+				vkWaitForFences(device, static_cast<uint32_t>(oldPresentFences.size()), oldPresentFences.data(), VK_TRUE, std::numeric_limits<uint64_t>::max());
+			}
+			for (size_t i = 0; i < oldPresentFences.size(); i++) {
+				vkDestroyFence(device, oldPresentFences[i], allocationCallbacks);
+			}
+			vkDestroySwapchainKHR(device, oldSwapChain, allocationCallbacks);
+		});
+	} else {
+		// no way to know when a present is done but waiting for its queue. This stalls the 
+		// present queue only (which may be the graphics queue), not the whole device.
+		vkQueueWaitIdle(presentQueue);
+		deletionQueue.push([this, oldSwapChain]() { vkDestroySwapchainKHR(device, oldSwapChain, allocationCallbacks); });
+	}
 
 	// The image views need to be recreated because they are based directly on the swap chain images.
 	createImageViews();
-	// The render pass needs to be recreated because it depends on the format of the swap chain images. 
-	// It is rare for the swap chain image format to change during an operation like a window resize, 
-	// but it should still be handled.
-	createRenderPass();
-	// Viewport and scissor rectangle size is specified during graphics pipeline creation, so the pipeline also needs to be rebuilt.
-	createGraphicsPipeline();
+	// The render pass depends on the format of the swap chain images. It is rare for the 
+	// format to change during an operation like a window resize, but it should still be handled.
+	// Viewport and scissor are dynamic states, so the pipeline only needs to be rebuilt together with the render pass.
+	if (swapChainImageFormat != oldFormat) {
+		// a background compile may still be using the old render pass.
+		pipelineLibrary.waitIdle();
+		VkRenderPass oldRenderPass = renderPass;
+		deletionQueue.push([this, oldRenderPass]() { vkDestroyRenderPass(device, oldRenderPass, allocationCallbacks); });
+		createRenderPass();
+		// the pipelines of the old format stay in the library (they don't reference the render pass 
+		// after creation), switching back to that format gets them without compiling.
+		createGraphicsPipeline();
+	}
 	// the framebuffers and command buffers also directly depend on the swap chain images.
 	createFramebuffers();
 	createCommandBuffers();
 
 	this->swapChainChanged = false;
-}
\ No newline at end of file
+}
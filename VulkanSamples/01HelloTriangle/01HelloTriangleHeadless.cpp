@@ -0,0 +1,284 @@
+
+#include "01HelloTriangleHeadless.h"
+
+#include <iostream>
+#include <fstream>
+#include <limits>
+#include <algorithm>
+
+// without --frames a headless run would never end.
+static const int DEFAULT_HEADLESS_FRAMES = 100;
+
+void HelloTriangleHeadless::run() {
+	// no initWindow(), there is nothing to show.
+	// the render pass leaves the image ready for the copy instead of the presentation.
+	colorFinalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	initVulkan();
+	mainLoop();
+	cleanup();
+}
+
+void HelloTriangleHeadless::mainLoop() {
+	int frameCount = options.frameCount > 0 ? options.frameCount : DEFAULT_HEADLESS_FRAMES;
+	for (int frame = 0; frame < frameCount; ++frame) {
+		frameTimer.beginWait();
+		framePacer.waitForNextFrame();
+		frameTimer.endWait();
+		drawFrame();
+	}
+
+	vkDeviceWaitIdle(device);
+
+	FrameTimer::Stats stats = frameTimer.getTotalStats();
+	printf("headless: %d frames, frame: %.3f ms (%.1f fps), cpu: %.3f ms, wait gpu: %.3f ms\n",
+		frameCount, stats.avgFrameMs, stats.fps, stats.avgCpuMs, stats.avgWaitMs);
+	FramePacer::Stats presentStats = framePacer.getTotalStats();
+	printf("headless: present interval: %.3f ms, jitter: %.3f ms, min: %.3f ms, max: %.3f ms\n",
+		presentStats.avgIntervalMs, presentStats.jitterMs, presentStats.minIntervalMs, presentStats.maxIntervalMs);
+	gpuProfiler.report();
+	allocator.printStats();
+	if (allocationCallbacks != nullptr) {
+		hostAllocator.printStats();
+	}
+	printRenderTargetStats();
+	pipelineLibrary.printStats();
+
+	if (!options.dumpFile.empty()) {
+		writeImage(options.dumpFile, lastImageIndex);
+	}
+}
+
+// headless never recreates its images, so this only runs from cleanup().
+void HelloTriangleHeadless::cleanupSwapChain() {
+	HelloTriangle::cleanupSwapChain();
+	// the device is idle, the views and framebuffers go before the images they use.
+	deletionQueue.flush();
+
+	for (size_t i = 0; i < swapChainImages.size(); i++) {
+		vkDestroyFence(device, presentFences[i], allocationCallbacks);
+		allocator.destroyBuffer(readbackBuffers[i], readbackBuffersMemory[i]);
+		// unlike the images of a real swap chain, these are owned by us.
+		allocator.destroyImage(swapChainImages[i], swapChainImagesMemory[i]);
+	}
+	// also frees readbackCommandBuffers.
+	vkDestroyCommandPool(device, readbackCommandPool, allocationCallbacks);
+}
+
+void HelloTriangleHeadless::createSurface() {
+	// nothing to present to.
+}
+
+// create the images a swap chain would own. One more image than frames in flight,
+// so the CPU never has to wait for an image that is still being rendered.
+void HelloTriangleHeadless::createSwapChain(bool redoQuery, VkSwapchainKHR oldSwapChain) {
+	uint32_t imageCount = static_cast<uint32_t>(std::max(1, options.framesInFlight)) + 1;
+	std::cout << "headless image count: " << imageCount << std::endl;
+
+	// the format a swap chain prefers (see chooseSwapSurfaceFormat), so both paths render the same.
+	swapChainImageFormat = VK_FORMAT_B8G8R8A8_UNORM;
+	swapChainExtent = { static_cast<uint32_t>(WIDTH), static_cast<uint32_t>(HEIGHT) };
+
+	swapChainImages.resize(imageCount);
+	swapChainImagesMemory.resize(imageCount);
+	for (uint32_t i = 0; i < imageCount; i++) {
+		VkImageCreateInfo imageInfo = {};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = swapChainImageFormat;
+		imageInfo.extent.width = swapChainExtent.width;
+		imageInfo.extent.height = swapChainExtent.height;
+		imageInfo.extent.depth = 1;
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		// rendered to, then copied to the readback buffer.
+		imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		allocator.createImage(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, swapChainImages[i], swapChainImagesMemory[i]);
+	}
+	// no frame is using the new images yet.
+	imagesInFlight.assign(imageCount, VK_NULL_HANDLE);
+	imageTimelineValues.assign(imageCount, 0);
+
+	createReadbackResources();
+}
+
+void HelloTriangleHeadless::createReadbackResources() {
+	size_t imageCount = swapChainImages.size();
+	VkDeviceSize bufferSize = static_cast<VkDeviceSize>(swapChainExtent.width) * swapChainExtent.height * 4;
+
+	readbackBuffers.resize(imageCount);
+	readbackBuffersMemory.resize(imageCount);
+	for (size_t i = 0; i < imageCount; i++) {
+		allocator.createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			readbackBuffers[i], readbackBuffersMemory[i]);
+	}
+
+	// createSwapChain runs before createCommandPool, so the copies get their own pool.
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.queueFamilyIndex = findQueueFamilies(physicalDevice).graphicsFamilyIdx;
+	poolInfo.flags = 0;
+
+	if (vkCreateCommandPool(device, &poolInfo, allocationCallbacks, &readbackCommandPool) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create readback command pool!");
+	}
+
+	readbackCommandBuffers.resize(imageCount);
+	VkCommandBufferAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool = readbackCommandPool;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount = static_cast<uint32_t>(imageCount);
+
+	if (vkAllocateCommandBuffers(device, &allocInfo, readbackCommandBuffers.data()) != VK_SUCCESS) {
+		throw std::runtime_error("failed to allocate readback command buffers!");
+	}
+
+	for (size_t i = 0; i < imageCount; i++) {
+		VkCommandBufferBeginInfo beginInfo = {};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		// the same copy is submitted every time the image is "presented".
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+		vkBeginCommandBuffer(readbackCommandBuffers[i], &beginInfo);
+
+		// the render pass already left the image in VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL.
+		VkBufferImageCopy region = {};
+		region.bufferOffset = 0;
+		region.bufferRowLength = 0; // tightly packed
+		region.bufferImageHeight = 0;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = 0;
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = 1;
+		region.imageOffset = { 0, 0, 0 };
+		region.imageExtent = { swapChainExtent.width, swapChainExtent.height, 1 };
+		vkCmdCopyImageToBuffer(readbackCommandBuffers[i], swapChainImages[i], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			readbackBuffers[i], 1, &region);
+
+		// make the copy visible to the host once the fence is signaled.
+		VkBufferMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.buffer = readbackBuffers[i];
+		barrier.offset = 0;
+		barrier.size = VK_WHOLE_SIZE;
+		vkCmdPipelineBarrier(readbackCommandBuffers[i], VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+			0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+		if (vkEndCommandBuffer(readbackCommandBuffers[i]) != VK_SUCCESS) {
+			throw std::runtime_error("failed to record readback command buffer!");
+		}
+	}
+
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	// no image has been presented yet, all of them can be acquired.
+	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+	presentFences.resize(imageCount);
+	for (size_t i = 0; i < imageCount; i++) {
+		if (vkCreateFence(device, &fenceInfo, allocationCallbacks, &presentFences[i]) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create present fence!");
+		}
+	}
+}
+
+// the images are handed out in order, like a FIFO swap chain.
+uint32_t HelloTriangleHeadless::acquireNextImage() {
+	uint32_t imageIndex = nextImageIndex;
+	nextImageIndex = (nextImageIndex + 1) % static_cast<uint32_t>(swapChainImages.size());
+
+	// the previous "present" of this image (the readback copy) must be done before we render to it again.
+	frameTimer.beginWait();
+	vkWaitForFences(device, 1, &presentFences[imageIndex], VK_TRUE, std::numeric_limits<uint64_t>::max());
+	frameTimer.endWait();
+
+	// drawFrame waits on imageAvailableSemaphores[currentFrame], so it has to be signaled.
+	// An empty submit does it, the image is already available.
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &imageAvailableSemaphores[currentFrame];
+	if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+		throw std::runtime_error("failed to signal the acquire semaphore!");
+	}
+	return imageIndex;
+}
+
+void HelloTriangleHeadless::presentImage(uint32_t imageIndex) {
+	// consumes renderFinishedSemaphores[currentFrame] like vkQueuePresentKHR would,
+	// and copies the image back when asked to, which is the work a real present does too.
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	submitInfo.waitSemaphoreCount = 1;
+	submitInfo.pWaitSemaphores = &renderFinishedSemaphores[currentFrame];
+	submitInfo.pWaitDstStageMask = &waitStage;
+	if (options.readbackEveryFrame) {
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &readbackCommandBuffers[imageIndex];
+	}
+
+	vkResetFences(device, 1, &presentFences[imageIndex]);
+	if (vkQueueSubmit(presentQueue, 1, &submitInfo, presentFences[imageIndex]) != VK_SUCCESS) {
+		throw std::runtime_error("failed to submit readback command buffer!");
+	}
+	lastImageIndex = imageIndex;
+}
+
+// only the debug report extension, no surface extensions.
+std::vector<const char*> HelloTriangleHeadless::getRequiredExtensions() {
+	std::vector<const char*> extensions;
+	if (enableValidationLayers) {
+		extensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
+	}
+	return extensions;
+}
+
+// no VK_KHR_swapchain, so a device without any presentation support is fine.
+std::vector<const char*> HelloTriangleHeadless::getRequiredDeviceExtensions() {
+	return std::vector<const char*>();
+}
+
+// write the image as a binary PPM (P6), viewable and diffable everywhere without an image library.
+void HelloTriangleHeadless::writeImage(const std::string& filename, uint32_t imageIndex) {
+	if (!options.readbackEveryFrame) {
+		// the copy has not been done for this image, do it now (the device is idle).
+		VkSubmitInfo submitInfo = {};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &readbackCommandBuffers[imageIndex];
+		if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+			throw std::runtime_error("failed to submit readback command buffer!");
+		}
+		vkQueueWaitIdle(graphicsQueue);
+	}
+
+	std::ofstream file(filename, std::ios::out | std::ios::binary);
+	if (!file.is_open()) {
+		throw std::runtime_error("failed to open file " + filename + "!");
+	}
+	file << "P6\n" << swapChainExtent.width << " " << swapChainExtent.height << "\n255\n";
+
+	// the readback buffers are persistently mapped by the allocator.
+	allocator.invalidate(readbackBuffersMemory[imageIndex]);
+	const unsigned char* pixels = static_cast<const unsigned char*>(readbackBuffersMemory[imageIndex].mapped);
+	size_t pixelCount = static_cast<size_t>(swapChainExtent.width) * swapChainExtent.height;
+	std::vector<char> rgb(pixelCount * 3);
+	for (size_t i = 0; i < pixelCount; i++) {
+		// B8G8R8A8 -> RGB
+		rgb[i * 3 + 0] = pixels[i * 4 + 2];
+		rgb[i * 3 + 1] = pixels[i * 4 + 1];
+		rgb[i * 3 + 2] = pixels[i * 4 + 0];
+	}
+
+	file.write(rgb.data(), rgb.size());
+	std::cout << "wrote " << filename << std::endl;
+}
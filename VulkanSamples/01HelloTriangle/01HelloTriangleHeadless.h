@@ -0,0 +1,40 @@
+#ifndef __01HELLOTRIANGLEHEADLESS_H__
+#define __01HELLOTRIANGLEHEADLESS_H__
+
+#include "01HelloTriangle.h"
+
+// Render the same triangle without a window, surface or VK_KHR_swapchain.
+// The "swap chain" is a ring of images we create ourselves, and "presenting"
+// is (optionally) a copy of the image back to host memory.
+// Useful for benchmarks and image diffs on machines without a display,
+// e.g. a build server with a CPU implementation like lavapipe.
+class HelloTriangleHeadless : public HelloTriangle {
+public:
+	void run();
+private:
+	// one host visible buffer per image, the target of the readback copy.
+	std::vector<VkBuffer> readbackBuffers;
+	std::vector<MemoryAllocator::Allocation> readbackBuffersMemory;
+	std::vector<MemoryAllocator::Allocation> swapChainImagesMemory;
+	// pre-recorded copy image -> readbackBuffers for each image.
+	VkCommandPool readbackCommandPool = VK_NULL_HANDLE;
+	std::vector<VkCommandBuffer> readbackCommandBuffers;
+	// signaled when the "present" submit of the image finished, the image can be rendered to again.
+	std::vector<VkFence> presentFences;
+	uint32_t nextImageIndex = 0;
+	uint32_t lastImageIndex = 0;
+
+	void mainLoop();
+	void cleanupSwapChain();
+	void createSurface();
+	void createSwapChain(bool redoQuery = false, VkSwapchainKHR oldSwapChain = VK_NULL_HANDLE);
+	uint32_t acquireNextImage();
+	void presentImage(uint32_t imageIndex);
+	std::vector<const char*> getRequiredExtensions();
+	std::vector<const char*> getRequiredDeviceExtensions();
+
+	void createReadbackResources();
+	void writeImage(const std::string& filename, uint32_t imageIndex);
+};
+
+#endif
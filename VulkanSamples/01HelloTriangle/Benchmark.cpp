@@ -0,0 +1,158 @@
+#include "Benchmark.h"
+#include "01HelloTriangleHeadless.h"
+
+#include <cstdio>
+
+bool Benchmark::run(const std::string& name) {
+	if (name == "record") {
+		runRecordModes();
+	} else if (name == "instances") {
+		runInstanceCounts();
+	} else if (name == "cull") {
+		runCulling();
+	} else if (name == "perdraw") {
+		runPerDrawModes();
+	} else if (name == "msaa") {
+		runSampleCounts();
+	} else {
+		return false;
+	}
+	return true;
+}
+
+void Benchmark::runRecordModes() {
+	const int drawCounts[] = { 1000, 10000, 100000 };
+	const RecordMode modes[] = { RECORD_STATIC, RECORD_PER_FRAME, RECORD_THREADED };
+	const char* modeNames[] = { "static", "frame", "threads" };
+
+	std::vector<Result> results;
+	for (int draws : drawCounts) {
+		for (int m = 0; m < 3; m++) {
+			AppOptions options = baseOptions;
+			options.drawCount = draws;
+			options.recordMode = modes[m];
+			char name[64];
+			snprintf(name, sizeof(name), "%s, %d draws", modeNames[m], draws);
+			results.push_back(runHeadless(name, options));
+		}
+	}
+	printResults(results);
+}
+
+void Benchmark::runInstanceCounts() {
+	const int instanceCounts[] = { 1, 1000, 10000, 100000, 1000000 };
+
+	std::vector<Result> results;
+	for (int instances : instanceCounts) {
+		AppOptions options = baseOptions;
+		options.instanceCount = instances;
+		char name[64];
+		snprintf(name, sizeof(name), "%d instances", instances);
+		results.push_back(runHeadless(name, options));
+	}
+	printResults(results);
+}
+
+void Benchmark::runCulling() {
+	const int objectCount = 100000;
+
+	std::vector<Result> results;
+	AppOptions options = baseOptions;
+	options.drawCount = objectCount;
+	options.instanceCount = 1;
+	results.push_back(runHeadless("100k draw calls", options));
+
+	options = baseOptions;
+	options.drawCount = 1;
+	options.instanceCount = objectCount;
+	results.push_back(runHeadless("100k instances, no culling", options));
+
+	options.gpuCulling = true;
+	if (options.recordMode == RECORD_THREADED) {
+		options.recordMode = RECORD_PER_FRAME; // a single indirect draw, see main.cpp.
+	}
+	results.push_back(runHeadless("100k instances, GPU culling", options));
+
+	options.asyncCompute = true;
+	results.push_back(runHeadless("100k instances, async culling", options));
+	printResults(results);
+}
+
+void Benchmark::runPerDrawModes() {
+	const int drawCounts[] = { 10000, 100000 };
+	const PerDrawMode modes[] = { PER_DRAW_UNIFORM_BUFFER, PER_DRAW_PUSH_CONSTANTS, PER_DRAW_STORAGE_BUFFER };
+	const char* modeNames[] = { "ubo", "push", "ssbo" };
+
+	std::vector<Result> results;
+	for (int draws : drawCounts) {
+		for (int m = 0; m < 3; m++) {
+			AppOptions options = baseOptions;
+			options.drawCount = draws;
+			options.perDrawMode = modes[m];
+			// the per draw cost is in the recording and the uniform writes, static command 
+			// buffers would hide both.
+			if (options.recordMode == RECORD_STATIC) {
+				options.recordMode = RECORD_PER_FRAME;
+			}
+			char name[64];
+			snprintf(name, sizeof(name), "%s, %d draws", modeNames[m], draws);
+			results.push_back(runHeadless(name, options));
+		}
+	}
+	printResults(results);
+}
+
+void Benchmark::runSampleCounts() {
+	const int sampleCounts[] = { 1, 2, 4, 8 };
+
+	std::vector<Result> results;
+	AppOptions options = baseOptions;
+	options.sampleCount = 1;
+	options.depthBuffer = false;
+	results.push_back(runHeadless("1 sample, no depth", options));
+
+	// clamped to what the device supports, a row may repeat the previous one.
+	for (int samples : sampleCounts) {
+		options = baseOptions;
+		options.sampleCount = samples;
+		options.depthBuffer = true;
+		char name[64];
+		snprintf(name, sizeof(name), "%d samples, depth", samples);
+		results.push_back(runHeadless(name, options));
+	}
+	printResults(results);
+}
+
+Benchmark::Result Benchmark::runHeadless(const std::string& name, const AppOptions& options) {
+	printf("benchmark: %s\n", name.c_str());
+	fflush(stdout);
+
+	AppOptions runOptions = options;
+	runOptions.headless = true;
+	runOptions.reportInterval = 0.0; // only the table at the end.
+	// throughput, never paced.
+	runOptions.presentPolicy = PRESENT_UNCAPPED;
+	runOptions.frameRateLimit = 0.0;
+	if (runOptions.frameCount == 0) runOptions.frameCount = 300;
+
+	HelloTriangleHeadless app;
+	app.setOptions(runOptions);
+	app.run();
+
+	Result result;
+	result.name = name;
+	result.cpu = app.getFrameTimer().getTotalStats();
+	for (const GpuProfiler::Stats& stats : app.getGpuProfiler().getStats()) {
+		if (stats.name == "frame") result.gpuFrameMs = stats.avgMs;
+	}
+	return result;
+}
+
+void Benchmark::printResults(const std::vector<Result>& results) {
+	printf("\n%-32s %10s %10s %10s %10s %10s\n", "run", "frame ms", "fps", "cpu ms", "wait ms", "gpu ms");
+	for (const Result& result : results) {
+		printf("%-32s %10.3f %10.1f %10.3f %10.3f %10.3f\n", result.name.c_str(),
+			result.cpu.avgFrameMs, result.cpu.fps, result.cpu.avgCpuMs, result.cpu.avgWaitMs, result.gpuFrameMs);
+	}
+	fflush(stdout);
+}
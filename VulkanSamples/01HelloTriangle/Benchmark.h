@@ -0,0 +1,45 @@
+#ifndef __BENCHMARK_H__
+#define __BENCHMARK_H__
+
+#include "01HelloTriangle.h"
+
+#include <string>
+#include <vector>
+
+// Runs the headless sample with different settings and prints one table row per run.
+// Each run is a complete HelloTriangleHeadless (instance, device, ...), so nothing
+// cached by a previous run (except the pipeline cache file) changes the numbers.
+class Benchmark {
+public:
+	struct Result {
+		std::string name;
+		FrameTimer::Stats cpu;
+		double gpuFrameMs = 0.0; // avg of the "frame" region, 0 if timestamps are not supported
+	};
+
+	explicit Benchmark(const AppOptions& baseOptions) : baseOptions(baseOptions) {}
+
+	// static vs per-frame vs threaded recording, for 1k to 100k draws.
+	void runRecordModes();
+	// one draw with 1 to 1M instances: vertex fetch and the per-frame instance upload.
+	void runInstanceCounts();
+	// 100k objects: one draw call each vs instanced vs culled in a compute shader (on the
+	// graphics queue or the async compute queue) and drawn indirect.
+	void runCulling();
+	// 10k and 100k draws recorded every frame, the transform of each draw from a dynamic 
+	// uniform buffer offset vs push constants vs an index into a storage buffer.
+	void runPerDrawModes();
+	// 1 to 8 samples with a depth buffer, in transient attachments resolved into the swap chain image.
+	void runSampleCounts();
+
+	// the name of a benchmark for --benchmark, false if unknown.
+	bool run(const std::string& name);
+
+private:
+	AppOptions baseOptions;
+
+	Result runHeadless(const std::string& name, const AppOptions& options);
+	void printResults(const std::vector<Result>& results);
+};
+
+#endif
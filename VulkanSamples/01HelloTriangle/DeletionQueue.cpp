@@ -0,0 +1,21 @@
+#include "DeletionQueue.h"
+
+void DeletionQueue::push(const std::function<void()>& destroy) {
+	entries.push_back({ retireValue, destroy });
+}
+
+void DeletionQueue::collect(uint64_t completedValue) {
+	while (!entries.empty() && entries.front().retireValue <= completedValue) {
+		std::function<void()> destroy = entries.front().destroy;
+		entries.pop_front();
+		destroy();
+	}
+}
+
+void DeletionQueue::flush() {
+	while (!entries.empty()) {
+		std::function<void()> destroy = entries.front().destroy;
+		entries.pop_front();
+		destroy();
+	}
+}
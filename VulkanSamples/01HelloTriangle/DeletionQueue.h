@@ -0,0 +1,40 @@
+#ifndef __DELETIONQUEUE_H__
+#define __DELETIONQUEUE_H__
+
+#include <deque>
+#include <functional>
+#include <cstdint>
+
+// Destroys Vulkan objects once the GPU is done with them, instead of waiting for the
+// device (or all the frames in flight) to go idle before replacing them.
+//
+// Every object is pushed together with the submit value of the work that may still use
+// it: the number of frames submitted so far, which is also the value the graphics
+// timeline reaches when the last of them finishes. collect() destroys everything whose
+// value the GPU has reached. The values only go up, so the queue is in retirement order.
+//
+// usage:
+//		replacing:	push([=]() { vkDestroyX(device, oldX, nullptr); });
+//		per frame:	collect(completed) after the CPU waited for the GPU, setRetireValue(submitted) after the submit.
+//		shutdown:	flush() when the device is idle.
+class DeletionQueue {
+public:
+	// the objects pushed from now on may be used by the work up to value.
+	void setRetireValue(uint64_t value) { retireValue = value; }
+	void push(const std::function<void()>& destroy);
+	// destroy everything retired at or before completedValue.
+	void collect(uint64_t completedValue);
+	// destroy everything, the device must be idle.
+	void flush();
+
+private:
+	struct Entry {
+		uint64_t retireValue;
+		std::function<void()> destroy;
+	};
+
+	std::deque<Entry> entries; // oldest first
+	uint64_t retireValue = 0;
+};
+
+#endif
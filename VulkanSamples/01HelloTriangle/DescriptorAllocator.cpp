@@ -0,0 +1,154 @@
+#include "DescriptorAllocator.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <functional>
+
+void DescriptorLayoutCache::init(VkDevice device) {
+	this->device = device;
+}
+
+void DescriptorLayoutCache::destroy() {
+	for (auto& entry : layouts) {
+		vkDestroyDescriptorSetLayout(device, entry.second, nullptr);
+	}
+	layouts.clear();
+}
+
+VkDescriptorSetLayout DescriptorLayoutCache::getLayout(const VkDescriptorSetLayoutCreateInfo& layoutInfo) {
+	LayoutKey key;
+	key.bindings.assign(layoutInfo.pBindings, layoutInfo.pBindings + layoutInfo.bindingCount);
+	for (const auto& binding : key.bindings) {
+		if (binding.pImmutableSamplers != nullptr) {
+			throw std::runtime_error("immutable samplers are not supported by the layout cache!");
+		}
+	}
+	std::sort(key.bindings.begin(), key.bindings.end(),
+		[](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) { return a.binding < b.binding; });
+
+	auto found = layouts.find(key);
+	if (found != layouts.end()) {
+		return found->second;
+	}
+
+	VkDescriptorSetLayout layout;
+	if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &layout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create descriptor set layout!");
+	}
+	layouts[key] = layout;
+	return layout;
+}
+
+bool DescriptorLayoutCache::LayoutKey::operator==(const LayoutKey& other) const {
+	if (bindings.size() != other.bindings.size()) return false;
+	for (size_t i = 0; i < bindings.size(); i++) {
+		const VkDescriptorSetLayoutBinding& a = bindings[i];
+		const VkDescriptorSetLayoutBinding& b = other.bindings[i];
+		if (a.binding != b.binding || a.descriptorType != b.descriptorType ||
+			a.descriptorCount != b.descriptorCount || a.stageFlags != b.stageFlags) {
+			return false;
+		}
+	}
+	return true;
+}
+
+size_t DescriptorLayoutCache::LayoutKeyHash::operator()(const LayoutKey& key) const {
+	size_t hash = key.bindings.size();
+	// boost::hash_combine
+	auto combine = [&hash](uint32_t value) {
+		hash ^= std::hash<uint32_t>()(value) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+	};
+	for (const auto& binding : key.bindings) {
+		combine(binding.binding);
+		combine(static_cast<uint32_t>(binding.descriptorType));
+		combine(binding.descriptorCount);
+		combine(static_cast<uint32_t>(binding.stageFlags));
+	}
+	return hash;
+}
+
+void DescriptorAllocator::init(VkDevice device, uint32_t setsPerPool) {
+	this->device = device;
+	this->setsPerPool = setsPerPool;
+}
+
+void DescriptorAllocator::destroy() {
+	for (VkDescriptorPool pool : usedPools) {
+		vkDestroyDescriptorPool(device, pool, nullptr);
+	}
+	for (VkDescriptorPool pool : freePools) {
+		vkDestroyDescriptorPool(device, pool, nullptr);
+	}
+	usedPools.clear();
+	freePools.clear();
+	currentPool = VK_NULL_HANDLE;
+}
+
+VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout layout) {
+	if (currentPool == VK_NULL_HANDLE) {
+		currentPool = grabPool();
+	}
+
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = currentPool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &layout;
+
+	VkDescriptorSet descriptorSet;
+	if (vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet) == VK_SUCCESS) {
+		return descriptorSet;
+	}
+
+	// the pool is full (VK_ERROR_OUT_OF_POOL_MEMORY, or VK_ERROR_FRAGMENTED_POOL; 
+	// drivers without VK_KHR_maintenance1 may report anything), try once more with a new one.
+	currentPool = grabPool();
+	allocInfo.descriptorPool = currentPool;
+	if (vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet) != VK_SUCCESS) {
+		throw std::runtime_error("failed to allocate descriptor set!");
+	}
+	return descriptorSet;
+}
+
+void DescriptorAllocator::reset() {
+	for (VkDescriptorPool pool : usedPools) {
+		vkResetDescriptorPool(device, pool, 0);
+		freePools.push_back(pool);
+	}
+	usedPools.clear();
+	currentPool = VK_NULL_HANDLE;
+}
+
+VkDescriptorPool DescriptorAllocator::grabPool() {
+	VkDescriptorPool pool;
+	if (!freePools.empty()) {
+		pool = freePools.back();
+		freePools.pop_back();
+	} else {
+		// descriptors per set of each type, on average. A set needing more of a type 
+		// than the pool has left fails the allocation, and the next pool is used.
+		const struct { VkDescriptorType type; float perSet; } ratios[] = {
+			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.0f },
+			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4.0f },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1.0f },
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2.0f }
+		};
+		std::vector<VkDescriptorPoolSize> poolSizes;
+		for (const auto& ratio : ratios) {
+			poolSizes.push_back({ ratio.type, static_cast<uint32_t>(ratio.perSet * setsPerPool) });
+		}
+
+		VkDescriptorPoolCreateInfo poolInfo = {};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.flags = 0;
+		poolInfo.maxSets = setsPerPool;
+		poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+		poolInfo.pPoolSizes = poolSizes.data();
+		if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create descriptor pool!");
+		}
+	}
+	usedPools.push_back(pool);
+	return pool;
+}
@@ -0,0 +1,66 @@
+#ifndef __DESCRIPTORALLOCATOR_H__
+#define __DESCRIPTORALLOCATOR_H__
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+// Creates every VkDescriptorSetLayout only once.
+// Pipelines built from the same bindings get the same layout handle, which also
+// makes their pipeline layouts compatible for vkCmdBindDescriptorSets.
+// The layouts are owned by the cache and destroyed with it.
+class DescriptorLayoutCache {
+public:
+	void init(VkDevice device);
+	void destroy();
+
+	// the order of the bindings doesn't matter. Immutable samplers are not supported.
+	VkDescriptorSetLayout getLayout(const VkDescriptorSetLayoutCreateInfo& layoutInfo);
+
+private:
+	struct LayoutKey {
+		std::vector<VkDescriptorSetLayoutBinding> bindings; // sorted by binding
+		bool operator==(const LayoutKey& other) const;
+	};
+	struct LayoutKeyHash {
+		size_t operator()(const LayoutKey& key) const;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	std::unordered_map<LayoutKey, VkDescriptorSetLayout, LayoutKeyHash> layouts;
+};
+
+// Hands out descriptor sets from a growing list of pools, and takes them all back
+// at once with vkResetDescriptorPool. Sets are never freed one by one, so the pools
+// are created without VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT, which lets
+// the driver allocate from them like from a linear allocator.
+//
+// One allocator per frame in flight: after the frame's fence, reset() and allocate
+// the sets of the frame again. A pool that ran full is kept for the next frames, so
+// after a few frames allocate() never creates pools anymore.
+class DescriptorAllocator {
+public:
+	void init(VkDevice device, uint32_t setsPerPool = 256);
+	// the sets must not be in use by the GPU anymore.
+	void destroy();
+
+	VkDescriptorSet allocate(VkDescriptorSetLayout layout);
+	// all the sets allocated so far become invalid.
+	void reset();
+
+	uint32_t getPoolCount() const { return static_cast<uint32_t>(usedPools.size() + freePools.size()); }
+
+private:
+	VkDevice device = VK_NULL_HANDLE;
+	uint32_t setsPerPool = 0;
+	VkDescriptorPool currentPool = VK_NULL_HANDLE;
+	std::vector<VkDescriptorPool> usedPools; // including currentPool
+	std::vector<VkDescriptorPool> freePools; // reset, ready to be used again
+
+	VkDescriptorPool grabPool();
+};
+
+#endif
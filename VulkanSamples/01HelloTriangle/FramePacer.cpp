@@ -0,0 +1,102 @@
+#include "FramePacer.h"
+
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include <thread>
+
+// sleep_for wakes up late by up to a scheduler tick, the last part before the deadline is spun.
+static const std::chrono::microseconds SPIN_TIME(1000);
+
+void FramePacer::setFrameRateLimit(double fps) {
+	if (fps > 0.0) {
+		framePeriod = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / fps));
+	} else {
+		framePeriod = Clock::duration::zero();
+	}
+	paced = false;
+}
+
+void FramePacer::waitForNextFrame() {
+	if (framePeriod == Clock::duration::zero()) return;
+
+	Clock::time_point now = Clock::now();
+	if (!paced) {
+		nextFrame = now;
+		paced = true;
+	}
+
+	if (now < nextFrame) {
+		if (nextFrame - now > SPIN_TIME) {
+			std::this_thread::sleep_for(nextFrame - now - SPIN_TIME);
+		}
+		while (Clock::now() < nextFrame) {
+			std::this_thread::yield();
+		}
+	} else if (now - nextFrame > framePeriod) {
+		// more than a whole frame late (a hitch, a resize): start over from now,
+		// rushing the missed frames out would only be another hitch.
+		nextFrame = now;
+	}
+	// from the deadline, not from the wake up, so the sleep inaccuracy doesn't add up.
+	nextFrame += framePeriod;
+}
+
+void FramePacer::presented() {
+	Clock::time_point now = Clock::now();
+	if (!presentedOnce) {
+		presentedOnce = true;
+		lastPresent = now;
+		lastReport = now;
+		return;
+	}
+
+	double ms = std::chrono::duration<double, std::milli>(now - lastPresent).count();
+	lastPresent = now;
+	total.add(ms);
+
+	// the samples are only kept for the p99 of the next report, and cleared by it.
+	if (reportInterval <= 0.0) return;
+	interval.add(ms);
+	intervalSamples.push_back(ms);
+	if (std::chrono::duration<double>(now - lastReport).count() >= reportInterval) {
+		report();
+		interval = Accum();
+		intervalSamples.clear();
+		lastReport = now;
+	}
+}
+
+void FramePacer::Accum::add(double ms) {
+	minMs = count == 0 ? ms : std::min(minMs, ms);
+	maxMs = count == 0 ? ms : std::max(maxMs, ms);
+	count++;
+	sumMs += ms;
+	sumSqMs += ms * ms;
+}
+
+FramePacer::Stats FramePacer::Accum::toStats() const {
+	Stats stats;
+	stats.presents = count;
+	if (count == 0) return stats;
+
+	stats.avgIntervalMs = sumMs / count;
+	stats.minIntervalMs = minMs;
+	stats.maxIntervalMs = maxMs;
+	double variance = sumSqMs / count - stats.avgIntervalMs * stats.avgIntervalMs;
+	stats.jitterMs = std::sqrt(std::max(0.0, variance));
+	return stats;
+}
+
+void FramePacer::report() {
+	Stats stats = interval.toStats();
+	if (!intervalSamples.empty()) {
+		std::vector<double> sorted = intervalSamples;
+		size_t index = std::min(sorted.size() - 1, sorted.size() * 99 / 100);
+		std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+		stats.p99IntervalMs = sorted[index];
+	}
+	printf("present: %.3f ms, jitter: %.3f ms, min: %.3f ms, max: %.3f ms, p99: %.3f ms\n",
+		stats.avgIntervalMs, stats.jitterMs, stats.minIntervalMs, stats.maxIntervalMs, stats.p99IntervalMs);
+	fflush(stdout);
+}
@@ -0,0 +1,71 @@
+#ifndef __FRAMEPACER_H__
+#define __FRAMEPACER_H__
+
+#include <chrono>
+#include <vector>
+#include <cstdint>
+
+// CPU side frame pacing, the present side counterpart of FrameTimer.
+//
+// The frame rate limit sleeps at the top of the main loop, before the input is polled and
+// the frame is built. The frame then starts with the newest input and goes straight to the
+// GPU. Sleeping after the input was sampled (or blocking in the present) would add the sleep
+// to the input-to-photon latency instead.
+//
+// The present-to-present intervals are taken on the CPU, when the present call returns.
+// With FIFO the acquire blocks on the display, so they follow the refresh rate. The jitter
+// is their standard deviation: steady pacing means a low jitter, not only a high average.
+//
+// usage:
+//		per frame:	waitForNextFrame(); poll input; draw; presented();
+class FramePacer {
+public:
+	struct Stats {
+		uint64_t presents = 0;
+		double avgIntervalMs = 0.0;
+		double minIntervalMs = 0.0;
+		double maxIntervalMs = 0.0;
+		double jitterMs = 0.0;
+		double p99IntervalMs = 0.0; // only in the reports, over the last reportInterval.
+	};
+
+	// print the interval stats every reportInterval seconds, <= 0 to disable.
+	double reportInterval = 1.0;
+
+	// frames per second, <= 0 for no limit.
+	void setFrameRateLimit(double fps);
+	// sleep until the next frame is due.
+	void waitForNextFrame();
+	void presented();
+
+	// over the whole run.
+	Stats getTotalStats() const { return total.toStats(); }
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Accum {
+		uint64_t count = 0;
+		double sumMs = 0.0;
+		double sumSqMs = 0.0;
+		double minMs = 0.0;
+		double maxMs = 0.0;
+		void add(double ms);
+		Stats toStats() const;
+	};
+
+	Clock::duration framePeriod = Clock::duration::zero();
+	Clock::time_point nextFrame;
+	bool paced = false;
+
+	bool presentedOnce = false;
+	Clock::time_point lastPresent;
+	Clock::time_point lastReport;
+	Accum interval; // reset after each report.
+	std::vector<double> intervalSamples; // for the p99 of the report, empty without reports
+	Accum total;
+
+	void report();
+};
+
+#endif
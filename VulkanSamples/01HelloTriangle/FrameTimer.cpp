@@ -0,0 +1,65 @@
+#include "FrameTimer.h"
+
+#include <cstdio>
+
+void FrameTimer::beginFrame() {
+	Clock::time_point now = Clock::now();
+	if (started) {
+		// the previous frame ends when the next one begins,
+		// so everything in the main loop is counted.
+		double frameSec = std::chrono::duration<double>(now - frameStart).count();
+		interval.frames++;
+		interval.frameSec += frameSec;
+		interval.waitSec += frameWaitSec;
+		total.frames++;
+		total.frameSec += frameSec;
+		total.waitSec += frameWaitSec;
+	} else {
+		started = true;
+		lastReport = now;
+	}
+	frameStart = now;
+	frameWaitSec = 0.0;
+}
+
+void FrameTimer::endFrame() {
+	if (reportInterval <= 0.0) return;
+
+	double sinceReport = std::chrono::duration<double>(Clock::now() - lastReport).count();
+	if (sinceReport >= reportInterval && interval.frames > 0) {
+		report();
+		interval = Accum();
+		lastReport = Clock::now();
+	}
+}
+
+void FrameTimer::beginWait() {
+	waitStart = Clock::now();
+}
+
+void FrameTimer::endWait() {
+	frameWaitSec += std::chrono::duration<double>(Clock::now() - waitStart).count();
+}
+
+FrameTimer::Stats FrameTimer::getTotalStats() const {
+	return total.toStats();
+}
+
+FrameTimer::Stats FrameTimer::Accum::toStats() const {
+	Stats stats;
+	stats.frames = frames;
+	if (frames == 0) return stats;
+
+	stats.avgFrameMs = frameSec * 1000.0 / frames;
+	stats.avgWaitMs = waitSec * 1000.0 / frames;
+	stats.avgCpuMs = stats.avgFrameMs - stats.avgWaitMs;
+	stats.fps = frameSec > 0.0 ? frames / frameSec : 0.0;
+	return stats;
+}
+
+void FrameTimer::report() {
+	Stats stats = interval.toStats();
+	printf("frame: %.3f ms (%.1f fps), cpu: %.3f ms, wait gpu: %.3f ms\n",
+		stats.avgFrameMs, stats.fps, stats.avgCpuMs, stats.avgWaitMs);
+	fflush(stdout);
+}
@@ -0,0 +1,59 @@
+#ifndef __FRAMETIMER_H__
+#define __FRAMETIMER_H__
+
+#include <chrono>
+#include <cstdint>
+
+// CPU side frame time counter.
+// frame time: time between two beginFrame() calls.
+// wait time: time the CPU was blocked waiting for the GPU (fences) inside the frame.
+// cpu time: frame time - wait time, the time the CPU was actually doing work.
+//
+// Without any overlap, frame = cpu + gpu. With N frames in flight it should
+// get close to max(cpu, gpu), the wait time shows how long the CPU is idle.
+// Run it on a software driver (e.g. lavapipe) where the GPU is slow to see
+// the difference clearly.
+class FrameTimer {
+public:
+	struct Stats {
+		uint64_t frames = 0;
+		double avgFrameMs = 0.0;
+		double avgCpuMs = 0.0;
+		double avgWaitMs = 0.0;
+		double fps = 0.0;
+	};
+
+	// print the averages every reportInterval seconds, <= 0 to disable.
+	double reportInterval = 1.0;
+
+	void beginFrame();
+	void endFrame();
+	void beginWait();
+	void endWait();
+
+	// averages over the whole run.
+	Stats getTotalStats() const;
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	struct Accum {
+		uint64_t frames = 0;
+		double frameSec = 0.0;
+		double waitSec = 0.0;
+		Stats toStats() const;
+	};
+
+	bool started = false;
+	Clock::time_point frameStart;
+	Clock::time_point waitStart;
+	Clock::time_point lastReport;
+	double frameWaitSec = 0.0;
+
+	Accum interval; // reset after each report.
+	Accum total;
+
+	void report();
+};
+
+#endif
@@ -0,0 +1,176 @@
+#include "GpuProfiler.h"
+
+#include <cstdio>
+#include <algorithm>
+#include <stdexcept>
+
+void GpuProfiler::init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamilyIndex) {
+	this->device = device;
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	// the number of nanoseconds required for a timestamp query to be incremented by 1.
+	timestampPeriod = properties.limits.timestampPeriod;
+
+	// timestampValidBits is 0 if the queue family does not support timestamps at all,
+	// otherwise only the low bits are meaningful and the counter wraps around.
+	uint32_t queueFamilyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+	uint32_t validBits = queueFamilies[queueFamilyIndex].timestampValidBits;
+	timestampMask = validBits >= 64 ? ~0ull : ((1ull << validBits) - 1);
+
+	supported = validBits > 0 && timestampPeriod > 0.0f;
+	if (!supported) {
+		printf("gpu timestamps are not supported by the queue family, gpu timing disabled\n");
+	}
+}
+
+void GpuProfiler::createSlots(uint32_t slotCount, DeletionQueue* deletionQueue) {
+	if (!supported) return;
+
+	for (size_t i = 0; i < slots.size(); i++) {
+		VkQueryPool queryPool = slots[i].queryPool;
+		VkDevice device = this->device;
+		if (deletionQueue != nullptr) {
+			deletionQueue->push([device, queryPool]() { vkDestroyQueryPool(device, queryPool, nullptr); });
+		} else {
+			vkDestroyQueryPool(device, queryPool, nullptr);
+		}
+	}
+	slots.clear();
+	slots.resize(slotCount);
+
+	VkQueryPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	poolInfo.queryCount = 2 * MAX_REGIONS;
+
+	for (uint32_t i = 0; i < slotCount; i++) {
+		if (vkCreateQueryPool(device, &poolInfo, nullptr, &slots[i].queryPool) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create timestamp query pool!");
+		}
+	}
+	// 2 values (timestamp, availability) per query.
+	results.resize(2 * 2 * MAX_REGIONS);
+}
+
+void GpuProfiler::destroy() {
+	for (size_t i = 0; i < slots.size(); i++) {
+		vkDestroyQueryPool(device, slots[i].queryPool, nullptr);
+	}
+	slots.clear();
+}
+
+void GpuProfiler::resetSlot(VkCommandBuffer commandBuffer, uint32_t slot) {
+	if (!supported) return;
+
+	// queries have to be reset before they can be written again, and the reset
+	// is part of the command buffer, so a re-submitted command buffer resets them each time.
+	vkCmdResetQueryPool(commandBuffer, slots[slot].queryPool, 0, 2 * MAX_REGIONS);
+	slots[slot].regions.clear();
+}
+
+void GpuProfiler::beginRegion(VkCommandBuffer commandBuffer, uint32_t slot, const char* name) {
+	if (!supported) return;
+
+	uint32_t region = findRegion(name);
+	slots[slot].regions.push_back(region);
+	// TOP_OF_PIPE: the timestamp is written as soon as all previous commands have started.
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, slots[slot].queryPool, 2 * region);
+}
+
+void GpuProfiler::endRegion(VkCommandBuffer commandBuffer, uint32_t slot, const char* name) {
+	if (!supported) return;
+
+	uint32_t region = findRegion(name);
+	// BOTTOM_OF_PIPE: the timestamp is written when all previous commands have completed.
+	vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, slots[slot].queryPool, 2 * region + 1);
+}
+
+void GpuProfiler::submitted(uint32_t slot) {
+	if (!supported) return;
+	slots[slot].pending = true;
+}
+
+void GpuProfiler::collect(uint32_t slot) {
+	if (!supported || !slots[slot].pending || slots[slot].regions.empty()) return;
+
+	uint32_t regionCount = *std::max_element(slots[slot].regions.begin(), slots[slot].regions.end()) + 1;
+	// no VK_QUERY_RESULT_WAIT_BIT: the caller already waited for the fence. If a query is still not
+	// available anyway, its availability value is 0 and the sample is dropped instead of stalling.
+	vkGetQueryPoolResults(device, slots[slot].queryPool, 0, 2 * regionCount,
+		results.size() * sizeof(uint64_t), results.data(), 2 * sizeof(uint64_t),
+		VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+	slots[slot].pending = false;
+
+	for (uint32_t region : slots[slot].regions) {
+		const uint64_t* begin = &results[4 * region];
+		const uint64_t* end = &results[4 * region + 2];
+		if (begin[1] == 0 || end[1] == 0) continue;
+
+		uint64_t ticks = (end[0] - begin[0]) & timestampMask;
+		addSample(regions[region], ticks * timestampPeriod / 1000000.0);
+	}
+
+	if (reportInterval <= 0.0) return;
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (!reportStarted) {
+		reportStarted = true;
+		lastReport = now;
+	} else if (std::chrono::duration<double>(now - lastReport).count() >= reportInterval) {
+		report();
+		lastReport = now;
+	}
+}
+
+std::vector<GpuProfiler::Stats> GpuProfiler::getStats() const {
+	std::vector<Stats> allStats;
+	for (const Region& region : regions) {
+		Stats stats;
+		stats.name = region.name;
+		stats.samples = region.count;
+		size_t n = static_cast<size_t>(std::min<uint64_t>(region.count, region.samples.size()));
+		if (n > 0) {
+			std::vector<double> sorted(region.samples.begin(), region.samples.begin() + n);
+			std::sort(sorted.begin(), sorted.end());
+			double sum = 0.0;
+			for (double ms : sorted) sum += ms;
+			stats.minMs = sorted.front();
+			stats.avgMs = sum / n;
+			stats.p99Ms = sorted[std::min(n - 1, static_cast<size_t>(n * 0.99))];
+		}
+		allStats.push_back(stats);
+	}
+	return allStats;
+}
+
+void GpuProfiler::report() {
+	for (const Stats& stats : getStats()) {
+		if (stats.samples == 0) continue;
+		printf("gpu %s: min %.3f ms, avg %.3f ms, p99 %.3f ms\n",
+			stats.name.c_str(), stats.minMs, stats.avgMs, stats.p99Ms);
+	}
+	fflush(stdout);
+}
+
+uint32_t GpuProfiler::findRegion(const char* name) {
+	for (uint32_t i = 0; i < regions.size(); i++) {
+		if (regions[i].name == name) return i;
+	}
+	if (regions.size() >= MAX_REGIONS) {
+		throw std::runtime_error("too many gpu profiler regions!");
+	}
+	Region region;
+	region.name = name;
+	region.samples.resize(windowSize);
+	regions.push_back(region);
+	return static_cast<uint32_t>(regions.size() - 1);
+}
+
+void GpuProfiler::addSample(Region& region, double ms) {
+	region.samples[region.next] = ms;
+	region.next = (region.next + 1) % region.samples.size();
+	region.count++;
+}
@@ -0,0 +1,92 @@
+#ifndef __GPUPROFILER_H__
+#define __GPUPROFILER_H__
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include "DeletionQueue.h"
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <chrono>
+
+// GPU side timing with timestamp queries, the counterpart of FrameTimer.
+// Each named region writes a timestamp at its begin and at its end, the
+// difference (in timestampPeriod ns ticks) is the GPU time of the region.
+//
+// The queries are grouped in slots, one VkQueryPool per slot. A slot is used
+// by one command buffer at a time (here: one per swap chain image, because the
+// command buffers are pre-recorded per image). The results of a slot are read
+// right before the slot is submitted again, when the fence of its previous
+// submission has already been waited for, so reading never stalls.
+//
+// usage:
+//		recording:	resetSlot(cmd, slot); beginRegion(cmd, slot, "x"); ... endRegion(cmd, slot, "x");
+//		per frame:	collect(slot) after the slot's fence, submitted(slot) after vkQueueSubmit.
+class GpuProfiler {
+public:
+	struct Stats {
+		std::string name;
+		uint64_t samples = 0;
+		double minMs = 0.0;
+		double avgMs = 0.0;
+		double p99Ms = 0.0;
+	};
+
+	// print the rolling stats every reportInterval seconds from collect(), <= 0 to disable.
+	double reportInterval = 1.0;
+	// number of samples per region the rolling stats are computed from.
+	size_t windowSize = 256;
+
+	void init(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t queueFamilyIndex);
+	// (re)create the query pools, e.g. when the number of swap chain images changed.
+	// The old pools must not be in use by the GPU, or go to deletionQueue.
+	void createSlots(uint32_t slotCount, DeletionQueue* deletionQueue = nullptr);
+	void destroy();
+	bool isSupported() const { return supported; }
+
+	// must be recorded outside of a render pass, before any region of the slot.
+	void resetSlot(VkCommandBuffer commandBuffer, uint32_t slot);
+	void beginRegion(VkCommandBuffer commandBuffer, uint32_t slot, const char* name);
+	void endRegion(VkCommandBuffer commandBuffer, uint32_t slot, const char* name);
+
+	void submitted(uint32_t slot);
+	void collect(uint32_t slot);
+
+	std::vector<Stats> getStats() const;
+	void report();
+
+private:
+	// the begin and end timestamps of a region are two queries, so a pool has 2 * MAX_REGIONS queries.
+	static const uint32_t MAX_REGIONS = 16;
+
+	struct Region {
+		std::string name;
+		std::vector<double> samples; // ring buffer of windowSize samples in ms.
+		size_t next = 0;
+		uint64_t count = 0;
+	};
+
+	struct Slot {
+		VkQueryPool queryPool = VK_NULL_HANDLE;
+		// regions recorded into the command buffer of this slot.
+		std::vector<uint32_t> regions;
+		bool pending = false; // submitted, results not collected yet.
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	bool supported = false;
+	float timestampPeriod = 1.0f; // ns per tick
+	uint64_t timestampMask = ~0ull; // only timestampValidBits are meaningful.
+	std::vector<Region> regions;
+	std::vector<Slot> slots;
+	bool reportStarted = false;
+	std::chrono::steady_clock::time_point lastReport;
+	std::vector<uint64_t> results;
+
+	uint32_t findRegion(const char* name);
+	void addSample(Region& region, double ms);
+};
+
+#endif
@@ -0,0 +1,221 @@
+#include "HostAllocator.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+static const char* SCOPE_NAMES[] = { "command", "object", "cache", "device", "instance" };
+
+static uintptr_t alignUp(uintptr_t address, size_t alignment) {
+	return (address + alignment - 1) & ~(uintptr_t)(alignment - 1);
+}
+
+void HostAllocator::init(size_t commandArenaSize) {
+	std::lock_guard<std::mutex> lock(mutex);
+	for (int i = 0; i < SCOPE_COUNT; i++) {
+		scopes[i] = ScopeStats();
+	}
+	totalLiveBytes = 0;
+	totalPeakBytes = 0;
+	totalInternalLiveBytes = 0;
+	totalInternalPeakBytes = 0;
+
+	arena.assign(commandArenaSize, 0);
+	arenaHead = 0;
+	arenaLiveCount = 0;
+	arenaStats = ArenaStats();
+	arenaStats.size = commandArenaSize;
+
+	callbacks.pUserData = this;
+	callbacks.pfnAllocation = allocationCallback;
+	callbacks.pfnReallocation = reallocationCallback;
+	callbacks.pfnFree = freeCallback;
+	callbacks.pfnInternalAllocation = internalAllocationCallback;
+	callbacks.pfnInternalFree = internalFreeCallback;
+}
+
+void HostAllocator::destroy() {
+	std::lock_guard<std::mutex> lock(mutex);
+	std::vector<char>().swap(arena);
+	arenaHead = 0;
+}
+
+void HostAllocator::resetCommandArena() {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (arena.empty()) return;
+
+	// a free in the arena does nothing, the block can only be reused once nothing in it is live.
+	if (arenaLiveCount > 0) {
+		arenaStats.skippedResets++;
+		return;
+	}
+	arenaHead = 0;
+	arenaStats.resets++;
+}
+
+HostAllocator::ScopeStats HostAllocator::getStats(VkSystemAllocationScope scope) const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return scopes[scope];
+}
+
+HostAllocator::ScopeStats HostAllocator::getTotalStats() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	ScopeStats total;
+	for (int i = 0; i < SCOPE_COUNT; i++) {
+		total.allocations += scopes[i].allocations;
+		total.reallocations += scopes[i].reallocations;
+		total.frees += scopes[i].frees;
+		total.internalAllocations += scopes[i].internalAllocations;
+	}
+	total.liveBytes = totalLiveBytes;
+	total.peakBytes = totalPeakBytes;
+	total.internalLiveBytes = totalInternalLiveBytes;
+	total.internalPeakBytes = totalInternalPeakBytes;
+	return total;
+}
+
+HostAllocator::ArenaStats HostAllocator::getArenaStats() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return arenaStats;
+}
+
+void HostAllocator::printStats() const {
+	ScopeStats total = getTotalStats();
+	printf("host memory: %d allocations, %d reallocations, %d frees, live %.1f KB, peak %.1f KB, internal peak %.1f KB\n",
+		(int)total.allocations, (int)total.reallocations, (int)total.frees,
+		total.liveBytes / 1024.0, total.peakBytes / 1024.0, total.internalPeakBytes / 1024.0);
+	for (int i = 0; i < SCOPE_COUNT; i++) {
+		ScopeStats stats = getStats((VkSystemAllocationScope)i);
+		printf("\t%s: %d allocations, %d reallocations, %d frees, live %.1f KB, peak %.1f KB, internal %d peak %.1f KB\n",
+			SCOPE_NAMES[i], (int)stats.allocations, (int)stats.reallocations, (int)stats.frees,
+			stats.liveBytes / 1024.0, stats.peakBytes / 1024.0,
+			(int)stats.internalAllocations, stats.internalPeakBytes / 1024.0);
+	}
+	ArenaStats commandArena = getArenaStats();
+	if (commandArena.size > 0) {
+		printf("\tcommand arena %.1f KB: %d allocations, %d overflows, peak %.1f KB, %d resets, %d skipped\n",
+			commandArena.size / 1024.0, (int)commandArena.allocations, (int)commandArena.overflows,
+			commandArena.peakBytes / 1024.0, (int)commandArena.resets, (int)commandArena.skippedResets);
+	}
+	fflush(stdout);
+}
+
+void* HostAllocator::allocateBlock(size_t size, size_t alignment, VkSystemAllocationScope scope) {
+	// the header goes right before the block, so the block has to be aligned for it too.
+	alignment = std::max(alignment, alignof(Header));
+
+	char* memory = nullptr;
+	void* raw = nullptr;
+	if (scope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND && !arena.empty()) {
+		uintptr_t base = (uintptr_t)arena.data();
+		uintptr_t address = alignUp(base + arenaHead + sizeof(Header), alignment);
+		if (address + size <= base + arena.size()) {
+			memory = (char*)address;
+			arenaHead = address + size - base;
+			arenaLiveCount++;
+			arenaStats.allocations++;
+			arenaStats.peakBytes = std::max(arenaStats.peakBytes, arenaHead);
+		} else {
+			arenaStats.overflows++;
+		}
+	}
+	if (memory == nullptr) {
+		raw = malloc(sizeof(Header) + alignment - 1 + size);
+		if (raw == nullptr) return nullptr;
+		memory = (char*)alignUp((uintptr_t)raw + sizeof(Header), alignment);
+	}
+
+	Header* header = (Header*)memory - 1;
+	header->raw = raw;
+	header->size = size;
+	header->scope = scope;
+	addBytes(scope, size);
+	return memory;
+}
+
+void HostAllocator::freeBlock(void* memory) {
+	Header* header = (Header*)memory - 1;
+	ScopeStats& stats = scopes[header->scope];
+	stats.liveBytes -= header->size;
+	totalLiveBytes -= header->size;
+	if (header->raw == nullptr) {
+		// in the arena, reused after the next reset.
+		arenaLiveCount--;
+	} else {
+		free(header->raw);
+	}
+}
+
+void HostAllocator::addBytes(VkSystemAllocationScope scope, size_t size) {
+	ScopeStats& stats = scopes[scope];
+	stats.liveBytes += size;
+	stats.peakBytes = std::max(stats.peakBytes, stats.liveBytes);
+	totalLiveBytes += size;
+	totalPeakBytes = std::max(totalPeakBytes, totalLiveBytes);
+}
+
+void* VKAPI_PTR HostAllocator::allocationCallback(void* pUserData, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+	HostAllocator* self = static_cast<HostAllocator*>(pUserData);
+	std::lock_guard<std::mutex> lock(self->mutex);
+	void* memory = self->allocateBlock(size, alignment, scope);
+	if (memory != nullptr) {
+		self->scopes[scope].allocations++;
+	}
+	return memory;
+}
+
+void* VKAPI_PTR HostAllocator::reallocationCallback(void* pUserData, void* pOriginal, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+	if (pOriginal == nullptr) {
+		return allocationCallback(pUserData, size, alignment, scope);
+	}
+	if (size == 0) {
+		freeCallback(pUserData, pOriginal);
+		return nullptr;
+	}
+
+	HostAllocator* self = static_cast<HostAllocator*>(pUserData);
+	std::lock_guard<std::mutex> lock(self->mutex);
+	// always a new block: in place would need the size of the malloc block, and an arena
+	// block can't grow. On failure the original has to stay untouched.
+	Header* original = (Header*)pOriginal - 1;
+	void* memory = self->allocateBlock(size, alignment, scope);
+	if (memory == nullptr) return nullptr;
+	memcpy(memory, pOriginal, std::min(size, original->size));
+	self->scopes[original->scope].frees++;
+	self->freeBlock(pOriginal);
+	self->scopes[scope].allocations++;
+	self->scopes[scope].reallocations++;
+	return memory;
+}
+
+void VKAPI_PTR HostAllocator::freeCallback(void* pUserData, void* pMemory) {
+	if (pMemory == nullptr) return;
+
+	HostAllocator* self = static_cast<HostAllocator*>(pUserData);
+	std::lock_guard<std::mutex> lock(self->mutex);
+	Header* header = (Header*)pMemory - 1;
+	self->scopes[header->scope].frees++;
+	self->freeBlock(pMemory);
+}
+
+void VKAPI_PTR HostAllocator::internalAllocationCallback(void* pUserData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope) {
+	HostAllocator* self = static_cast<HostAllocator*>(pUserData);
+	std::lock_guard<std::mutex> lock(self->mutex);
+	ScopeStats& stats = self->scopes[scope];
+	stats.internalAllocations++;
+	stats.internalLiveBytes += size;
+	stats.internalPeakBytes = std::max(stats.internalPeakBytes, stats.internalLiveBytes);
+	self->totalInternalLiveBytes += size;
+	self->totalInternalPeakBytes = std::max(self->totalInternalPeakBytes, self->totalInternalLiveBytes);
+}
+
+void VKAPI_PTR HostAllocator::internalFreeCallback(void* pUserData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope) {
+	HostAllocator* self = static_cast<HostAllocator*>(pUserData);
+	std::lock_guard<std::mutex> lock(self->mutex);
+	ScopeStats& stats = self->scopes[scope];
+	// a driver could report a free for an allocation made before the callbacks were installed.
+	size = std::min(size, stats.internalLiveBytes);
+	stats.internalLiveBytes -= size;
+	self->totalInternalLiveBytes -= std::min(size, self->totalInternalLiveBytes);
+}
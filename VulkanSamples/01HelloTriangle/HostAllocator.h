@@ -0,0 +1,105 @@
+#ifndef __HOSTALLOCATOR_H__
+#define __HOSTALLOCATOR_H__
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+// VkAllocationCallbacks that route the host memory the driver allocates for our objects
+// through us, to see how much of it there is and what it is for.
+//
+// - the allocations are counted per VkSystemAllocationScope, with their live and peak
+//   bytes (as requested by the driver, without our header). The memory the driver
+//   allocates on its own and only reports (pfnInternalAllocation) is counted separately.
+// - COMMAND scope allocations only live for the duration of the Vulkan command that
+//   made them. With a command arena they are bumped from one fixed block instead of
+//   going through malloc, freeing them does nothing, and the block is reset as a whole
+//   once per frame. When it is full they fall back to the heap, so it never fails.
+//   A reset is skipped while a COMMAND allocation is still live, e.g. in the middle of
+//   a pipeline compile on a background thread.
+// - the callbacks may be called from any thread, everything is behind one mutex.
+//
+// Only the objects created with getCallbacks() are seen, and every one of them has to be
+// destroyed with the same callbacks. This object must outlive all of them.
+//
+// usage:
+//		init:		init(arenaSize); pass getCallbacks() as pAllocator to vkCreate*/vkDestroy*.
+//		per frame:	resetCommandArena().
+class HostAllocator {
+public:
+	struct ScopeStats {
+		uint64_t allocations = 0;	// including the new block of a reallocation
+		uint64_t reallocations = 0;
+		uint64_t frees = 0;
+		size_t liveBytes = 0;
+		size_t peakBytes = 0;
+		// reported by the driver through the internal allocation notifications.
+		uint64_t internalAllocations = 0;
+		size_t internalLiveBytes = 0;
+		size_t internalPeakBytes = 0;
+	};
+
+	struct ArenaStats {
+		size_t size = 0;			// 0: no arena
+		uint64_t allocations = 0;	// served from the arena
+		uint64_t overflows = 0;		// COMMAND allocations that did not fit, served from the heap
+		uint64_t resets = 0;
+		uint64_t skippedResets = 0;	// a COMMAND allocation was still live
+		size_t peakBytes = 0;		// the highest the arena was filled, with alignment and headers
+	};
+
+	// commandArenaSize: bytes of the COMMAND scope arena, 0 to allocate them from the heap like the rest.
+	void init(size_t commandArenaSize);
+	// after the last object created with the callbacks is destroyed.
+	void destroy();
+
+	const VkAllocationCallbacks* getCallbacks() const { return &callbacks; }
+	// start the arena from the top again, the COMMAND allocations of the last frame are over.
+	void resetCommandArena();
+
+	ScopeStats getStats(VkSystemAllocationScope scope) const;
+	// all the scopes, the peaks are the peaks of the sums (not the sums of the peaks).
+	ScopeStats getTotalStats() const;
+	ArenaStats getArenaStats() const;
+	void printStats() const;
+
+private:
+	static const int SCOPE_COUNT = VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1;
+
+	// in front of every block handed out, the driver does not pass the size to pfnFree.
+	struct Header {
+		void* raw;		// what to free, nullptr if in the arena
+		size_t size;	// requested
+		VkSystemAllocationScope scope;
+	};
+
+	VkAllocationCallbacks callbacks = {};
+	mutable std::mutex mutex;
+	ScopeStats scopes[SCOPE_COUNT];
+	size_t totalLiveBytes = 0;
+	size_t totalPeakBytes = 0;
+	size_t totalInternalLiveBytes = 0;
+	size_t totalInternalPeakBytes = 0;
+
+	std::vector<char> arena;
+	size_t arenaHead = 0;
+	uint32_t arenaLiveCount = 0;
+	ArenaStats arenaStats;
+
+	// not counted as allocations/frees, only the bytes are tracked. The mutex must be held.
+	void* allocateBlock(size_t size, size_t alignment, VkSystemAllocationScope scope);
+	void freeBlock(void* memory);
+	void addBytes(VkSystemAllocationScope scope, size_t size);
+
+	static void* VKAPI_PTR allocationCallback(void* pUserData, size_t size, size_t alignment, VkSystemAllocationScope scope);
+	static void* VKAPI_PTR reallocationCallback(void* pUserData, void* pOriginal, size_t size, size_t alignment, VkSystemAllocationScope scope);
+	static void VKAPI_PTR freeCallback(void* pUserData, void* pMemory);
+	static void VKAPI_PTR internalAllocationCallback(void* pUserData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+	static void VKAPI_PTR internalFreeCallback(void* pUserData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+};
+
+#endif
@@ -0,0 +1,381 @@
+#include "MemoryAllocator.h"
+
+#include <cstdio>
+#include <algorithm>
+#include <stdexcept>
+
+void MemoryAllocator::init(VkPhysicalDevice physicalDevice, VkDevice device) {
+	this->physicalDevice = physicalDevice;
+	this->device = device;
+
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	nonCoherentAtomSize = std::max<VkDeviceSize>(1, properties.limits.nonCoherentAtomSize);
+	maxAllocationCount = properties.limits.maxMemoryAllocationCount;
+
+	pools.clear();
+	pools.resize(memoryProperties.memoryTypeCount * 2);
+}
+
+void MemoryAllocator::destroy() {
+	for (auto& pool : pools) {
+		for (auto& block : pool) {
+			if (!block->usedNodes.empty()) {
+				printf("memory allocator: %d allocations leaked in memory type %d\n",
+					(int)block->usedNodes.size(), (int)block->memoryType);
+			}
+			if (block->mapped != nullptr) {
+				vkUnmapMemory(device, block->memory);
+			}
+			vkFreeMemory(device, block->memory, nullptr);
+		}
+		pool.clear();
+	}
+	deviceAllocationCount = 0;
+}
+
+MemoryAllocator::Allocation MemoryAllocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, ResourceTiling tiling,
+	bool dedicated) {
+	uint32_t memoryType = findMemoryType(requirements.memoryTypeBits, properties);
+	std::vector<std::unique_ptr<Block>>& pool = pools[memoryType * 2 + tiling];
+	VkDeviceSize poolBlockSize = heapBlockSize(memoryType);
+
+	Block* block = nullptr;
+	VkDeviceSize offset = 0;
+	if (dedicated || requirements.size > poolBlockSize / 2) {
+		// a big resource would waste up to half of a buddy block, give it its own memory.
+		block = createBlock(memoryType, tiling, requirements.size, true);
+		block->usedNodes[0] = 0;
+		block->usedBytes = requirements.size;
+		block->requestedBytes = requirements.size;
+	} else {
+		for (auto& candidate : pool) {
+			if (!candidate->dedicated && candidate->allocate(requirements.size, requirements.alignment, offset)) {
+				block = candidate.get();
+				break;
+			}
+		}
+		if (block == nullptr) {
+			block = createBlock(memoryType, tiling, poolBlockSize, false);
+			if (!block->allocate(requirements.size, requirements.alignment, offset)) {
+				throw std::runtime_error("failed to sub-allocate memory!");
+			}
+		}
+	}
+
+	Allocation allocation;
+	allocation.memory = block->memory;
+	allocation.offset = offset;
+	allocation.size = requirements.size;
+	allocation.mapped = block->mapped != nullptr ? static_cast<char*>(block->mapped) + offset : nullptr;
+	allocation.memoryType = memoryType;
+	allocation.block = block;
+	return allocation;
+}
+
+void MemoryAllocator::free(Allocation& allocation) {
+	Block* block = allocation.block;
+	if (block == nullptr) return;
+
+	if (block->dedicated) {
+		destroyBlock(block);
+	} else {
+		block->requestedBytes -= allocation.size;
+		block->free(allocation.offset);
+		// keep one empty block per pool around, so allocating and freeing
+		// a resource in a loop doesn't hit vkAllocateMemory every time.
+		if (block->usedNodes.empty()) {
+			std::vector<std::unique_ptr<Block>>& pool = pools[block->memoryType * 2 + block->tiling];
+			size_t emptyBlocks = 0;
+			for (auto& candidate : pool) {
+				if (!candidate->dedicated && candidate->usedNodes.empty()) emptyBlocks++;
+			}
+			if (emptyBlocks > 1) {
+				destroyBlock(block);
+			}
+		}
+	}
+	allocation = Allocation();
+}
+
+MemoryAllocator::LinearRegion MemoryAllocator::createLinearRegion(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties) {
+	LinearRegion region;
+	createBuffer(size, usage, properties, region.buffer, region.allocation);
+	return region;
+}
+
+bool MemoryAllocator::LinearRegion::allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset) {
+	// the buffer itself starts at a node boundary, so aligning the offset
+	// in the buffer aligns the memory offset too.
+	VkDeviceSize aligned = (head + alignment - 1) / alignment * alignment;
+	if (aligned + size > allocation.size) {
+		return false;
+	}
+	offset = aligned;
+	head = aligned + size;
+	return true;
+}
+
+void MemoryAllocator::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
+	VkBuffer& buffer, Allocation& allocation) {
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = size;
+	bufferInfo.usage = usage;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	createBuffer(bufferInfo, properties, buffer, allocation);
+}
+
+void MemoryAllocator::createBuffer(const VkBufferCreateInfo& bufferInfo, VkMemoryPropertyFlags properties,
+	VkBuffer& buffer, Allocation& allocation) {
+	if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create buffer!");
+	}
+
+	VkMemoryRequirements memRequirements;
+	vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+
+	allocation = allocate(memRequirements, properties, RESOURCE_LINEAR);
+	vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset);
+}
+
+void MemoryAllocator::destroyBuffer(VkBuffer& buffer, Allocation& allocation) {
+	vkDestroyBuffer(device, buffer, nullptr);
+	buffer = VK_NULL_HANDLE;
+	free(allocation);
+}
+
+void MemoryAllocator::createImage(const VkImageCreateInfo& imageInfo, VkMemoryPropertyFlags properties,
+	VkImage& image, Allocation& allocation) {
+	createImage(imageInfo, properties, properties, image, allocation);
+}
+
+void MemoryAllocator::createImage(const VkImageCreateInfo& imageInfo, VkMemoryPropertyFlags properties,
+	VkMemoryPropertyFlags fallbackProperties, VkImage& image, Allocation& allocation) {
+	if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create image!");
+	}
+
+	VkMemoryRequirements memRequirements;
+	vkGetImageMemoryRequirements(device, image, &memRequirements);
+	if (!hasMemoryType(memRequirements.memoryTypeBits, properties)) {
+		properties = fallbackProperties;
+	}
+
+	ResourceTiling tiling = imageInfo.tiling == VK_IMAGE_TILING_OPTIMAL ? RESOURCE_OPTIMAL : RESOURCE_LINEAR;
+	// vkGetDeviceMemoryCommitment covers the whole VkDeviceMemory, in a shared block it 
+	// would report the other lazily allocated images too.
+	bool dedicated = (properties & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != 0;
+	allocation = allocate(memRequirements, properties, tiling, dedicated);
+	vkBindImageMemory(device, image, allocation.memory, allocation.offset);
+}
+
+void MemoryAllocator::destroyImage(VkImage& image, Allocation& allocation) {
+	vkDestroyImage(device, image, nullptr);
+	image = VK_NULL_HANDLE;
+	free(allocation);
+}
+
+void MemoryAllocator::flush(const Allocation& allocation) {
+	if (memoryProperties.memoryTypes[allocation.memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) return;
+
+	// the range has to be a multiple of nonCoherentAtomSize, nodes are aligned to at least that.
+	VkMappedMemoryRange range = {};
+	range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+	range.memory = allocation.memory;
+	range.offset = allocation.offset;
+	range.size = (allocation.size + nonCoherentAtomSize - 1) / nonCoherentAtomSize * nonCoherentAtomSize;
+	if (allocation.block->dedicated) range.size = VK_WHOLE_SIZE;
+	vkFlushMappedMemoryRanges(device, 1, &range);
+}
+
+void MemoryAllocator::invalidate(const Allocation& allocation) {
+	if (memoryProperties.memoryTypes[allocation.memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) return;
+
+	VkMappedMemoryRange range = {};
+	range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+	range.memory = allocation.memory;
+	range.offset = allocation.offset;
+	range.size = (allocation.size + nonCoherentAtomSize - 1) / nonCoherentAtomSize * nonCoherentAtomSize;
+	if (allocation.block->dedicated) range.size = VK_WHOLE_SIZE;
+	vkInvalidateMappedMemoryRanges(device, 1, &range);
+}
+
+// Graphics cards can offer different types of memory to allocate from,
+// find the one that suits the resource and has the properties we need.
+uint32_t MemoryAllocator::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
+	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+		if ((typeFilter & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+			return i;
+		}
+	}
+
+	throw std::runtime_error("failed to find suitable memory type!");
+}
+
+bool MemoryAllocator::hasMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const {
+	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+		if ((typeFilter & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+			return true;
+		}
+	}
+	return false;
+}
+
+std::vector<MemoryAllocator::Stats> MemoryAllocator::getStats() const {
+	std::vector<Stats> allStats;
+	for (size_t i = 0; i < pools.size(); i++) {
+		if (pools[i].empty()) continue;
+
+		Stats stats;
+		stats.memoryType = static_cast<uint32_t>(i / 2);
+		stats.tiling = static_cast<ResourceTiling>(i % 2);
+		VkDeviceSize freeBytes = 0;
+		for (const auto& block : pools[i]) {
+			stats.blockCount++;
+			stats.allocationCount += static_cast<uint32_t>(block->usedNodes.size());
+			stats.blockBytes += block->size;
+			stats.usedBytes += block->usedBytes;
+			stats.requestedBytes += block->requestedBytes;
+			freeBytes += block->size - block->usedBytes;
+			stats.largestFreeBytes = std::max(stats.largestFreeBytes, block->largestFree());
+		}
+		if (stats.usedBytes > 0) {
+			stats.internalFragmentation = double(stats.usedBytes - stats.requestedBytes) / stats.usedBytes;
+		}
+		if (freeBytes > 0) {
+			stats.externalFragmentation = 1.0 - double(stats.largestFreeBytes) / freeBytes;
+		}
+		allStats.push_back(stats);
+	}
+	return allStats;
+}
+
+void MemoryAllocator::printStats() const {
+	printf("device memory: %d vkAllocateMemory (max %d)\n", (int)deviceAllocationCount, (int)maxAllocationCount);
+	for (const Stats& stats : getStats()) {
+		printf("\ttype %d %s: %d blocks %.2f MB, %d allocations, used %.2f MB, requested %.2f MB, "
+			"largest free %.2f MB, internal frag %.1f%%, external frag %.1f%%\n",
+			(int)stats.memoryType, stats.tiling == RESOURCE_OPTIMAL ? "optimal" : "linear",
+			(int)stats.blockCount, stats.blockBytes / 1048576.0, (int)stats.allocationCount,
+			stats.usedBytes / 1048576.0, stats.requestedBytes / 1048576.0, stats.largestFreeBytes / 1048576.0,
+			stats.internalFragmentation * 100.0, stats.externalFragmentation * 100.0);
+	}
+	fflush(stdout);
+}
+
+MemoryAllocator::Block* MemoryAllocator::createBlock(uint32_t memoryType, ResourceTiling tiling, VkDeviceSize size, bool dedicated) {
+	if (maxAllocationCount > 0 && deviceAllocationCount >= maxAllocationCount) {
+		throw std::runtime_error("maxMemoryAllocationCount exceeded!");
+	}
+
+	VkMemoryAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = size;
+	allocInfo.memoryTypeIndex = memoryType;
+
+	std::unique_ptr<Block> block(new Block());
+	if (vkAllocateMemory(device, &allocInfo, nullptr, &block->memory) != VK_SUCCESS) {
+		throw std::runtime_error("failed to allocate device memory block!");
+	}
+	deviceAllocationCount++;
+
+	block->size = size;
+	block->memoryType = memoryType;
+	block->tiling = tiling;
+	block->dedicated = dedicated;
+
+	if (memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+		vkMapMemory(device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped);
+	}
+
+	if (!dedicated) {
+		// size is a power of two multiple of MIN_NODE_SIZE, see heapBlockSize().
+		while ((MIN_NODE_SIZE << block->maxOrder) < size) block->maxOrder++;
+		block->freeLists.resize(block->maxOrder + 1);
+		block->freeLists[block->maxOrder].insert(0);
+	}
+
+	Block* result = block.get();
+	pools[memoryType * 2 + tiling].push_back(std::move(block));
+	return result;
+}
+
+void MemoryAllocator::destroyBlock(Block* block) {
+	if (block->mapped != nullptr) {
+		vkUnmapMemory(device, block->memory);
+	}
+	vkFreeMemory(device, block->memory, nullptr);
+	deviceAllocationCount--;
+
+	std::vector<std::unique_ptr<Block>>& pool = pools[block->memoryType * 2 + block->tiling];
+	for (size_t i = 0; i < pool.size(); i++) {
+		if (pool[i].get() == block) {
+			pool.erase(pool.begin() + i);
+			break;
+		}
+	}
+}
+
+// the largest power of two <= blockSize, and at most 1/8 of the heap, so small heaps
+// (e.g. the 256 MB host visible device local heap) are not filled by a couple of blocks.
+VkDeviceSize MemoryAllocator::heapBlockSize(uint32_t memoryType) const {
+	VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryType].heapIndex].size;
+	VkDeviceSize limit = std::min(blockSize, heapSize / 8);
+	VkDeviceSize size = MIN_NODE_SIZE;
+	while (size * 2 <= limit) size *= 2;
+	return size;
+}
+
+bool MemoryAllocator::Block::allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset) {
+	VkDeviceSize nodeSize = std::max(size, alignment);
+	uint32_t order = 0;
+	while ((MIN_NODE_SIZE << order) < nodeSize) order++;
+	if (order > maxOrder) return false;
+
+	// the smallest free node that fits, split it in halves until it has the right size.
+	uint32_t k = order;
+	while (k <= maxOrder && freeLists[k].empty()) k++;
+	if (k > maxOrder) return false;
+
+	offset = *freeLists[k].begin();
+	freeLists[k].erase(freeLists[k].begin());
+	while (k > order) {
+		k--;
+		freeLists[k].insert(offset + (MIN_NODE_SIZE << k)); // the upper half stays free.
+	}
+
+	usedNodes[offset] = order;
+	usedBytes += MIN_NODE_SIZE << order;
+	requestedBytes += size;
+	return true;
+}
+
+void MemoryAllocator::Block::free(VkDeviceSize offset) {
+	auto it = usedNodes.find(offset);
+	if (it == usedNodes.end()) {
+		throw std::runtime_error("freeing memory that was not allocated!");
+	}
+	uint32_t order = it->second;
+	usedNodes.erase(it);
+	usedBytes -= MIN_NODE_SIZE << order;
+
+	// merge with the buddy as long as it is free too.
+	while (order < maxOrder) {
+		VkDeviceSize buddy = offset ^ (MIN_NODE_SIZE << order);
+		if (freeLists[order].erase(buddy) == 0) break;
+		offset = std::min(offset, buddy);
+		order++;
+	}
+	freeLists[order].insert(offset);
+}
+
+VkDeviceSize MemoryAllocator::Block::largestFree() const {
+	if (dedicated) return 0;
+	for (uint32_t k = maxOrder + 1; k-- > 0;) {
+		if (!freeLists[k].empty()) return MIN_NODE_SIZE << k;
+	}
+	return 0;
+}
@@ -0,0 +1,156 @@
+#ifndef __MEMORYALLOCATOR_H__
+#define __MEMORYALLOCATOR_H__
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <set>
+#include <map>
+#include <memory>
+#include <cstdint>
+
+// Sub-allocates buffers and images from a few big VkDeviceMemory blocks.
+// vkAllocateMemory is slow and maxMemoryAllocationCount can be as low as 4096,
+// so one allocation per resource does not scale past a toy scene.
+//
+// - blocks are per memory type, and additionally split into linear (buffers,
+//   linear images) and optimal (optimal tiling images) pools. Linear and optimal
+//   resources never share a block, so bufferImageGranularity can never be violated.
+// - inside a block a buddy allocator hands out power of two nodes. A node is
+//   always aligned to its own size, which covers any alignment up to the node size.
+// - resources bigger than half a block get a dedicated VkDeviceMemory.
+// - host visible blocks are mapped once when created and stay mapped (a memory
+//   object can only be mapped once at a time, so never call vkMapMemory on them).
+// - LinearRegion: a node used as a bump allocator, for data that is thrown away
+//   all at once (per-frame uploads, staging), reset() frees everything.
+//   It comes with a buffer covering the whole node.
+class MemoryAllocator {
+public:
+	enum ResourceTiling {
+		RESOURCE_LINEAR,	// buffers and VK_IMAGE_TILING_LINEAR images
+		RESOURCE_OPTIMAL	// VK_IMAGE_TILING_OPTIMAL images
+	};
+
+	struct Block;
+
+	struct Allocation {
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;		// requested size
+		void* mapped = nullptr;		// points at offset, nullptr if not host visible
+		uint32_t memoryType = 0;
+		Block* block = nullptr;		// owner, nullptr once freed
+	};
+
+	// bump allocator on top of one buffer.
+	struct LinearRegion {
+		VkBuffer buffer = VK_NULL_HANDLE;
+		Allocation allocation;
+		VkDeviceSize head = 0;
+
+		// returns false if the region is full. offset is relative to buffer,
+		// the data is at (char*)allocation.mapped + offset if host visible.
+		bool allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset);
+		void reset() { head = 0; }
+	};
+
+	struct Stats {
+		uint32_t memoryType = 0;
+		ResourceTiling tiling = RESOURCE_LINEAR;
+		uint32_t blockCount = 0;
+		uint32_t allocationCount = 0;
+		VkDeviceSize blockBytes = 0;	// allocated from the device
+		VkDeviceSize usedBytes = 0;		// handed out in buddy nodes
+		VkDeviceSize requestedBytes = 0;	// what the resources asked for
+		VkDeviceSize largestFreeBytes = 0;
+		// (used - requested) / used: lost to rounding up to power of two nodes.
+		double internalFragmentation = 0.0;
+		// 1 - largest free / total free: how badly the free space is scattered.
+		double externalFragmentation = 0.0;
+	};
+
+	// size of a new block, smaller on small heaps (1/8 of the heap).
+	VkDeviceSize blockSize = 64 * 1024 * 1024;
+
+	void init(VkPhysicalDevice physicalDevice, VkDevice device);
+	void destroy();
+
+	// dedicated: a VkDeviceMemory of its own instead of a buddy node, e.g. so that 
+	// vkGetDeviceMemoryCommitment reports this resource alone.
+	Allocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, ResourceTiling tiling,
+		bool dedicated = false);
+	void free(Allocation& allocation);
+
+	LinearRegion createLinearRegion(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties);
+	void destroyLinearRegion(LinearRegion& region) { destroyBuffer(region.buffer, region.allocation); }
+
+	// create the resource, allocate and bind its memory.
+	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
+		VkBuffer& buffer, Allocation& allocation);
+	// e.g. for VK_SHARING_MODE_CONCURRENT buffers.
+	void createBuffer(const VkBufferCreateInfo& bufferInfo, VkMemoryPropertyFlags properties,
+		VkBuffer& buffer, Allocation& allocation);
+	void destroyBuffer(VkBuffer& buffer, Allocation& allocation);
+	void createImage(const VkImageCreateInfo& imageInfo, VkMemoryPropertyFlags properties,
+		VkImage& image, Allocation& allocation);
+	// properties if the image can live in such a memory type, fallbackProperties otherwise.
+	// e.g. LAZILY_ALLOCATED for transient attachments, only tiled GPUs tend to have it.
+	// Those get dedicated memory, the commitment is only known per VkDeviceMemory.
+	void createImage(const VkImageCreateInfo& imageInfo, VkMemoryPropertyFlags properties,
+		VkMemoryPropertyFlags fallbackProperties, VkImage& image, Allocation& allocation);
+	void destroyImage(VkImage& image, Allocation& allocation);
+
+	// needed for memory without VK_MEMORY_PROPERTY_HOST_COHERENT_BIT.
+	void flush(const Allocation& allocation);
+	void invalidate(const Allocation& allocation);
+
+	uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+	bool hasMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const;
+	VkMemoryPropertyFlags getMemoryProperties(const Allocation& allocation) const {
+		return memoryProperties.memoryTypes[allocation.memoryType].propertyFlags;
+	}
+	std::vector<Stats> getStats() const;
+	void printStats() const;
+
+	// a buddy node or dedicated allocation, see allocate().
+	struct Block {
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize size = 0;
+		void* mapped = nullptr;
+		uint32_t memoryType = 0;
+		ResourceTiling tiling = RESOURCE_LINEAR;
+		bool dedicated = false;
+		uint32_t maxOrder = 0;
+		// free node offsets per order, a node of order k is MIN_NODE_SIZE << k bytes.
+		std::vector<std::set<VkDeviceSize>> freeLists;
+		// offset -> order of the nodes in use.
+		std::map<VkDeviceSize, uint32_t> usedNodes;
+		VkDeviceSize usedBytes = 0;
+		VkDeviceSize requestedBytes = 0;
+
+		bool allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset);
+		void free(VkDeviceSize offset);
+		VkDeviceSize largestFree() const;
+	};
+
+private:
+	// also the smallest alignment handed out, >= any nonCoherentAtomSize (spec max 256).
+	static const VkDeviceSize MIN_NODE_SIZE = 256;
+
+	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+	VkDevice device = VK_NULL_HANDLE;
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	VkDeviceSize nonCoherentAtomSize = 1;
+	uint32_t maxAllocationCount = 0;
+	uint32_t deviceAllocationCount = 0;
+
+	// index: memoryType * 2 + tiling
+	std::vector<std::vector<std::unique_ptr<Block>>> pools;
+
+	Block* createBlock(uint32_t memoryType, ResourceTiling tiling, VkDeviceSize size, bool dedicated);
+	void destroyBlock(Block* block);
+	VkDeviceSize heapBlockSize(uint32_t memoryType) const;
+};
+
+#endif
@@ -0,0 +1,549 @@
+#include "PipelineLibrary.h"
+
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+
+// FNV-1a, the descs are small and hashed once per lookup.
+static const uint64_t FNV_OFFSET = 14695981039346656037ull;
+static const uint64_t FNV_PRIME = 1099511628211ull;
+
+static void hashBytes(uint64_t& hash, const void* data, size_t size) {
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+}
+
+template <typename T>
+static void hashValue(uint64_t& hash, const T& value) {
+	hashBytes(hash, &value, sizeof(value));
+}
+
+void PipelineDesc::setSpecConstant(VkShaderStageFlagBits stage, uint32_t constantID, uint32_t value) {
+	auto it = specConstants.begin();
+	while (it != specConstants.end() && (it->stage < stage || (it->stage == stage && it->constantID < constantID))) {
+		++it;
+	}
+	if (it != specConstants.end() && it->stage == stage && it->constantID == constantID) {
+		it->value = value;
+	} else {
+		specConstants.insert(it, { stage, constantID, value });
+	}
+}
+
+bool PipelineDesc::operator==(const PipelineDesc& other) const {
+	if (vertexBindings.size() != other.vertexBindings.size() ||
+		vertexAttributes.size() != other.vertexAttributes.size() ||
+		specConstants.size() != other.specConstants.size()) {
+		return false;
+	}
+	for (size_t i = 0; i < specConstants.size(); i++) {
+		const SpecConstant& a = specConstants[i];
+		const SpecConstant& b = other.specConstants[i];
+		if (a.stage != b.stage || a.constantID != b.constantID || a.value != b.value) return false;
+	}
+	for (size_t i = 0; i < vertexBindings.size(); i++) {
+		const VkVertexInputBindingDescription& a = vertexBindings[i];
+		const VkVertexInputBindingDescription& b = other.vertexBindings[i];
+		if (a.binding != b.binding || a.stride != b.stride || a.inputRate != b.inputRate) return false;
+	}
+	for (size_t i = 0; i < vertexAttributes.size(); i++) {
+		const VkVertexInputAttributeDescription& a = vertexAttributes[i];
+		const VkVertexInputAttributeDescription& b = other.vertexAttributes[i];
+		if (a.location != b.location || a.binding != b.binding || a.format != b.format || a.offset != b.offset) return false;
+	}
+	// renderPass is not compared, see the declaration.
+	return vertShader == other.vertShader && fragShader == other.fragShader &&
+		topology == other.topology && polygonMode == other.polygonMode &&
+		cullMode == other.cullMode && frontFace == other.frontFace && samples == other.samples &&
+		blendEnable == other.blendEnable && srcColorBlendFactor == other.srcColorBlendFactor &&
+		dstColorBlendFactor == other.dstColorBlendFactor && colorWriteMask == other.colorWriteMask &&
+		depthTestEnable == other.depthTestEnable && depthWriteEnable == other.depthWriteEnable &&
+		depthCompareOp == other.depthCompareOp && layout == other.layout && colorFormat == other.colorFormat &&
+		depthFormat == other.depthFormat && subpass == other.subpass;
+}
+
+size_t PipelineDesc::hash() const {
+	uint64_t hash = FNV_OFFSET;
+	hashValue(hash, vertShader);
+	hashValue(hash, fragShader);
+	for (const auto& specConstant : specConstants) {
+		hashValue(hash, specConstant.stage);
+		hashValue(hash, specConstant.constantID);
+		hashValue(hash, specConstant.value);
+	}
+	for (const auto& binding : vertexBindings) {
+		hashValue(hash, binding.binding);
+		hashValue(hash, binding.stride);
+		hashValue(hash, binding.inputRate);
+	}
+	for (const auto& attribute : vertexAttributes) {
+		hashValue(hash, attribute.location);
+		hashValue(hash, attribute.binding);
+		hashValue(hash, attribute.format);
+		hashValue(hash, attribute.offset);
+	}
+	hashValue(hash, topology);
+	hashValue(hash, polygonMode);
+	hashValue(hash, cullMode);
+	hashValue(hash, frontFace);
+	hashValue(hash, samples);
+	hashValue(hash, blendEnable);
+	hashValue(hash, srcColorBlendFactor);
+	hashValue(hash, dstColorBlendFactor);
+	hashValue(hash, colorWriteMask);
+	hashValue(hash, depthTestEnable);
+	hashValue(hash, depthWriteEnable);
+	hashValue(hash, depthCompareOp);
+	hashValue(hash, layout);
+	hashValue(hash, colorFormat);
+	hashValue(hash, depthFormat);
+	hashValue(hash, subpass);
+	return static_cast<size_t>(hash);
+}
+
+void PipelineLibrary::init(VkDevice device, VkPipelineCache pipelineCache) {
+	this->device = device;
+	this->pipelineCache = pipelineCache;
+	quit = false;
+	compileThread = std::thread(&PipelineLibrary::compileThreadMain, this);
+}
+
+void PipelineLibrary::destroy() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	queueCondition.notify_all();
+	if (compileThread.joinable()) {
+		compileThread.join();
+	}
+
+	for (auto& pipeline : pipelines) {
+		vkDestroyPipeline(device, pipeline.second.pipeline, nullptr);
+	}
+	pipelines.clear();
+	for (auto& shader : shaders) {
+		vkDestroyShaderModule(device, shader.second.module, nullptr);
+	}
+	shaders.clear();
+	queue.clear();
+}
+
+uint64_t PipelineLibrary::registerShader(const uint32_t* code, size_t codeSize) {
+	uint64_t id = FNV_OFFSET;
+	hashBytes(id, code, codeSize);
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (shaders.count(id) != 0) {
+			return id;
+		}
+	}
+
+	// before creating anything, a module that can't be reflected is not used.
+	Shader shader;
+	shader.reflection = SpirvReflect::reflect(code, codeSize);
+
+	VkShaderModuleCreateInfo createInfo = {};
+	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	createInfo.codeSize = codeSize;
+	createInfo.pCode = code;
+
+	if (vkCreateShaderModule(device, &createInfo, nullptr, &shader.module) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create shader module!");
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!shaders.emplace(id, shader).second) {
+		// registered by another thread meanwhile.
+		vkDestroyShaderModule(device, shader.module, nullptr);
+	}
+	return id;
+}
+
+ShaderReflection PipelineLibrary::getReflection(uint64_t shaderId) {
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = shaders.find(shaderId);
+	if (it == shaders.end()) {
+		throw std::runtime_error("shader is not registered!");
+	}
+	return it->second.reflection;
+}
+
+VkPipeline PipelineLibrary::get(const PipelineDesc& desc) {
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		auto it = pipelines.find(desc);
+		if (it == pipelines.end()) {
+			// claim it, so a getOrQueue() meanwhile doesn't compile it a second time.
+			pipelines[desc] = Entry();
+		} else {
+			if (!it->second.ready) {
+				// queued or being compiled on the background thread.
+				readyCondition.wait(lock, [this, &desc] { return pipelines[desc].ready; });
+			}
+			const Entry& entry = pipelines[desc];
+			if (entry.failed) {
+				throw std::runtime_error("failed to create graphics pipeline!");
+			}
+			hits++;
+			return entry.pipeline;
+		}
+	}
+
+	auto startTime = std::chrono::steady_clock::now();
+	VkPipeline pipeline = compile(desc);
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+	finish(desc, pipeline, ms, false);
+	if (pipeline == VK_NULL_HANDLE) {
+		throw std::runtime_error("failed to create graphics pipeline!");
+	}
+	return pipeline;
+}
+
+VkPipeline PipelineLibrary::getOrQueue(const PipelineDesc& desc, VkPipeline fallback) {
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = pipelines.find(desc);
+	if (it != pipelines.end()) {
+		if (it->second.ready && !it->second.failed) {
+			hits++;
+			return it->second.pipeline;
+		}
+		fallbacks++;
+		return fallback;
+	}
+
+	pipelines[desc] = Entry();
+	queue.push_back(desc);
+	queueCondition.notify_one();
+	fallbacks++;
+	return fallback;
+}
+
+void PipelineLibrary::waitIdle() {
+	std::unique_lock<std::mutex> lock(mutex);
+	readyCondition.wait(lock, [this] { return queue.empty() && !compiling; });
+}
+
+VkPipeline PipelineLibrary::remove(const PipelineDesc& desc) {
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = pipelines.find(desc);
+	if (it == pipelines.end() || !it->second.ready) {
+		return VK_NULL_HANDLE;
+	}
+	VkPipeline pipeline = it->second.pipeline;
+	pipelines.erase(it);
+	return pipeline;
+}
+
+void PipelineLibrary::printStats() {
+	std::lock_guard<std::mutex> lock(mutex);
+	printf("pipelines: %d compiled (%.2f ms total), %llu hits, %llu fallbacks\n",
+		(int)compiles, compileMs, (unsigned long long)hits, (unsigned long long)fallbacks);
+}
+
+void PipelineLibrary::compileThreadMain() {
+	for (;;) {
+		PipelineDesc desc;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			queueCondition.wait(lock, [this] { return quit || !queue.empty(); });
+			if (quit) return;
+			desc = queue.front();
+			queue.pop_front();
+			compiling = true;
+		}
+
+		auto startTime = std::chrono::steady_clock::now();
+		VkPipeline pipeline = compile(desc);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+		if (pipeline == VK_NULL_HANDLE) {
+			fprintf(stderr, "failed to create graphics pipeline in the background!\n");
+		}
+
+		finish(desc, pipeline, ms, true);
+	}
+}
+
+void PipelineLibrary::finish(const PipelineDesc& desc, VkPipeline pipeline, double ms, bool background) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (background) compiling = false;
+		Entry& entry = pipelines[desc];
+		entry.pipeline = pipeline;
+		entry.ready = true;
+		entry.failed = pipeline == VK_NULL_HANDLE;
+		if (!entry.failed) {
+			compiles++;
+			compileMs += ms;
+		}
+	}
+	readyCondition.notify_all();
+}
+
+// the shader stage has to declare every constant of desc, as 32 bit.
+bool PipelineLibrary::checkSpecConstants(const PipelineDesc& desc) {
+	std::lock_guard<std::mutex> lock(mutex);
+	for (const PipelineDesc::SpecConstant& specConstant : desc.specConstants) {
+		uint64_t shaderId = specConstant.stage == VK_SHADER_STAGE_VERTEX_BIT ? desc.vertShader : desc.fragShader;
+		auto shader = shaders.find(shaderId);
+		if (shader == shaders.end()) return false;
+
+		bool found = false;
+		for (const ShaderReflection::SpecConstant& declared : shader->second.reflection.specConstants) {
+			if (declared.constantID == specConstant.constantID && declared.size == sizeof(uint32_t)) found = true;
+		}
+		if (!found) {
+			fprintf(stderr, "pipeline library: the shader has no 32 bit specialization constant %d\n", (int)specConstant.constantID);
+			return false;
+		}
+	}
+	return true;
+}
+
+// the values of the constants of one stage, tightly packed: constant i is at offset i * 4.
+static const VkSpecializationInfo* getSpecializationInfo(const PipelineDesc& desc, VkShaderStageFlagBits stage,
+	std::vector<VkSpecializationMapEntry>& entries, std::vector<uint32_t>& data, VkSpecializationInfo& info) {
+	for (const PipelineDesc::SpecConstant& specConstant : desc.specConstants) {
+		if (specConstant.stage != stage) continue;
+		VkSpecializationMapEntry entry = {};
+		entry.constantID = specConstant.constantID;
+		entry.offset = static_cast<uint32_t>(data.size() * sizeof(uint32_t));
+		entry.size = sizeof(uint32_t);
+		entries.push_back(entry);
+		data.push_back(specConstant.value);
+	}
+	if (entries.empty()) return nullptr;
+
+	info.mapEntryCount = static_cast<uint32_t>(entries.size());
+	info.pMapEntries = entries.data();
+	info.dataSize = data.size() * sizeof(uint32_t);
+	info.pData = data.data();
+	return &info;
+}
+
+VkPipeline PipelineLibrary::compile(const PipelineDesc& desc) {
+	if (!checkSpecConstants(desc)) {
+		return VK_NULL_HANDLE;
+	}
+
+	VkShaderModule vertShaderModule;
+	VkShaderModule fragShaderModule;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto vert = shaders.find(desc.vertShader);
+		auto frag = shaders.find(desc.fragShader);
+		if (vert == shaders.end() || frag == shaders.end()) {
+			return VK_NULL_HANDLE;
+		}
+		vertShaderModule = vert->second.module;
+		fragShaderModule = frag->second.module;
+	}
+
+	VkPipelineShaderStageCreateInfo vertShaderStageInfo = {};
+	vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+	vertShaderStageInfo.module = vertShaderModule;
+	// That means that it's possible to combine multiple fragment shaders into 
+	// a single shader module and use different entry points to differentiate 
+	// between their behaviors. Here use the main.
+	vertShaderStageInfo.pName = "main";
+	// It allows you to specify values for shader constants. 
+	// You can use a single shader module where its behavior can be configured 
+	// at pipeline creation by specifying different values for the constants used in it. 
+	// This is more efficient than configuring the shader using variables at render time, 
+	// because the compiler can do optimizations like eliminating if statements that 
+	// depend on these values.
+	std::vector<VkSpecializationMapEntry> vertEntries;
+	std::vector<uint32_t> vertData;
+	VkSpecializationInfo vertSpecialization = {};
+	vertShaderStageInfo.pSpecializationInfo = getSpecializationInfo(desc, VK_SHADER_STAGE_VERTEX_BIT, vertEntries, vertData, vertSpecialization);
+
+	VkPipelineShaderStageCreateInfo fragShaderStageInfo = {};
+	fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	fragShaderStageInfo.module = fragShaderModule;
+	fragShaderStageInfo.pName = "main";
+	std::vector<VkSpecializationMapEntry> fragEntries;
+	std::vector<uint32_t> fragData;
+	VkSpecializationInfo fragSpecialization = {};
+	fragShaderStageInfo.pSpecializationInfo = getSpecializationInfo(desc, VK_SHADER_STAGE_FRAGMENT_BIT, fragEntries, fragData, fragSpecialization);
+
+	VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
+
+	// Vertex input
+	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
+	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(desc.vertexBindings.size());
+	vertexInputInfo.pVertexBindingDescriptions = desc.vertexBindings.data();
+	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(desc.vertexAttributes.size());
+	vertexInputInfo.pVertexAttributeDescriptions = desc.vertexAttributes.data();
+
+	// Input assembly
+	// 1, what kind of geometry will be drawn from the vertices and 
+	//		VK_PRIMITIVE_TOPOLOGY_POINT_LIST: points from vertices
+	//		VK_PRIMITIVE_TOPOLOGY_LINE_LIST: line from every 2 vertices without reuse
+	//		VK_PRIMITIVE_TOPOLOGY_LINE_STRIP : the end vertex of every line is used as start vertex for the next line
+	//		VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST : triangle from every 3 vertices without reuse
+	//		VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP : the second and third vertex of every triangle are 
+	//												used as first two vertices of the next triangle
+	// 2, if primitive restart should be enabled
+	// Normally, the vertices are loaded from the vertex buffer by index in sequential order, 
+	// but with an element buffer you can specify the indices to use yourself.
+	// If you set the primitiveRestartEnable member to VK_TRUE, then it's possible to break up 
+	// lines and triangles in the _STRIP topology modes by using a special index of 0xFFFF or 0xFFFFFFFF.
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
+	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssembly.topology = desc.topology;
+	inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+	// Viewports and scissors
+	// they are dynamic states (see below) and set in the command buffer with the 
+	// current swap chain extent, so the pipeline doesn't depend on the window size.
+	// only the count is needed here.
+	VkPipelineViewportStateCreateInfo viewportState = {};
+	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportState.viewportCount = 1;
+	viewportState.pViewports = nullptr; // dynamic
+	viewportState.scissorCount = 1;
+	viewportState.pScissors = nullptr; // dynamic
+
+	// Rasterizer
+	VkPipelineRasterizationStateCreateInfo rasterizer = {};
+	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	// If depthClampEnable is set to VK_TRUE, then fragments that are beyond the near 
+	// and far planes are clamped to them as opposed to discarding them. 
+	// This is useful in some special cases like shadow maps.
+	rasterizer.depthClampEnable = VK_FALSE;
+	// If rasterizerDiscardEnable is set to VK_TRUE, then geometry never passes through 
+	// the rasterizer stage. This basically disables any output to the framebuffer.
+	rasterizer.rasterizerDiscardEnable = VK_FALSE;
+	// The polygonMode determines how fragments are generated for geometry.
+	//		VK_POLYGON_MODE_FILL: fill the area of the polygon with fragments
+	//		VK_POLYGON_MODE_LINE: polygon edges are drawn as lines
+	//		VK_POLYGON_MODE_POINT : polygon vertices are drawn as points
+	// Using any mode other than fill requires enabling a GPU feature.
+	rasterizer.polygonMode = desc.polygonMode;
+	// any line thicker than 1.0f requires you to enable the wideLines GPU feature.
+	rasterizer.lineWidth = 1.0f;
+	rasterizer.cullMode = desc.cullMode;
+	rasterizer.frontFace = desc.frontFace;
+	// This is sometimes used for shadow mapping
+	rasterizer.depthBiasEnable = VK_FALSE;
+	rasterizer.depthBiasConstantFactor = 0.0f; // Optional
+	rasterizer.depthBiasClamp = 0.0f; // Optional
+	rasterizer.depthBiasSlopeFactor = 0.0f; // Optional
+
+	// Multisampling
+	VkPipelineMultisampleStateCreateInfo multisampling = {};
+	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisampling.sampleShadingEnable = VK_FALSE;
+	multisampling.rasterizationSamples = desc.samples;
+	multisampling.minSampleShading = 1.0f; // Optional
+	multisampling.pSampleMask = nullptr; // Optional
+	multisampling.alphaToCoverageEnable = VK_FALSE; // Optional
+	multisampling.alphaToOneEnable = VK_FALSE; // Optional
+
+	// Depth and stencil testing
+	// ignored by the subpass without a depth attachment, no stencil.
+	VkPipelineDepthStencilStateCreateInfo depthStencil = {};
+	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthStencil.depthTestEnable = desc.depthTestEnable ? VK_TRUE : VK_FALSE;
+	depthStencil.depthWriteEnable = desc.depthWriteEnable ? VK_TRUE : VK_FALSE;
+	depthStencil.depthCompareOp = desc.depthCompareOp;
+	depthStencil.depthBoundsTestEnable = VK_FALSE;
+	depthStencil.stencilTestEnable = VK_FALSE;
+
+	// Color blending, two steps
+	//		1, Mix the old and new value to produce a final color
+	//		2, Combine the old and new value using a bitwise operation
+	// 1,
+	VkPipelineColorBlendAttachmentState colorBlendAttachment = {}; // configuration per attached framebuffer
+	colorBlendAttachment.colorWriteMask = desc.colorWriteMask;
+	colorBlendAttachment.blendEnable = desc.blendEnable ? VK_TRUE : VK_FALSE;
+	colorBlendAttachment.srcColorBlendFactor = desc.srcColorBlendFactor;
+	colorBlendAttachment.dstColorBlendFactor = desc.dstColorBlendFactor;
+	colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD; // Optional
+	colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE; // Optional
+	colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO; // Optional
+	colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD; // Optional
+	// pseudocode:
+	// if (blendEnable) {
+	//		finalColor.rgb = (srcColorBlendFactor * newColor.rgb) <colorBlendOp> (dstColorBlendFactor * oldColor.rgb);
+	//		finalColor.a = (srcAlphaBlendFactor * newColor.a) <alphaBlendOp> (dstAlphaBlendFactor * oldColor.a);
+	// } else {
+	//		finalColor = newColor;
+	// }
+	//
+	// finalColor = finalColor & colorWriteMask;
+	// 
+	// most common way:
+	// finalColor.rgb = newAlpha * newColor + (1 - newAlpha) * oldColor;
+	// finalColor.a = newAlpha.a;
+	// code:
+	// colorBlendAttachment.blendEnable = VK_TRUE;
+	// colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+	// colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	// colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+	// colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	// colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+	// colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+	// 2, 
+	VkPipelineColorBlendStateCreateInfo colorBlending = {};
+	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlending.logicOpEnable = VK_FALSE;
+	colorBlending.logicOp = VK_LOGIC_OP_COPY; // Optional
+	colorBlending.attachmentCount = 1;
+	colorBlending.pAttachments = &colorBlendAttachment;
+	colorBlending.blendConstants[0] = 0.0f; // Optional
+	colorBlending.blendConstants[1] = 0.0f; // Optional
+	colorBlending.blendConstants[2] = 0.0f; // Optional
+	colorBlending.blendConstants[3] = 0.0f; // Optional
+
+	// Dynamic state
+	// A limited amount of the state that we've specified in the previous structs can actually be changed without recreating the pipeline.
+	// viewport and scissor are dynamic, so a window resize doesn't need a new pipeline.
+	VkDynamicState dynamicStates[] = {
+		VK_DYNAMIC_STATE_VIEWPORT,
+		VK_DYNAMIC_STATE_SCISSOR
+	};
+
+	VkPipelineDynamicStateCreateInfo dynamicState = {};
+	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.dynamicStateCount = 2;
+	dynamicState.pDynamicStates = dynamicStates;
+
+	// final gfx pipeline.
+	VkGraphicsPipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineInfo.stageCount = 2;
+	pipelineInfo.pStages = shaderStages;
+	pipelineInfo.pVertexInputState = &vertexInputInfo;
+	pipelineInfo.pInputAssemblyState = &inputAssembly;
+	pipelineInfo.pViewportState = &viewportState;
+	pipelineInfo.pRasterizationState = &rasterizer;
+	pipelineInfo.pMultisampleState = &multisampling;
+	pipelineInfo.pDepthStencilState = desc.depthFormat != VK_FORMAT_UNDEFINED ? &depthStencil : nullptr;
+	pipelineInfo.pColorBlendState = &colorBlending;
+	pipelineInfo.pDynamicState = &dynamicState;
+	pipelineInfo.layout = desc.layout;
+	pipelineInfo.renderPass = desc.renderPass;
+	pipelineInfo.subpass = desc.subpass;
+	// Vulkan allows you to create a new graphics pipeline by deriving from an existing pipeline.
+	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
+	pipelineInfo.basePipelineIndex = -1; // Optional
+
+	// can take multiple VkGraphicsPipelineCreateInfo objects and create multiple VkPipeline objects in a single call.
+	// pipelineCache: A pipeline cache can be used to store and reuse data relevant to pipeline creation across multiple calls to 
+	// vkCreateGraphicsPipelines and even across program executions if the cache is stored to a file. 
+	// A VkPipelineCache is internally synchronized, the background thread can use it at the same time.
+	VkPipeline pipeline;
+	if (vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+		return VK_NULL_HANDLE;
+	}
+	return pipeline;
+}
@@ -0,0 +1,145 @@
+#ifndef __PIPELINELIBRARY_H__
+#define __PIPELINELIBRARY_H__
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include "SpirvReflect.h"
+
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+// Everything a graphics pipeline is built from, as a value type: two equal
+// descs always give the same VkPipeline. Viewport and scissor are always dynamic.
+struct PipelineDesc {
+	// ids from PipelineLibrary::registerShader, entry point "main".
+	uint64_t vertShader = 0;
+	uint64_t fragShader = 0;
+
+	// Specialization constants: one module compiled with different values gives another 
+	// pipeline, and the driver optimizes for the values (e.g. drops the branches on them).
+	// All 32 bit (int, uint, float bits or VkBool32), missing ones keep the shader's default.
+	struct SpecConstant {
+		VkShaderStageFlagBits stage;
+		uint32_t constantID;
+		uint32_t value;
+	};
+	// sorted by stage and id, so equal values give equal descs. Use setSpecConstant.
+	std::vector<SpecConstant> specConstants;
+	void setSpecConstant(VkShaderStageFlagBits stage, uint32_t constantID, uint32_t value);
+
+	std::vector<VkVertexInputBindingDescription> vertexBindings;
+	std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+	VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+	VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+	VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+	VkFrontFace frontFace = VK_FRONT_FACE_CLOCKWISE;
+	VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+
+	// one color attachment.
+	bool blendEnable = false;
+	VkBlendFactor srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+	VkBlendFactor dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+	VkColorComponentFlags colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+	// only used with a depthFormat.
+	bool depthTestEnable = false;
+	bool depthWriteEnable = false;
+	VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+
+	// A pipeline can be used with every render pass compatible with the one it was created
+	// with, which is (for a single subpass) the same attachment formats and sample counts.
+	// So only the formats and subpass are part of the key (samples is above), renderPass is 
+	// just the one to create with, and may be any compatible render pass.
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+	VkFormat colorFormat = VK_FORMAT_UNDEFINED;
+	// VK_FORMAT_UNDEFINED: the subpass has no depth attachment.
+	VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+	uint32_t subpass = 0;
+
+	bool operator==(const PipelineDesc& other) const;
+	size_t hash() const;
+};
+
+// In-memory map PipelineDesc -> VkPipeline, on top of the VkPipelineCache.
+// The VkPipelineCache only makes a compile cheaper, every vkCreateGraphicsPipelines
+// still creates a new pipeline; here the same desc always returns the same pipeline.
+//
+// Pipelines missing at draw time don't have to stall the frame: getOrQueue() hands
+// the desc to a background thread and returns a fallback pipeline meanwhile, the
+// real one is returned from the first call after the compile finished.
+//
+// All the functions are thread safe (used by the record threads too).
+// The pipelines and shader modules are owned by the library.
+class PipelineLibrary {
+public:
+	void init(VkDevice device, VkPipelineCache pipelineCache);
+	// waits for the background compiles, the pipelines must not be in use by the GPU.
+	void destroy();
+
+	// creates the shader module once, the id is a hash of the code. codeSize in bytes.
+	// The code is also reflected once, throws if it can't be parsed.
+	uint64_t registerShader(const uint32_t* code, size_t codeSize);
+	ShaderReflection getReflection(uint64_t shaderId);
+
+	// compiles on the calling thread if needed (or waits for a background compile of the same desc).
+	VkPipeline get(const PipelineDesc& desc);
+	// never blocks: fallback until the background compile is done.
+	VkPipeline getOrQueue(const PipelineDesc& desc, VkPipeline fallback);
+	// all the queued compiles are finished, e.g. before destroying a render pass they use.
+	void waitIdle();
+	// take the pipeline of desc out of the library, the caller destroys it once the GPU is done with it.
+	// VK_NULL_HANDLE if there is none, or it is still being compiled (then it stays in the library).
+	VkPipeline remove(const PipelineDesc& desc);
+
+	void printStats();
+
+private:
+	struct DescHash {
+		size_t operator()(const PipelineDesc& desc) const { return desc.hash(); }
+	};
+	struct Shader {
+		VkShaderModule module = VK_NULL_HANDLE;
+		ShaderReflection reflection;
+	};
+	struct Entry {
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		bool ready = false;		// pipeline is valid, or the compile failed
+		bool failed = false;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+
+	std::mutex mutex;
+	std::condition_variable readyCondition;	// an entry became ready
+	std::condition_variable queueCondition;	// queue not empty, or quit
+	std::unordered_map<PipelineDesc, Entry, DescHash> pipelines;
+	std::unordered_map<uint64_t, Shader> shaders;
+	std::deque<PipelineDesc> queue;
+	bool compiling = false;
+	bool quit = false;
+	std::thread compileThread;
+
+	// stats
+	uint64_t hits = 0;
+	uint64_t fallbacks = 0;
+	uint32_t compiles = 0;
+	double compileMs = 0.0;
+
+	// called without the lock held.
+	VkPipeline compile(const PipelineDesc& desc);
+	bool checkSpecConstants(const PipelineDesc& desc);
+	void compileThreadMain();
+	void finish(const PipelineDesc& desc, VkPipeline pipeline, double ms, bool background);
+};
+
+#endif
@@ -0,0 +1,139 @@
+#include "RecordThreadPool.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+void RecordThreadPool::init(VkDevice device, uint32_t queueFamilyIndex, uint32_t threadCount, uint32_t framesInFlight) {
+	this->device = device;
+	if (threadCount == 0) {
+		threadCount = std::thread::hardware_concurrency();
+		if (threadCount == 0) threadCount = 4; // not computable
+	}
+	printf("record threads = %d\n", (int)threadCount);
+
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.queueFamilyIndex = queueFamilyIndex;
+	// re-recorded every frame, and only ever reset as a whole.
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+	for (uint32_t i = 0; i < threadCount; i++) {
+		std::unique_ptr<Worker> worker(new Worker());
+		worker->pools.resize(framesInFlight);
+		worker->commandBuffers.resize(framesInFlight);
+		for (uint32_t frame = 0; frame < framesInFlight; frame++) {
+			if (vkCreateCommandPool(device, &poolInfo, nullptr, &worker->pools[frame]) != VK_SUCCESS) {
+				throw std::runtime_error("failed to create record thread command pool!");
+			}
+
+			VkCommandBufferAllocateInfo allocInfo = {};
+			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.commandPool = worker->pools[frame];
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+			allocInfo.commandBufferCount = 1;
+			if (vkAllocateCommandBuffers(device, &allocInfo, &worker->commandBuffers[frame]) != VK_SUCCESS) {
+				throw std::runtime_error("failed to allocate secondary command buffer!");
+			}
+		}
+		workers.push_back(std::move(worker));
+	}
+
+	// start the threads after all the pools exist.
+	for (uint32_t i = 0; i < threadCount; i++) {
+		workers[i]->thread = std::thread(&RecordThreadPool::workerMain, this, i);
+	}
+}
+
+void RecordThreadPool::destroy() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	startCondition.notify_all();
+
+	for (auto& worker : workers) {
+		if (worker->thread.joinable()) {
+			worker->thread.join();
+		}
+		// also frees the secondary command buffers.
+		for (VkCommandPool pool : worker->pools) {
+			vkDestroyCommandPool(device, pool, nullptr);
+		}
+	}
+	workers.clear();
+}
+
+void RecordThreadPool::record(uint32_t frameSlot, const VkCommandBufferInheritanceInfo& inheritance, size_t itemCount,
+	const RecordFunc& recordFunc, std::vector<VkCommandBuffer>& secondaries) {
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		jobFrameSlot = frameSlot;
+		jobInheritance = &inheritance;
+		jobItemCount = itemCount;
+		jobRecordFunc = &recordFunc;
+		jobFailed = false;
+		jobsPending = static_cast<uint32_t>(workers.size());
+		jobGeneration++;
+		startCondition.notify_all();
+
+		doneCondition.wait(lock, [this] { return jobsPending == 0; });
+		if (jobFailed) {
+			throw std::runtime_error("failed to record secondary command buffer!");
+		}
+	}
+
+	secondaries.clear();
+	for (auto& worker : workers) {
+		secondaries.push_back(worker->commandBuffers[frameSlot]);
+	}
+}
+
+void RecordThreadPool::workerMain(uint32_t workerIndex) {
+	Worker& worker = *workers[workerIndex];
+	uint64_t seenGeneration = 0;
+
+	for (;;) {
+		uint32_t frameSlot;
+		const VkCommandBufferInheritanceInfo* inheritance;
+		size_t itemCount;
+		const RecordFunc* recordFunc;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			startCondition.wait(lock, [this, seenGeneration] { return quit || jobGeneration != seenGeneration; });
+			if (quit) return;
+			seenGeneration = jobGeneration;
+			frameSlot = jobFrameSlot;
+			inheritance = jobInheritance;
+			itemCount = jobItemCount;
+			recordFunc = jobRecordFunc;
+		}
+
+		// an equal share of the items for each worker, in order.
+		size_t workerCount = workers.size();
+		size_t first = itemCount * workerIndex / workerCount;
+		size_t last = itemCount * (workerIndex + 1) / workerCount;
+
+		// the secondaries of this frame slot finished executing, the whole pool can be reset.
+		vkResetCommandPool(device, worker.pools[frameSlot], 0);
+
+		VkCommandBuffer commandBuffer = worker.commandBuffers[frameSlot];
+		VkCommandBufferBeginInfo beginInfo = {};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		// entirely inside the render pass given by the inheritance info.
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		beginInfo.pInheritanceInfo = inheritance;
+		vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+		(*recordFunc)(commandBuffer, first, last);
+
+		bool failed = vkEndCommandBuffer(commandBuffer) != VK_SUCCESS;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (failed) jobFailed = true;
+			if (--jobsPending == 0) {
+				doneCondition.notify_one();
+			}
+		}
+	}
+}
@@ -0,0 +1,68 @@
+#ifndef __RECORDTHREADPOOL_H__
+#define __RECORDTHREADPOOL_H__
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+// Worker threads recording secondary command buffers in parallel.
+//
+// A VkCommandPool (and everything allocated from it) must only be used by one
+// thread at a time, so every worker owns its pools: one per frame in flight,
+// because the secondaries of a frame may still be executing while the next
+// frame is recorded. The pool of a frame is reset in bulk with vkResetCommandPool
+// before it is recorded again, nothing is ever freed individually.
+//
+// record() splits [0, itemCount) into one contiguous range per worker and blocks
+// until all of them are recorded, the secondaries come back in item order so the
+// primary can execute them with vkCmdExecuteCommands.
+class RecordThreadPool {
+public:
+	// records the items [first, last) into commandBuffer, which is already begun.
+	typedef std::function<void(VkCommandBuffer commandBuffer, size_t first, size_t last)> RecordFunc;
+
+	// threadCount 0: one worker per hardware thread.
+	void init(VkDevice device, uint32_t queueFamilyIndex, uint32_t threadCount, uint32_t framesInFlight);
+	// the device must be idle.
+	void destroy();
+	uint32_t getThreadCount() const { return static_cast<uint32_t>(workers.size()); }
+
+	// frameSlot's previous secondaries must have finished executing.
+	void record(uint32_t frameSlot, const VkCommandBufferInheritanceInfo& inheritance, size_t itemCount,
+		const RecordFunc& recordFunc, std::vector<VkCommandBuffer>& secondaries);
+
+private:
+	struct Worker {
+		std::thread thread;
+		std::vector<VkCommandPool> pools; // per frame in flight
+		std::vector<VkCommandBuffer> commandBuffers; // one secondary per pool
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	std::vector<std::unique_ptr<Worker>> workers;
+
+	std::mutex mutex;
+	std::condition_variable startCondition;
+	std::condition_variable doneCondition;
+	uint64_t jobGeneration = 0; // incremented for every record() call
+	uint32_t jobsPending = 0;
+	bool jobFailed = false;
+	bool quit = false;
+
+	// the current job, only valid while jobsPending > 0.
+	uint32_t jobFrameSlot = 0;
+	const VkCommandBufferInheritanceInfo* jobInheritance = nullptr;
+	size_t jobItemCount = 0;
+	const RecordFunc* jobRecordFunc = nullptr;
+
+	void workerMain(uint32_t workerIndex);
+};
+
+#endif
@@ -0,0 +1,530 @@
+#include "RenderGraph.h"
+
+#include <cstdio>
+#include <algorithm>
+#include <stdexcept>
+
+// the accesses that have to be made available to later accesses.
+static const VkAccessFlags WRITE_ACCESS_MASK = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+	VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+// only these usages may be TRANSIENT_ATTACHMENT.
+static const VkImageUsageFlags ATTACHMENT_USAGE_MASK = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+	VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+
+void RenderGraph::init(VkDevice device, MemoryAllocator* allocator) {
+	this->device = device;
+	this->allocator = allocator;
+}
+
+void RenderGraph::reset(DeletionQueue* deletionQueue) {
+	std::vector<VkImage> images;
+	std::vector<VkImageView> views;
+	std::vector<MemoryAllocator::Allocation> allocations;
+	for (auto& resource : resources) {
+		if (resource.imported) continue;
+		images.push_back(resource.image);
+		views.push_back(resource.view);
+	}
+	for (auto& slot : memorySlots) {
+		allocations.push_back(slot.allocation);
+	}
+
+	VkDevice device = this->device;
+	MemoryAllocator* allocator = this->allocator;
+	auto destroy = [device, allocator, images, views, allocations]() mutable {
+		for (size_t i = 0; i < images.size(); i++) {
+			vkDestroyImageView(device, views[i], nullptr);
+			vkDestroyImage(device, images[i], nullptr);
+		}
+		for (auto& allocation : allocations) {
+			allocator->free(allocation);
+		}
+	};
+	if (deletionQueue != nullptr) {
+		deletionQueue->push(destroy);
+	} else {
+		destroy();
+	}
+
+	resources.clear();
+	passes.clear();
+	memorySlots.clear();
+	finalBarriers.clear();
+	compiled = false;
+}
+
+RenderGraph::ResourceId RenderGraph::createImage(const std::string& name, const ImageDesc& desc) {
+	Resource resource;
+	resource.name = name;
+	resource.desc = desc;
+	resources.push_back(resource);
+	return static_cast<ResourceId>(resources.size() - 1);
+}
+
+RenderGraph::ResourceId RenderGraph::importImage(const std::string& name, VkImageAspectFlags aspect,
+	const AccessState& initial, const AccessState& final) {
+	Resource resource;
+	resource.name = name;
+	resource.imported = true;
+	resource.desc.aspect = aspect;
+	resource.initial = initial;
+	resource.final = final;
+	resources.push_back(resource);
+	return static_cast<ResourceId>(resources.size() - 1);
+}
+
+RenderGraph::ResourceId RenderGraph::importBuffer(const std::string& name, const AccessState& initial) {
+	Resource resource;
+	resource.name = name;
+	resource.isImage = false;
+	resource.imported = true;
+	resource.initial = initial;
+	resources.push_back(resource);
+	return static_cast<ResourceId>(resources.size() - 1);
+}
+
+void RenderGraph::markOutput(ResourceId resource) {
+	resources[resource].output = true;
+}
+
+RenderGraph::PassId RenderGraph::addPass(const std::string& name, PassType type, const RecordFunc& record) {
+	Pass pass;
+	pass.name = name;
+	pass.type = type;
+	pass.record = record;
+	passes.push_back(pass);
+	return static_cast<PassId>(passes.size() - 1);
+}
+
+void RenderGraph::read(PassId pass, ResourceId resource, Usage usage) {
+	addAccess(pass, resource, usage, false);
+}
+
+void RenderGraph::write(PassId pass, ResourceId resource, Usage usage) {
+	addAccess(pass, resource, usage, true);
+}
+
+// the stages, accesses and layout of a use. Several uses of a resource in one pass
+// are merged into one access, they have to agree on the layout.
+void RenderGraph::addAccess(PassId passId, ResourceId resource, Usage usage, bool write) {
+	Pass& pass = passes[passId];
+	VkPipelineStageFlags shaderStages = pass.type == PASS_COMPUTE ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT :
+		VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+
+	Access access = { resource, 0, 0, VK_IMAGE_LAYOUT_UNDEFINED, write };
+	switch (usage) {
+	case USAGE_COLOR_ATTACHMENT:
+		access.stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		access.access = write ? VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT : VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
+		access.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		break;
+	case USAGE_DEPTH_ATTACHMENT:
+		// the depth test reads, even when the pass only "writes" depth.
+		access.stages = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		access.access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | (write ? VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT : 0);
+		access.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		break;
+	case USAGE_SAMPLED:
+		access.stages = shaderStages;
+		access.access = VK_ACCESS_SHADER_READ_BIT;
+		access.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		break;
+	case USAGE_STORAGE:
+		access.stages = shaderStages;
+		access.access = write ? VK_ACCESS_SHADER_WRITE_BIT : VK_ACCESS_SHADER_READ_BIT;
+		access.layout = VK_IMAGE_LAYOUT_GENERAL;
+		break;
+	case USAGE_UNIFORM:
+		access.stages = shaderStages;
+		access.access = VK_ACCESS_UNIFORM_READ_BIT;
+		break;
+	case USAGE_TRANSFER:
+		access.stages = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		access.access = write ? VK_ACCESS_TRANSFER_WRITE_BIT : VK_ACCESS_TRANSFER_READ_BIT;
+		access.layout = write ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		break;
+	case USAGE_INDIRECT:
+		access.stages = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+		access.access = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+		break;
+	}
+	if (write && (usage == USAGE_SAMPLED || usage == USAGE_UNIFORM || usage == USAGE_INDIRECT)) {
+		throw std::runtime_error("render graph: " + resources[resource].name + " can't be written as a read only usage!");
+	}
+	if (!resources[resource].isImage) {
+		access.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+	}
+
+	for (auto& other : pass.accesses) {
+		if (other.resource != resource) continue;
+		if (other.layout != access.layout) {
+			throw std::runtime_error("render graph: " + resources[resource].name + " is used in two layouts by pass " + pass.name + "!");
+		}
+		other.stages |= access.stages;
+		other.access |= access.access;
+		other.write = other.write || write;
+		return;
+	}
+	pass.accesses.push_back(access);
+}
+
+void RenderGraph::compile() {
+	cullPasses();
+
+	// the lifetime of the transient images, in live passes.
+	for (size_t i = 0; i < passes.size(); i++) {
+		if (!passes[i].live) continue;
+		for (const auto& access : passes[i].accesses) {
+			Resource& resource = resources[access.resource];
+			if (resource.firstPass < 0) resource.firstPass = static_cast<int>(i);
+			resource.lastPass = static_cast<int>(i);
+		}
+	}
+
+	createTransientImages();
+	scheduleBarriers();
+	compiled = true;
+}
+
+// From the last pass backwards: a pass is needed if it writes something that is an output
+// or read by a later needed pass, then everything it reads is needed too.
+// Writes are not tracked per range, so a later write never makes an earlier one dead.
+void RenderGraph::cullPasses() {
+	std::vector<bool> needed(resources.size(), false);
+	for (size_t i = 0; i < resources.size(); i++) {
+		needed[i] = resources[i].output;
+	}
+
+	for (size_t i = passes.size(); i-- > 0;) {
+		Pass& pass = passes[i];
+		pass.live = false;
+		for (const auto& access : pass.accesses) {
+			if (access.write && needed[access.resource]) {
+				pass.live = true;
+				break;
+			}
+		}
+		if (!pass.live) continue;
+		// read-modify-write (an atomic counter, a loaded attachment) counts as a read.
+		for (const auto& access : pass.accesses) {
+			if (!access.write || (access.access & ~WRITE_ACCESS_MASK) != 0) {
+				needed[access.resource] = true;
+			}
+		}
+	}
+}
+
+// Create the images, then share the memory: in the order of their first pass, an image
+// goes into the first slot whose images are all done before it starts, and whose memory
+// types it can live in.
+void RenderGraph::createTransientImages() {
+	std::vector<ResourceId> transients;
+	for (size_t i = 0; i < resources.size(); i++) {
+		Resource& resource = resources[i];
+		if (resource.imported || resource.firstPass < 0) continue;
+
+		VkImageCreateInfo imageInfo = {};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = resource.desc.format;
+		imageInfo.extent = { resource.desc.extent.width, resource.desc.extent.height, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = resource.desc.samples;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = resource.desc.usage;
+		if ((resource.desc.usage & ~ATTACHMENT_USAGE_MASK) == 0) {
+			imageInfo.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+		}
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		if (vkCreateImage(device, &imageInfo, nullptr, &resource.image) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create render graph image " + resource.name + "!");
+		}
+		vkGetImageMemoryRequirements(device, resource.image, &resource.requirements);
+		transients.push_back(static_cast<ResourceId>(i));
+	}
+
+	std::stable_sort(transients.begin(), transients.end(),
+		[this](ResourceId a, ResourceId b) { return resources[a].firstPass < resources[b].firstPass; });
+
+	for (ResourceId id : transients) {
+		const Resource& resource = resources[id];
+		bool transientAttachment = (resource.desc.usage & ~ATTACHMENT_USAGE_MASK) == 0;
+		MemorySlot* target = nullptr;
+		for (auto& slot : memorySlots) {
+			if (resources[slot.images.back()].lastPass < resource.firstPass &&
+				(slot.requirements.memoryTypeBits & resource.requirements.memoryTypeBits) != 0) {
+				target = &slot;
+				break;
+			}
+		}
+		if (target == nullptr) {
+			memorySlots.push_back(MemorySlot());
+			target = &memorySlots.back();
+			target->requirements = resource.requirements;
+			target->lazy = transientAttachment;
+		} else {
+			target->requirements.size = std::max(target->requirements.size, resource.requirements.size);
+			target->requirements.alignment = std::max(target->requirements.alignment, resource.requirements.alignment);
+			target->requirements.memoryTypeBits &= resource.requirements.memoryTypeBits;
+			target->lazy = target->lazy && transientAttachment;
+		}
+		target->images.push_back(id);
+	}
+
+	for (auto& slot : memorySlots) {
+		slot.lazy = slot.lazy && allocator->hasMemoryType(slot.requirements.memoryTypeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+		VkMemoryPropertyFlags properties = slot.lazy ? VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		// lazy slots get a VkDeviceMemory of their own: the commitment can only be queried per 
+		// VkDeviceMemory, and a slot uses exactly its requirements instead of a buddy node.
+		slot.allocation = allocator->allocate(slot.requirements, properties, MemoryAllocator::RESOURCE_OPTIMAL, slot.lazy);
+
+		for (ResourceId id : slot.images) {
+			Resource& resource = resources[id];
+			vkBindImageMemory(device, resource.image, slot.allocation.memory, slot.allocation.offset);
+
+			VkImageViewCreateInfo viewInfo = {};
+			viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			viewInfo.image = resource.image;
+			viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewInfo.format = resource.desc.format;
+			viewInfo.subresourceRange.aspectMask = resource.desc.aspect;
+			viewInfo.subresourceRange.baseMipLevel = 0;
+			viewInfo.subresourceRange.levelCount = 1;
+			viewInfo.subresourceRange.baseArrayLayer = 0;
+			viewInfo.subresourceRange.layerCount = 1;
+			if (vkCreateImageView(device, &viewInfo, nullptr, &resource.view) != VK_SUCCESS) {
+				throw std::runtime_error("failed to create render graph image view " + resource.name + "!");
+			}
+		}
+	}
+}
+
+// Walk the live passes in order and track, per resource, the last write and the reads
+// since then. A use needs a barrier for a layout change, after a write (unless an earlier
+// barrier already made it visible to these stages) and before a write that follows reads.
+void RenderGraph::scheduleBarriers() {
+	struct State {
+		VkImageLayout layout;
+		VkPipelineStageFlags writeStages;	// the last write, or layout transition
+		VkAccessFlags writeAccess;
+		VkPipelineStageFlags readStages;	// since the last write
+		VkPipelineStageFlags visibleStages;	// the last write is visible to these already
+		VkAccessFlags visibleAccess;
+	};
+	std::vector<State> states(resources.size());
+	for (size_t i = 0; i < resources.size(); i++) {
+		const Resource& resource = resources[i];
+		// transients: the src of the first barrier is patched below, it depends on the end of the frame.
+		State state = { resource.initial.layout, resource.initial.stages, resource.initial.access, 0, 0, 0 };
+		states[i] = state;
+	}
+	// where the first barrier of each transient image is: (pass, index).
+	std::vector<std::pair<size_t, size_t>> firstBarriers(resources.size(), std::make_pair(passes.size(), 0));
+
+	for (size_t p = 0; p < passes.size(); p++) {
+		Pass& pass = passes[p];
+		pass.barriers.clear();
+		if (!pass.live) continue;
+
+		for (const auto& access : pass.accesses) {
+			const Resource& resource = resources[access.resource];
+			State& state = states[access.resource];
+			bool layoutChange = resource.isImage && access.layout != state.layout;
+
+			Barrier barrier = { access.resource, state.layout, access.layout, 0, 0, access.stages, access.access };
+			bool needed = false;
+			if (layoutChange || (access.write && (state.writeStages | state.readStages) != 0)) {
+				// write after write or read: everyone before has to be done, only writes need flushing.
+				barrier.srcStages = state.writeStages | state.readStages;
+				barrier.srcAccess = state.writeAccess;
+				needed = true;
+			} else if (!access.write && state.writeStages != 0 &&
+				((access.stages & ~state.visibleStages) != 0 || (access.access & ~state.visibleAccess) != 0)) {
+				// read after write, these stages haven't seen the write yet.
+				barrier.srcStages = state.writeStages;
+				barrier.srcAccess = state.writeAccess;
+				needed = true;
+			}
+
+			if (needed) {
+				if (!resource.imported && firstBarriers[access.resource].first == passes.size()) {
+					firstBarriers[access.resource] = std::make_pair(p, pass.barriers.size());
+				}
+				pass.barriers.push_back(barrier);
+			}
+
+			if (access.write) {
+				state.writeStages = access.stages;
+				state.writeAccess = access.access & WRITE_ACCESS_MASK;
+				state.readStages = 0;
+				state.visibleStages = 0;
+				state.visibleAccess = 0;
+			} else if (layoutChange) {
+				// the transition is a write, only visible to the stages of this barrier.
+				state.writeStages = access.stages;
+				state.writeAccess = 0;
+				state.readStages = access.stages;
+				state.visibleStages = access.stages;
+				state.visibleAccess = access.access;
+			} else {
+				state.readStages |= access.stages;
+				if (needed) {
+					state.visibleStages |= access.stages;
+					state.visibleAccess |= access.access;
+				}
+			}
+			state.layout = access.layout;
+		}
+	}
+
+	// A transient image starts the frame in the memory the previous image of its slot used,
+	// or itself in the previous frame: its first barrier waits for the end of that use.
+	for (const auto& slot : memorySlots) {
+		for (size_t i = 0; i < slot.images.size(); i++) {
+			ResourceId id = slot.images[i];
+			ResourceId previous = slot.images[(i + slot.images.size() - 1) % slot.images.size()];
+			const std::pair<size_t, size_t>& location = firstBarriers[id];
+			if (location.first == passes.size()) continue;
+			Barrier& barrier = passes[location.first].barriers[location.second];
+			barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			barrier.srcStages = states[previous].writeStages | states[previous].readStages;
+			barrier.srcAccess = states[previous].writeAccess;
+		}
+	}
+
+	// the imported images go back to the layout the rest of the frame expects.
+	finalBarriers.clear();
+	for (size_t i = 0; i < resources.size(); i++) {
+		const Resource& resource = resources[i];
+		const State& state = states[i];
+		if (!resource.imported || !resource.isImage || resource.final.layout == state.layout) continue;
+
+		Barrier barrier = { static_cast<ResourceId>(i), state.layout, resource.final.layout,
+			state.writeStages | state.readStages, state.writeAccess, resource.final.stages, resource.final.access };
+		finalBarriers.push_back(barrier);
+	}
+}
+
+void RenderGraph::bindImage(ResourceId resource, VkImage image) {
+	resources[resource].image = image;
+}
+
+void RenderGraph::bindBuffer(ResourceId resource, VkBuffer buffer) {
+	resources[resource].buffer = buffer;
+}
+
+void RenderGraph::execute(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t slot) {
+	if (!compiled) {
+		throw std::runtime_error("render graph: execute before compile!");
+	}
+	for (auto& pass : passes) {
+		if (!pass.live) continue;
+		recordBarriers(commandBuffer, pass.barriers);
+		pass.record(commandBuffer, imageIndex, slot);
+	}
+	recordBarriers(commandBuffer, finalBarriers);
+}
+
+// all the barriers of a batch in one vkCmdPipelineBarrier, with the union of their stages.
+void RenderGraph::recordBarriers(VkCommandBuffer commandBuffer, const std::vector<Barrier>& barriers) {
+	if (barriers.empty()) return;
+
+	imageBarriers.clear();
+	bufferBarriers.clear();
+	VkPipelineStageFlags srcStages = 0;
+	VkPipelineStageFlags dstStages = 0;
+	for (const auto& barrier : barriers) {
+		const Resource& resource = resources[barrier.resource];
+		srcStages |= barrier.srcStages;
+		dstStages |= barrier.dstStages;
+
+		if (resource.isImage) {
+			if (resource.image == VK_NULL_HANDLE) {
+				throw std::runtime_error("render graph: no image bound to " + resource.name + "!");
+			}
+			VkImageMemoryBarrier imageBarrier = {};
+			imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			imageBarrier.srcAccessMask = barrier.srcAccess;
+			imageBarrier.dstAccessMask = barrier.dstAccess;
+			imageBarrier.oldLayout = barrier.oldLayout;
+			imageBarrier.newLayout = barrier.newLayout;
+			imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			imageBarrier.image = resource.image;
+			imageBarrier.subresourceRange.aspectMask = resource.desc.aspect;
+			imageBarrier.subresourceRange.baseMipLevel = 0;
+			imageBarrier.subresourceRange.levelCount = 1;
+			imageBarrier.subresourceRange.baseArrayLayer = 0;
+			imageBarrier.subresourceRange.layerCount = 1;
+			imageBarriers.push_back(imageBarrier);
+		} else {
+			if (resource.buffer == VK_NULL_HANDLE) {
+				throw std::runtime_error("render graph: no buffer bound to " + resource.name + "!");
+			}
+			VkBufferMemoryBarrier bufferBarrier = {};
+			bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			bufferBarrier.srcAccessMask = barrier.srcAccess;
+			bufferBarrier.dstAccessMask = barrier.dstAccess;
+			bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			bufferBarrier.buffer = resource.buffer;
+			bufferBarrier.offset = 0;
+			bufferBarrier.size = VK_WHOLE_SIZE;
+			bufferBarriers.push_back(bufferBarrier);
+		}
+	}
+
+	// nothing to wait for (a first use), or nobody waiting (handed over with a semaphore).
+	if (srcStages == 0) srcStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+	if (dstStages == 0) dstStages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 0, nullptr,
+		static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
+		static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+}
+
+void RenderGraph::printStats() const {
+	uint32_t livePasses = 0;
+	uint32_t barrierCount = static_cast<uint32_t>(finalBarriers.size());
+	uint32_t batchCount = finalBarriers.empty() ? 0 : 1;
+	std::string culled;
+	for (const auto& pass : passes) {
+		if (!pass.live) {
+			culled += " " + pass.name;
+			continue;
+		}
+		livePasses++;
+		barrierCount += static_cast<uint32_t>(pass.barriers.size());
+		batchCount += pass.barriers.empty() ? 0 : 1;
+	}
+	printf("render graph: %u of %u passes (culled:%s), %u barriers in %u vkCmdPipelineBarrier\n",
+		livePasses, static_cast<uint32_t>(passes.size()), culled.empty() ? " none" : culled.c_str(), barrierCount, batchCount);
+
+	// what the transient images would need without sharing, and what they got.
+	VkDeviceSize imageBytes = 0;
+	VkDeviceSize slotBytes = 0;
+	for (const auto& slot : memorySlots) {
+		slotBytes += slot.requirements.size;
+		for (ResourceId id : slot.images) {
+			imageBytes += resources[id].requirements.size;
+		}
+		VkDeviceSize committed = 0;
+		if (slot.lazy) {
+			vkGetDeviceMemoryCommitment(device, slot.allocation.memory, &committed);
+		}
+		printf("\tmemory %u: %.2f MB%s, %u image(s):", static_cast<uint32_t>(&slot - &memorySlots[0]),
+			slot.requirements.size / (1024.0 * 1024.0), slot.lazy ? " lazily allocated" : "",
+			static_cast<uint32_t>(slot.images.size()));
+		for (ResourceId id : slot.images) {
+			printf(" %s", resources[id].name.c_str());
+		}
+		if (slot.lazy) {
+			printf(" (%.2f MB committed)", committed / (1024.0 * 1024.0));
+		}
+		printf("\n");
+	}
+	printf("\ttransient memory: %.2f MB, %.2f MB without aliasing\n",
+		slotBytes / (1024.0 * 1024.0), imageBytes / (1024.0 * 1024.0));
+}
@@ -0,0 +1,189 @@
+#ifndef __RENDERGRAPH_H__
+#define __RENDERGRAPH_H__
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include "MemoryAllocator.h"
+#include "DeletionQueue.h"
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <cstdint>
+
+// The passes of a frame and the resources they read and write, instead of
+// hand written barriers and subpass dependencies.
+//
+// The graph is declared once (per swap chain), compile() turns it into a plan:
+// - passes whose writes never reach an output are culled, and so are the images only they use.
+// - every image gets the layout its use needs, the transitions are part of the barriers.
+// - the barriers a pass needs are batched into one vkCmdPipelineBarrier before it,
+//   with only the stages and accesses of the hazards in it: read after read needs
+//   nothing, write after read only an execution dependency.
+// - transient images (created by the graph, only alive inside the frame) whose passes
+//   don't overlap share their memory. The first barrier of an image waits for the last
+//   use of whatever was in the memory before, in this frame or the previous one.
+// execute() then records the passes with their barriers, as often as needed.
+//
+// Imported resources (the swap chain images, per slot buffers) are described by the
+// state they are in before the frame and the layout they must be left in. Their
+// handles change from frame to frame, bind them before every execute().
+//
+// usage:
+//		build:		id = createImage(...) / importImage(...); pass = addPass(...); read(pass, id, usage); write(...)
+//		compile():	once, after the last pass.
+//		record:		bindImage/bindBuffer for the imports; execute(cmd, imageIndex, slot).
+//		reset():	before building it again, e.g. after a resize. The frames in flight may still use
+//					the transient images, hand them to a DeletionQueue then.
+class RenderGraph {
+public:
+	typedef uint32_t ResourceId;
+	typedef uint32_t PassId;
+
+	// how a pass uses a resource, the pass type chooses the shader stages.
+	enum Usage {
+		USAGE_COLOR_ATTACHMENT,		// also a resolve attachment
+		USAGE_DEPTH_ATTACHMENT,
+		USAGE_SAMPLED,				// read only
+		USAGE_STORAGE,
+		USAGE_UNIFORM,				// read only
+		USAGE_TRANSFER,
+		USAGE_INDIRECT				// read only
+	};
+
+	enum PassType {
+		PASS_GRAPHICS,
+		PASS_COMPUTE,
+		PASS_TRANSFER
+	};
+
+	// the layout, stages and accesses a resource is used with outside the graph.
+	struct AccessState {
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED; // ignored for buffers
+		VkPipelineStageFlags stages = 0;
+		VkAccessFlags access = 0;
+	};
+
+	struct ImageDesc {
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		VkExtent2D extent = { 0, 0 };
+		VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+		VkImageUsageFlags usage = 0;
+		VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+	};
+
+	// the commands of a pass, imageIndex and slot are the ones given to execute().
+	typedef std::function<void(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t slot)> RecordFunc;
+
+	void init(VkDevice device, MemoryAllocator* allocator);
+	// the transient images must not be in use by the GPU anymore.
+	void destroy() { reset(); }
+	// forget the passes and resources, destroy the transient images (through deletionQueue if given).
+	void reset(DeletionQueue* deletionQueue = nullptr);
+
+	// a transient image, created by compile(). Its contents never survive the frame:
+	// the first use starts from VK_IMAGE_LAYOUT_UNDEFINED. Only the attachment usages
+	// allow it to be TRANSIENT_ATTACHMENT, in LAZILY_ALLOCATED memory where there is some.
+	ResourceId createImage(const std::string& name, const ImageDesc& desc);
+	// initial: how the image was last used before the frame, e.g. the stage the acquire
+	// semaphore is waited in. final: the layout to leave it in, and the stages/accesses
+	// that use it after the frame (BOTTOM_OF_PIPE/0 when a semaphore follows).
+	ResourceId importImage(const std::string& name, VkImageAspectFlags aspect, const AccessState& initial, const AccessState& final);
+	ResourceId importBuffer(const std::string& name, const AccessState& initial);
+	// the contents are needed after the frame, the passes writing it are never culled.
+	void markOutput(ResourceId resource);
+
+	PassId addPass(const std::string& name, PassType type, const RecordFunc& record);
+	void read(PassId pass, ResourceId resource, Usage usage);
+	void write(PassId pass, ResourceId resource, Usage usage);
+
+	void compile();
+
+	// the handle of an imported resource for the next execute().
+	void bindImage(ResourceId resource, VkImage image);
+	void bindBuffer(ResourceId resource, VkBuffer buffer);
+	// VK_NULL_HANDLE if the image was culled together with its passes.
+	VkImageView getImageView(ResourceId resource) const { return resources[resource].view; }
+
+	void execute(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t slot);
+	void printStats() const;
+
+private:
+	// one VkImageMemoryBarrier / VkBufferMemoryBarrier.
+	struct Barrier {
+		ResourceId resource;
+		VkImageLayout oldLayout;
+		VkImageLayout newLayout;
+		VkPipelineStageFlags srcStages;
+		VkAccessFlags srcAccess;
+		VkPipelineStageFlags dstStages;
+		VkAccessFlags dstAccess;
+	};
+
+	// all the uses of one resource in one pass, merged.
+	struct Access {
+		ResourceId resource;
+		VkPipelineStageFlags stages;
+		VkAccessFlags access;
+		VkImageLayout layout;
+		bool write;
+	};
+
+	struct Pass {
+		std::string name;
+		PassType type;
+		RecordFunc record;
+		std::vector<Access> accesses;
+		bool live = false;
+		// recorded right before the pass.
+		std::vector<Barrier> barriers;
+	};
+
+	struct Resource {
+		std::string name;
+		bool isImage = true;
+		bool imported = false;
+		bool output = false;
+		ImageDesc desc;
+		AccessState initial;
+		AccessState final;
+		// transient images, after compile(): the first and last live pass using it.
+		int firstPass = -1;
+		int lastPass = -1;
+		VkMemoryRequirements requirements = {};
+		VkImage image = VK_NULL_HANDLE; // bound by bindImage for imports
+		VkImageView view = VK_NULL_HANDLE;
+		VkBuffer buffer = VK_NULL_HANDLE;
+	};
+
+	// memory shared by transient images with disjoint lifetimes, in the order they use it.
+	struct MemorySlot {
+		std::vector<ResourceId> images;
+		// what all the images need: the largest size and alignment, the common memory types.
+		VkMemoryRequirements requirements = {};
+		bool lazy = false; // only transient attachments, and a LAZILY_ALLOCATED type fits them all
+		MemoryAllocator::Allocation allocation;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	MemoryAllocator* allocator = nullptr;
+	std::vector<Resource> resources;
+	std::vector<Pass> passes;
+	std::vector<MemorySlot> memorySlots;
+	// after the last pass: imported images into their final layout.
+	std::vector<Barrier> finalBarriers;
+	bool compiled = false;
+
+	// reused by execute().
+	std::vector<VkImageMemoryBarrier> imageBarriers;
+	std::vector<VkBufferMemoryBarrier> bufferBarriers;
+
+	void addAccess(PassId pass, ResourceId resource, Usage usage, bool write);
+	void cullPasses();
+	void scheduleBarriers();
+	void createTransientImages();
+	void recordBarriers(VkCommandBuffer commandBuffer, const std::vector<Barrier>& barriers);
+};
+
+#endif
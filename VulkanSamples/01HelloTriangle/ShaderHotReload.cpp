@@ -0,0 +1,149 @@
+#include "ShaderHotReload.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <set>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cerrno>
+#endif
+
+bool ShaderHotReload::init(const std::string& directory, const std::vector<std::string>& files) {
+	this->directory = directory;
+	this->files = files;
+	outputDirectory = directory + "/generated";
+
+#ifdef __linux__
+	// glslangValidator doesn't create it, and only the compile scripts do in the shaders folder.
+	if (mkdir(outputDirectory.c_str(), 0755) != 0 && errno != EEXIST) {
+		fprintf(stderr, "shader hot reload: can't create %s\n", outputDirectory.c_str());
+		return false;
+	}
+	inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotifyFd < 0) {
+		fprintf(stderr, "shader hot reload: inotify_init1 failed\n");
+		return false;
+	}
+	// the directory, not the files: most editors save by writing a new file and renaming it 
+	// over the old one, a watch on the old inode would never fire again.
+	if (inotify_add_watch(inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+		fprintf(stderr, "shader hot reload: can't watch %s\n", directory.c_str());
+		close(inotifyFd);
+		inotifyFd = -1;
+		return false;
+	}
+
+	quit = false;
+	watchThread = std::thread(&ShaderHotReload::watchThreadMain, this);
+	printf("shader hot reload: watching %d shaders in %s\n", (int)files.size(), directory.c_str());
+	return true;
+#else
+	fprintf(stderr, "shader hot reload: only supported on Linux (inotify)\n");
+	return false;
+#endif
+}
+
+void ShaderHotReload::destroy() {
+	quit = true;
+	if (watchThread.joinable()) {
+		watchThread.join();
+	}
+#ifdef __linux__
+	if (inotifyFd >= 0) {
+		close(inotifyFd);
+		inotifyFd = -1;
+	}
+#endif
+	compiled.clear();
+}
+
+std::vector<ShaderHotReload::Shader> ShaderHotReload::poll() {
+	std::lock_guard<std::mutex> lock(mutex);
+	std::vector<Shader> result;
+	result.swap(compiled);
+	return result;
+}
+
+void ShaderHotReload::watchThreadMain() {
+#ifdef __linux__
+	// big enough for a burst of events, aligned for struct inotify_event.
+	alignas(struct inotify_event) char buffer[4096];
+
+	while (!quit) {
+		// wake up regularly to see quit.
+		pollfd pollFd = {};
+		pollFd.fd = inotifyFd;
+		pollFd.events = POLLIN;
+		if (::poll(&pollFd, 1, 100) <= 0) continue;
+
+		// an editor saves in several steps (write, rename, chmod ...), collect the 
+		// events until it is quiet, so each file is compiled once, in its final state.
+		std::set<std::string> changed;
+		for (;;) {
+			ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+			if (length <= 0) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(50));
+				length = read(inotifyFd, buffer, sizeof(buffer));
+				if (length <= 0) break;
+			}
+			for (char* p = buffer; p < buffer + length;) {
+				const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(p);
+				if (event->len > 0 && std::find(files.begin(), files.end(), event->name) != files.end()) {
+					changed.insert(event->name);
+				}
+				p += sizeof(struct inotify_event) + event->len;
+			}
+		}
+
+		for (const std::string& name : changed) {
+			Shader shader;
+			shader.name = name;
+			if (!compile(name, shader.code)) continue;
+
+			std::lock_guard<std::mutex> lock(mutex);
+			// a newer version replaces one that wasn't picked up yet.
+			compiled.erase(std::remove_if(compiled.begin(), compiled.end(),
+				[&name](const Shader& other) { return other.name == name; }), compiled.end());
+			compiled.push_back(std::move(shader));
+		}
+	}
+#endif
+}
+
+// glslangValidator prints the errors itself.
+bool ShaderHotReload::compile(const std::string& name, std::vector<uint32_t>& code) {
+	const char* sdk = getenv("VULKAN_SDK");
+	std::string glslang = sdk != nullptr ? std::string(sdk) + "/bin/glslangValidator" : "glslangValidator";
+	std::string source = directory + "/" + name;
+	std::string output = outputDirectory + "/" + name + ".hotreload.spv";
+
+	std::string command = "\"" + glslang + "\" -V \"" + source + "\" -o \"" + output + "\"";
+	printf("shader hot reload: compiling %s\n", name.c_str());
+	if (system(command.c_str()) != 0) {
+		fprintf(stderr, "shader hot reload: failed to compile %s, keeping the old version\n", name.c_str());
+		return false;
+	}
+
+	std::ifstream file(output, std::ios::ate | std::ios::binary);
+	if (!file.is_open()) {
+		fprintf(stderr, "shader hot reload: failed to open %s\n", output.c_str());
+		return false;
+	}
+	size_t fileSize = (size_t)file.tellg();
+	if (fileSize == 0 || fileSize % sizeof(uint32_t) != 0) {
+		fprintf(stderr, "shader hot reload: %s is not SPIR-V\n", output.c_str());
+		return false;
+	}
+	// read straight into the words, the module needs 4 byte alignment.
+	code.resize(fileSize / sizeof(uint32_t));
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(code.data()), fileSize);
+	return true;
+}
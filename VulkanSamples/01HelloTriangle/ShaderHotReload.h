@@ -0,0 +1,49 @@
+#ifndef __SHADERHOTRELOAD_H__
+#define __SHADERHOTRELOAD_H__
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+// Dev mode: watches shader sources and recompiles them when they are saved.
+//
+// A background thread waits for inotify events on the shader directory and runs
+// glslangValidator (the same one as shaders/compile.sh) on every changed file it
+// was asked to watch. The SPIR-V is handed to the render thread through poll(),
+// which never blocks, so it can be called once per frame. Swapping the pipelines
+// is up to the caller.
+//
+// Only on Linux, init() fails everywhere else.
+class ShaderHotReload {
+public:
+	struct Shader {
+		std::string name;			// as given to init()
+		std::vector<uint32_t> code;
+	};
+
+	// watch the files (names relative to directory).
+	bool init(const std::string& directory, const std::vector<std::string>& files);
+	void destroy();
+
+	// the shaders compiled successfully since the last call.
+	std::vector<Shader> poll();
+
+private:
+	std::string directory;
+	std::string outputDirectory; // directory/generated, created by init()
+	std::vector<std::string> files;
+	int inotifyFd = -1;
+	std::thread watchThread;
+	std::atomic<bool> quit{ false };
+
+	std::mutex mutex;
+	std::vector<Shader> compiled;
+
+	void watchThreadMain();
+	bool compile(const std::string& name, std::vector<uint32_t>& code);
+};
+
+#endif
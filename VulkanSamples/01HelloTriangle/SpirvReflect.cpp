@@ -0,0 +1,443 @@
+#include "SpirvReflect.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <stdexcept>
+#include <string>
+
+// the few parts of spirv.h that are needed here.
+static const uint32_t SPIRV_MAGIC = 0x07230203;
+static const size_t SPIRV_HEADER_WORDS = 5;
+
+enum SpirvOp {
+	OpEntryPoint = 15,
+	OpTypeBool = 20,
+	OpTypeInt = 21,
+	OpTypeFloat = 22,
+	OpTypeVector = 23,
+	OpTypeMatrix = 24,
+	OpTypeImage = 25,
+	OpTypeSampler = 26,
+	OpTypeSampledImage = 27,
+	OpTypeArray = 28,
+	OpTypeRuntimeArray = 29,
+	OpTypeStruct = 30,
+	OpTypePointer = 32,
+	OpConstant = 43,
+	OpSpecConstantTrue = 48,
+	OpSpecConstantFalse = 49,
+	OpSpecConstant = 50,
+	OpFunction = 54,
+	OpVariable = 59,
+	OpDecorate = 71,
+	OpMemberDecorate = 72
+};
+
+enum SpirvDecoration {
+	DecorationSpecId = 1,
+	DecorationBlock = 2,
+	DecorationBufferBlock = 3,
+	DecorationArrayStride = 6,
+	DecorationMatrixStride = 7,
+	DecorationBuiltIn = 11,
+	DecorationLocation = 30,
+	DecorationBinding = 33,
+	DecorationDescriptorSet = 34,
+	DecorationOffset = 35
+};
+
+enum SpirvStorageClass {
+	StorageClassUniformConstant = 0,
+	StorageClassInput = 1,
+	StorageClassUniform = 2,
+	StorageClassPushConstant = 9,
+	StorageClassStorageBuffer = 12
+};
+
+enum SpirvExecutionModel {
+	ExecutionModelVertex = 0,
+	ExecutionModelTessellationControl = 1,
+	ExecutionModelTessellationEvaluation = 2,
+	ExecutionModelGeometry = 3,
+	ExecutionModelFragment = 4,
+	ExecutionModelGLCompute = 5
+};
+
+// OpTypeImage dimensions that aren't plain images.
+static const uint32_t DIM_BUFFER = 5;
+static const uint32_t DIM_SUBPASS_DATA = 6;
+
+namespace {
+
+// everything known about an id after the pass over the module.
+struct SpirvId {
+	uint32_t opcode = 0;
+	std::vector<uint32_t> operands;	// all of the declaring instruction, the result id included.
+	// decorations
+	bool hasLocation = false, hasSet = false, hasBinding = false, hasSpecId = false;
+	bool builtIn = false, block = false, bufferBlock = false;
+	uint32_t location = 0, set = 0, binding = 0, specId = 0, arrayStride = 0;
+	std::vector<uint32_t> memberOffsets;
+	std::vector<uint32_t> memberMatrixStrides;
+};
+
+struct Module {
+	std::unordered_map<uint32_t, SpirvId> ids;
+
+	const SpirvId& get(uint32_t id) const {
+		auto it = ids.find(id);
+		if (it == ids.end()) {
+			throw std::runtime_error("SPIR-V reflection: undefined id " + std::to_string(id) + "!");
+		}
+		return it->second;
+	}
+
+	uint32_t getConstant(uint32_t id) const {
+		const SpirvId& constant = get(id);
+		// operands: result type, result id, value.
+		if (constant.opcode != OpConstant || constant.operands.size() < 3) {
+			throw std::runtime_error("SPIR-V reflection: array length is not a constant!");
+		}
+		return constant.operands[2];
+	}
+
+	// bytes of a type in a buffer with explicit layout (push constants).
+	uint32_t getSize(uint32_t typeId, uint32_t matrixStride = 0) const {
+		const SpirvId& type = get(typeId);
+		switch (type.opcode) {
+		case OpTypeBool:
+			return 4;
+		case OpTypeInt:
+		case OpTypeFloat:
+			return type.operands[1] / 8;
+		case OpTypeVector:
+			return type.operands[2] * getSize(type.operands[1]);
+		case OpTypeMatrix:
+			// the columns are matrixStride apart.
+			return type.operands[2] * (matrixStride != 0 ? matrixStride : getSize(type.operands[1]));
+		case OpTypeArray:
+			return getConstant(type.operands[2]) * (type.arrayStride != 0 ? type.arrayStride : getSize(type.operands[1]));
+		case OpTypeStruct: {
+			uint32_t size = 0;
+			for (size_t i = 1; i < type.operands.size(); i++) {
+				uint32_t offset = i - 1 < type.memberOffsets.size() ? type.memberOffsets[i - 1] : 0;
+				uint32_t stride = i - 1 < type.memberMatrixStrides.size() ? type.memberMatrixStrides[i - 1] : 0;
+				size = std::max(size, offset + getSize(type.operands[i], stride));
+			}
+			return size;
+		}
+		default:
+			throw std::runtime_error("SPIR-V reflection: unsupported type in a push constant block!");
+		}
+	}
+
+	// the vertex attribute format of one location of an input.
+	VkFormat getInputFormat(uint32_t typeId) const {
+		const SpirvId& type = get(typeId);
+		uint32_t components = 1;
+		const SpirvId* scalar = &type;
+		if (type.opcode == OpTypeVector) {
+			components = type.operands[2];
+			scalar = &get(type.operands[1]);
+		}
+		if (scalar->opcode == OpTypeFloat && scalar->operands[1] == 32) {
+			const VkFormat formats[] = { VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT };
+			return formats[components - 1];
+		}
+		if (scalar->opcode == OpTypeInt && scalar->operands[1] == 32) {
+			bool isSigned = scalar->operands[2] != 0;
+			const VkFormat sintFormats[] = { VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT };
+			const VkFormat uintFormats[] = { VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT };
+			return isSigned ? sintFormats[components - 1] : uintFormats[components - 1];
+		}
+		throw std::runtime_error("SPIR-V reflection: unsupported vertex input type!");
+	}
+
+	// the descriptor type of a resource variable, the type is the one the pointer points to.
+	VkDescriptorType getDescriptorType(const SpirvId& type, uint32_t storageClass) const {
+		switch (type.opcode) {
+		case OpTypeStruct:
+			// before SPIR-V 1.3 a storage buffer is a Uniform block decorated as BufferBlock.
+			if (storageClass == StorageClassStorageBuffer || type.bufferBlock) {
+				return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			}
+			return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		case OpTypeSampler:
+			return VK_DESCRIPTOR_TYPE_SAMPLER;
+		case OpTypeSampledImage:
+			return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		case OpTypeImage: {
+			// operands: result id, sampled type, dim, depth, arrayed, MS, sampled (1 = used with a sampler, 2 = storage image).
+			uint32_t dim = type.operands[2];
+			uint32_t sampled = type.operands[6];
+			if (dim == DIM_SUBPASS_DATA) return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+			if (dim == DIM_BUFFER) return sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+			return sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+		}
+		default:
+			throw std::runtime_error("SPIR-V reflection: unsupported descriptor type!");
+		}
+	}
+};
+
+}
+
+ShaderReflection SpirvReflect::reflect(const uint32_t* code, size_t codeSize) {
+	size_t wordCount = codeSize / sizeof(uint32_t);
+	if (wordCount < SPIRV_HEADER_WORDS || code[0] != SPIRV_MAGIC) {
+		throw std::runtime_error("SPIR-V reflection: not a SPIR-V module!");
+	}
+
+	Module module;
+	std::vector<uint32_t> variables;
+	std::vector<uint32_t> specConstants;
+	ShaderReflection reflection;
+	bool hasEntryPoint = false;
+
+	for (size_t i = SPIRV_HEADER_WORDS; i < wordCount;) {
+		uint32_t opcode = code[i] & 0xffff;
+		uint32_t length = code[i] >> 16;
+		if (length == 0 || i + length > wordCount) {
+			throw std::runtime_error("SPIR-V reflection: corrupted instruction stream!");
+		}
+		const uint32_t* operands = code + i + 1;
+		uint32_t operandCount = length - 1;
+
+		switch (opcode) {
+		case OpEntryPoint:
+			// the first one, the pipeline stage uses "main" and the modules here only have one.
+			if (!hasEntryPoint) {
+				hasEntryPoint = true;
+				switch (operands[0]) {
+				case ExecutionModelVertex: reflection.stage = VK_SHADER_STAGE_VERTEX_BIT; break;
+				case ExecutionModelTessellationControl: reflection.stage = VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT; break;
+				case ExecutionModelTessellationEvaluation: reflection.stage = VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT; break;
+				case ExecutionModelGeometry: reflection.stage = VK_SHADER_STAGE_GEOMETRY_BIT; break;
+				case ExecutionModelFragment: reflection.stage = VK_SHADER_STAGE_FRAGMENT_BIT; break;
+				case ExecutionModelGLCompute: reflection.stage = VK_SHADER_STAGE_COMPUTE_BIT; break;
+				default: throw std::runtime_error("SPIR-V reflection: unsupported execution model!");
+				}
+			}
+			break;
+		case OpDecorate: {
+			SpirvId& target = module.ids[operands[0]];
+			uint32_t value = operandCount > 2 ? operands[2] : 0;
+			switch (operands[1]) {
+			case DecorationSpecId: target.hasSpecId = true; target.specId = value; break;
+			case DecorationBlock: target.block = true; break;
+			case DecorationBufferBlock: target.bufferBlock = true; break;
+			case DecorationArrayStride: target.arrayStride = value; break;
+			case DecorationBuiltIn: target.builtIn = true; break;
+			case DecorationLocation: target.hasLocation = true; target.location = value; break;
+			case DecorationBinding: target.hasBinding = true; target.binding = value; break;
+			case DecorationDescriptorSet: target.hasSet = true; target.set = value; break;
+			}
+			break;
+		}
+		case OpMemberDecorate: {
+			SpirvId& target = module.ids[operands[0]];
+			uint32_t member = operands[1];
+			uint32_t value = operandCount > 3 ? operands[3] : 0;
+			if (operands[2] == DecorationOffset) {
+				if (target.memberOffsets.size() <= member) target.memberOffsets.resize(member + 1, 0);
+				target.memberOffsets[member] = value;
+			} else if (operands[2] == DecorationMatrixStride) {
+				if (target.memberMatrixStrides.size() <= member) target.memberMatrixStrides.resize(member + 1, 0);
+				target.memberMatrixStrides[member] = value;
+			} else if (operands[2] == DecorationBuiltIn) {
+				// gl_PerVertex, a block of built-ins.
+				target.builtIn = true;
+			}
+			break;
+		}
+		case OpTypeBool:
+		case OpTypeInt:
+		case OpTypeFloat:
+		case OpTypeVector:
+		case OpTypeMatrix:
+		case OpTypeImage:
+		case OpTypeSampler:
+		case OpTypeSampledImage:
+		case OpTypeArray:
+		case OpTypeRuntimeArray:
+		case OpTypeStruct:
+		case OpTypePointer: {
+			// types: the result id comes first.
+			SpirvId& id = module.ids[operands[0]];
+			id.opcode = opcode;
+			id.operands.assign(operands, operands + operandCount);
+			break;
+		}
+		case OpConstant:
+		case OpSpecConstantTrue:
+		case OpSpecConstantFalse:
+		case OpSpecConstant:
+		case OpVariable: {
+			// result type, then the result id.
+			SpirvId& id = module.ids[operands[1]];
+			id.opcode = opcode;
+			id.operands.assign(operands, operands + operandCount);
+			if (opcode == OpVariable) {
+				variables.push_back(operands[1]);
+			} else if (opcode != OpConstant) {
+				specConstants.push_back(operands[1]);
+			}
+			break;
+		}
+		}
+
+		// the functions only have local variables, everything global is declared by now.
+		if (opcode == OpFunction) break;
+		i += length;
+	}
+
+	if (!hasEntryPoint) {
+		throw std::runtime_error("SPIR-V reflection: no entry point!");
+	}
+
+	for (uint32_t variableId : variables) {
+		const SpirvId& variable = module.get(variableId);
+		// operands: result type, result id, storage class.
+		uint32_t storageClass = variable.operands[2];
+		const SpirvId& pointer = module.get(variable.operands[0]);
+		uint32_t typeId = pointer.operands[2];
+		const SpirvId* type = &module.get(typeId);
+
+		if (storageClass == StorageClassInput) {
+			if (reflection.stage != VK_SHADER_STAGE_VERTEX_BIT || variable.builtIn || type->builtIn) continue;
+			if (!variable.hasLocation) {
+				throw std::runtime_error("SPIR-V reflection: vertex input without a location!");
+			}
+			// a matrix is one location per column.
+			uint32_t locationCount = 1;
+			if (type->opcode == OpTypeMatrix) {
+				locationCount = type->operands[2];
+				typeId = type->operands[1];
+			}
+			VkFormat format = module.getInputFormat(typeId);
+			for (uint32_t l = 0; l < locationCount; l++) {
+				reflection.inputs.push_back({ variable.location + l, format });
+			}
+		} else if (storageClass == StorageClassPushConstant) {
+			reflection.pushConstantSize = std::max(reflection.pushConstantSize, module.getSize(typeId));
+		} else if (storageClass == StorageClassUniform || storageClass == StorageClassUniformConstant ||
+			storageClass == StorageClassStorageBuffer) {
+			ShaderReflection::Binding binding = {};
+			binding.set = variable.set;
+			binding.binding = variable.binding;
+			binding.descriptorCount = 1;
+			// an array of resources is one binding with descriptorCount elements.
+			if (type->opcode == OpTypeArray) {
+				binding.descriptorCount = module.getConstant(type->operands[2]);
+				type = &module.get(type->operands[1]);
+			} else if (type->opcode == OpTypeRuntimeArray) {
+				throw std::runtime_error("SPIR-V reflection: runtime descriptor arrays are not supported!");
+			}
+			binding.descriptorType = module.getDescriptorType(*type, storageClass);
+			reflection.bindings.push_back(binding);
+		}
+	}
+
+	for (uint32_t constantId : specConstants) {
+		const SpirvId& constant = module.get(constantId);
+		if (!constant.hasSpecId) continue; // e.g. an OpSpecConstantOp result, not settable.
+		ShaderReflection::SpecConstant specConstant = {};
+		specConstant.constantID = constant.specId;
+		if (constant.opcode == OpSpecConstant) {
+			specConstant.size = module.getSize(constant.operands[0]);
+			specConstant.defaultValue = constant.operands.size() > 2 ? constant.operands[2] : 0;
+		} else {
+			specConstant.size = sizeof(VkBool32);
+			specConstant.defaultValue = constant.opcode == OpSpecConstantTrue ? 1 : 0;
+		}
+		reflection.specConstants.push_back(specConstant);
+	}
+
+	std::sort(reflection.inputs.begin(), reflection.inputs.end(),
+		[](const ShaderReflection::Input& a, const ShaderReflection::Input& b) { return a.location < b.location; });
+	return reflection;
+}
+
+void SpirvReflect::buildVertexInput(const ShaderReflection& vert, const std::vector<VertexStream>& streams,
+	std::vector<VkVertexInputBindingDescription>& bindings, std::vector<VkVertexInputAttributeDescription>& attributes) {
+	bindings.clear();
+	attributes.clear();
+	for (size_t s = 0; s < streams.size(); s++) {
+		VkVertexInputBindingDescription binding = {};
+		binding.binding = static_cast<uint32_t>(s);
+		binding.inputRate = streams[s].inputRate;
+		binding.stride = 0;
+		uint32_t lastLocation = s + 1 < streams.size() ? streams[s + 1].firstLocation : UINT32_MAX;
+		for (const ShaderReflection::Input& input : vert.inputs) {
+			if (input.location < streams[s].firstLocation || input.location >= lastLocation) continue;
+			VkVertexInputAttributeDescription attribute = {};
+			attribute.binding = binding.binding;
+			attribute.location = input.location;
+			attribute.format = input.format;
+			attribute.offset = binding.stride;
+			binding.stride += getFormatSize(input.format);
+			attributes.push_back(attribute);
+		}
+		bindings.push_back(binding);
+	}
+}
+
+std::vector<VkDescriptorSetLayoutBinding> SpirvReflect::getSetBindings(const std::vector<const ShaderReflection*>& stages, uint32_t set) {
+	std::vector<VkDescriptorSetLayoutBinding> result;
+	for (const ShaderReflection* stage : stages) {
+		for (const ShaderReflection::Binding& binding : stage->bindings) {
+			if (binding.set != set) continue;
+
+			auto it = std::find_if(result.begin(), result.end(),
+				[&binding](const VkDescriptorSetLayoutBinding& other) { return other.binding == binding.binding; });
+			if (it == result.end()) {
+				VkDescriptorSetLayoutBinding layoutBinding = {};
+				layoutBinding.binding = binding.binding;
+				layoutBinding.descriptorType = binding.descriptorType;
+				layoutBinding.descriptorCount = binding.descriptorCount;
+				layoutBinding.stageFlags = stage->stage;
+				result.push_back(layoutBinding);
+			} else if (it->descriptorType != binding.descriptorType || it->descriptorCount != binding.descriptorCount) {
+				throw std::runtime_error("SPIR-V reflection: set " + std::to_string(set) + " binding " +
+					std::to_string(binding.binding) + " is declared differently in two stages!");
+			} else {
+				it->stageFlags |= stage->stage;
+			}
+		}
+	}
+	std::sort(result.begin(), result.end(),
+		[](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) { return a.binding < b.binding; });
+	return result;
+}
+
+uint32_t SpirvReflect::getSetCount(const std::vector<const ShaderReflection*>& stages) {
+	uint32_t count = 0;
+	for (const ShaderReflection* stage : stages) {
+		for (const ShaderReflection::Binding& binding : stage->bindings) {
+			count = std::max(count, binding.set + 1);
+		}
+	}
+	return count;
+}
+
+std::vector<VkPushConstantRange> SpirvReflect::getPushConstantRanges(const std::vector<const ShaderReflection*>& stages) {
+	VkPushConstantRange range = {};
+	for (const ShaderReflection* stage : stages) {
+		if (stage->pushConstantSize == 0) continue;
+		range.stageFlags |= stage->stage;
+		range.size = std::max(range.size, stage->pushConstantSize);
+	}
+	std::vector<VkPushConstantRange> ranges;
+	if (range.size != 0) ranges.push_back(range);
+	return ranges;
+}
+
+uint32_t SpirvReflect::getFormatSize(VkFormat format) {
+	switch (format) {
+	case VK_FORMAT_R32_SFLOAT: case VK_FORMAT_R32_SINT: case VK_FORMAT_R32_UINT: return 4;
+	case VK_FORMAT_R32G32_SFLOAT: case VK_FORMAT_R32G32_SINT: case VK_FORMAT_R32G32_UINT: return 8;
+	case VK_FORMAT_R32G32B32_SFLOAT: case VK_FORMAT_R32G32B32_SINT: case VK_FORMAT_R32G32B32_UINT: return 12;
+	case VK_FORMAT_R32G32B32A32_SFLOAT: case VK_FORMAT_R32G32B32A32_SINT: case VK_FORMAT_R32G32B32A32_UINT: return 16;
+	default: throw std::runtime_error("SPIR-V reflection: unsupported vertex format!");
+	}
+}
@@ -0,0 +1,68 @@
+#ifndef __SPIRVREFLECT_H__
+#define __SPIRVREFLECT_H__
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <cstdint>
+
+// What a pipeline has to provide for a shader stage, read from its SPIR-V.
+struct ShaderReflection {
+	// one per location, a mat4 input takes 4 locations. Sorted by location.
+	struct Input {
+		uint32_t location;
+		VkFormat format;
+	};
+	struct Binding {
+		uint32_t set;
+		uint32_t binding;
+		VkDescriptorType descriptorType;
+		uint32_t descriptorCount;
+	};
+	struct SpecConstant {
+		uint32_t constantID;
+		uint32_t size;			// of the value in VkSpecializationInfo, a bool is a VkBool32.
+		uint32_t defaultValue;	// the low 32 bits.
+	};
+
+	VkShaderStageFlagBits stage = VK_SHADER_STAGE_VERTEX_BIT;
+	std::vector<Input> inputs;	// vertex stage only, the other stages get theirs from the previous one.
+	std::vector<Binding> bindings;
+	uint32_t pushConstantSize = 0;	// 0: no push constants.
+	std::vector<SpecConstant> specConstants;
+};
+
+// A small SPIR-V parser, just enough to derive the vertex input state and the pipeline 
+// layout from the shaders, instead of writing them by hand next to the GLSL.
+//
+// SPIR-V is a stream of instructions, each one starts with a word (word count << 16) | opcode.
+// The types, decorations and global variables are all declared before the first function,
+// so one pass over the module gives everything: a variable points to a pointer type, which
+// points to the type of the data, and the decorations give its location or set/binding.
+class SpirvReflect {
+public:
+	// throws if the code is not valid SPIR-V, or uses something this parser doesn't know.
+	static ShaderReflection reflect(const uint32_t* code, size_t codeSize);
+
+	// the vertex input state for the inputs of a vertex shader: stream i is binding i, it gets 
+	// the locations from its firstLocation up to the next stream's, tightly packed in location order.
+	struct VertexStream {
+		VkVertexInputRate inputRate;
+		uint32_t firstLocation;
+	};
+	static void buildVertexInput(const ShaderReflection& vert, const std::vector<VertexStream>& streams,
+		std::vector<VkVertexInputBindingDescription>& bindings, std::vector<VkVertexInputAttributeDescription>& attributes);
+
+	// the bindings of a descriptor set over all the stages of a pipeline. Throws if two stages
+	// declare the same binding differently.
+	static std::vector<VkDescriptorSetLayoutBinding> getSetBindings(const std::vector<const ShaderReflection*>& stages, uint32_t set);
+	// number of descriptor sets the pipeline layout needs (highest set + 1).
+	static uint32_t getSetCount(const std::vector<const ShaderReflection*>& stages);
+	// a single range over all the stages that use push constants, empty if none does.
+	static std::vector<VkPushConstantRange> getPushConstantRanges(const std::vector<const ShaderReflection*>& stages);
+
+	static uint32_t getFormatSize(VkFormat format);
+};
+
+#endif
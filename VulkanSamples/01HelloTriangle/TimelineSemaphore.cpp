@@ -0,0 +1,81 @@
+#include "TimelineSemaphore.h"
+
+#include <limits>
+#include <stdexcept>
+
+void TimelineSemaphore::init(VkDevice device) {
+	this->device = device;
+	lastSignaled = 0;
+	completed = 0;
+
+#ifdef VK_KHR_timeline_semaphore
+	pfnGetSemaphoreCounterValue = (PFN_vkGetSemaphoreCounterValueKHR)vkGetDeviceProcAddr(device, "vkGetSemaphoreCounterValueKHR");
+	pfnWaitSemaphores = (PFN_vkWaitSemaphoresKHR)vkGetDeviceProcAddr(device, "vkWaitSemaphoresKHR");
+	if (pfnGetSemaphoreCounterValue == nullptr || pfnWaitSemaphores == nullptr) {
+		throw std::runtime_error("failed to load the timeline semaphore commands!");
+	}
+
+	VkSemaphoreTypeCreateInfoKHR typeInfo = {};
+	typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+	typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+	typeInfo.initialValue = 0;
+
+	VkSemaphoreCreateInfo semaphoreInfo = {};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreInfo.pNext = &typeInfo;
+	if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create timeline semaphore!");
+	}
+#else
+	throw std::runtime_error("timeline semaphores need newer Vulkan headers!");
+#endif
+}
+
+void TimelineSemaphore::destroy() {
+	vkDestroySemaphore(device, semaphore, nullptr);
+	semaphore = VK_NULL_HANDLE;
+}
+
+bool TimelineSemaphore::isCompleted(uint64_t value) {
+	if (value <= completed) return true;
+	return value <= getCompleted();
+}
+
+uint64_t TimelineSemaphore::getCompleted() {
+#ifdef VK_KHR_timeline_semaphore
+	uint64_t counter = 0;
+	if (pfnGetSemaphoreCounterValue(device, semaphore, &counter) != VK_SUCCESS) {
+		throw std::runtime_error("failed to read timeline semaphore!");
+	}
+	completed = counter;
+#endif
+	return completed;
+}
+
+void TimelineSemaphore::wait(uint64_t value) {
+	if (isCompleted(value)) return;
+
+#ifdef VK_KHR_timeline_semaphore
+	VkSemaphoreWaitInfoKHR waitInfo = {};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &semaphore;
+	waitInfo.pValues = &value;
+	if (pfnWaitSemaphores(device, &waitInfo, std::numeric_limits<uint64_t>::max()) != VK_SUCCESS) {
+		throw std::runtime_error("failed to wait for timeline semaphore!");
+	}
+	completed = value;
+#endif
+}
+
+void TimelineSubmitInfo::attach(VkSubmitInfo& submitInfo) {
+#ifdef VK_KHR_timeline_semaphore
+	info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+	info.pNext = submitInfo.pNext;
+	info.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+	info.pWaitSemaphoreValues = waitValues.data();
+	info.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+	info.pSignalSemaphoreValues = signalValues.data();
+	submitInfo.pNext = &info;
+#endif
+}
@@ -0,0 +1,66 @@
+#ifndef __TIMELINESEMAPHORE_H__
+#define __TIMELINESEMAPHORE_H__
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <cstdint>
+
+// A VK_KHR_timeline_semaphore (core in Vulkan 1.2): a 64 bit counter that only goes up.
+// Every submit on the queue it belongs to signals the next value, so one semaphore
+// replaces the fence per frame, per upload batch, ...: "is the work of submit N done"
+// is "counter >= N", and the CPU can wait for exactly that value.
+//
+// Only one queue may signal it, otherwise the values would not be signaled in order.
+//
+// usage:
+//		submit:		value = nextValue(); signal get() with value, see TimelineSubmitInfo.
+//		CPU side:	isCompleted(value) to poll, wait(value) to block.
+class TimelineSemaphore {
+public:
+	// the device must have VK_KHR_timeline_semaphore and its feature enabled.
+	void init(VkDevice device);
+	// the GPU must be done with it.
+	void destroy();
+
+	VkSemaphore get() const { return semaphore; }
+	// the value for the next submit, higher than every value handed out before.
+	uint64_t nextValue() { return ++lastSignaled; }
+	// the value of the last submit, waiting for it waits for everything submitted so far.
+	uint64_t getLastSignaled() const { return lastSignaled; }
+	// the counter is only queried while value is ahead of what was seen completed before. 0 is always completed.
+	bool isCompleted(uint64_t value);
+	// the current value of the counter, everything signaled up to it has finished.
+	uint64_t getCompleted();
+	void wait(uint64_t value);
+
+private:
+	VkDevice device = VK_NULL_HANDLE;
+	VkSemaphore semaphore = VK_NULL_HANDLE;
+	uint64_t lastSignaled = 0;
+	uint64_t completed = 0;
+#ifdef VK_KHR_timeline_semaphore
+	// extension commands, not exported by the loader.
+	PFN_vkGetSemaphoreCounterValueKHR pfnGetSemaphoreCounterValue = nullptr;
+	PFN_vkWaitSemaphoresKHR pfnWaitSemaphores = nullptr;
+#endif
+};
+
+// the values of the semaphores of one VkSubmitInfo, in the same order as its semaphores.
+// Binary semaphores (acquire/present) can be mixed in, their value is ignored (0).
+class TimelineSubmitInfo {
+public:
+	std::vector<uint64_t> waitValues;
+	std::vector<uint64_t> signalValues;
+
+	// chain the values into submitInfo.pNext, the vectors must not change until the submit.
+	void attach(VkSubmitInfo& submitInfo);
+
+private:
+#ifdef VK_KHR_timeline_semaphore
+	VkTimelineSemaphoreSubmitInfoKHR info = {};
+#endif
+};
+
+#endif
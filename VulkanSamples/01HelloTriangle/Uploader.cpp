@@ -0,0 +1,318 @@
+#include "Uploader.h"
+
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+// staging offsets are kept 16 bytes aligned, good enough for any vertex or index data.
+static const VkDeviceSize STAGING_ALIGNMENT = 16;
+
+void Uploader::init(VkDevice device, MemoryAllocator* allocator, uint32_t transferFamily, VkQueue transferQueue,
+	uint32_t graphicsFamily, VkDeviceSize ringSize, TimelineSemaphore* timeline) {
+	this->device = device;
+	this->allocator = allocator;
+	this->transferFamily = transferFamily;
+	this->transferQueue = transferQueue;
+	this->graphicsFamily = graphicsFamily;
+	this->ringSize = ringSize;
+	this->timeline = timeline;
+
+	// the batches are re-recorded, so each command buffer has to be resettable on its own.
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	poolInfo.queueFamilyIndex = transferFamily;
+	if (vkCreateCommandPool(device, &poolInfo, nullptr, &transferCommandPool) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create transfer command pool!");
+	}
+	poolInfo.queueFamilyIndex = graphicsFamily;
+	if (vkCreateCommandPool(device, &poolInfo, nullptr, &acquireCommandPool) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create acquire command pool!");
+	}
+
+	// written by the CPU, read once by the copy, so HOST_COHERENT is the right choice.
+	allocator->createBuffer(ringSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		ringBuffer, ringMemory);
+}
+
+void Uploader::destroy() {
+	for (auto& batch : batches) {
+		vkDestroySemaphore(device, batch->semaphore, nullptr);
+		vkDestroyFence(device, batch->fence, nullptr);
+	}
+	batches.clear();
+	inFlight.clear();
+	openBatch = nullptr;
+
+	// also frees the command buffers of the batches.
+	vkDestroyCommandPool(device, transferCommandPool, nullptr);
+	vkDestroyCommandPool(device, acquireCommandPool, nullptr);
+	allocator->destroyBuffer(ringBuffer, ringMemory);
+}
+
+void Uploader::upload(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size,
+	VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+	// before getting the batch: making room in the ring may have to flush the open batch.
+	VkDeviceSize ringBytes = 0;
+	VkDeviceSize srcOffset = allocateStaging(size, ringBytes);
+	memcpy(static_cast<char*>(ringMemory.mapped) + srcOffset, data, static_cast<size_t>(size));
+
+	if (openBatch == nullptr) {
+		openBatch = getFreeBatch();
+	}
+	Batch* batch = openBatch;
+	batch->ringBytes += ringBytes;
+	batch->dstStages |= dstStage;
+
+	VkBufferCopy copyRegion = {};
+	copyRegion.srcOffset = srcOffset;
+	copyRegion.dstOffset = dstOffset;
+	copyRegion.size = size;
+	vkCmdCopyBuffer(batch->transferCommandBuffer, ringBuffer, dstBuffer, 1, &copyRegion);
+
+	if (transferFamily != graphicsFamily) {
+		// release: the same barrier is recorded on both queues, with the access masks
+		// of the respective side. The release has no destination access, the acquire no source access.
+		VkBufferMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = 0;
+		barrier.srcQueueFamilyIndex = transferFamily;
+		barrier.dstQueueFamilyIndex = graphicsFamily;
+		barrier.buffer = dstBuffer;
+		barrier.offset = dstOffset;
+		barrier.size = size;
+		vkCmdPipelineBarrier(batch->transferCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = dstAccess;
+		batch->acquireBarriers.push_back(barrier);
+	}
+	// on the same queue family the semaphore alone makes the copy visible to dstStage.
+}
+
+void Uploader::flush() {
+	if (openBatch == nullptr) return;
+
+	Batch* batch = openBatch;
+	openBatch = nullptr;
+
+	if (vkEndCommandBuffer(batch->transferCommandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to record transfer command buffer!");
+	}
+
+	if (!batch->acquireBarriers.empty()) {
+		VkCommandBufferBeginInfo beginInfo = {};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		vkBeginCommandBuffer(batch->acquireCommandBuffer, &beginInfo);
+		// the semaphore is waited at dstStages, the acquire has to happen-after it, and before the use.
+		vkCmdPipelineBarrier(batch->acquireCommandBuffer, batch->dstStages, batch->dstStages,
+			0, 0, nullptr, static_cast<uint32_t>(batch->acquireBarriers.size()), batch->acquireBarriers.data(), 0, nullptr);
+		if (vkEndCommandBuffer(batch->acquireCommandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to record acquire command buffer!");
+		}
+	}
+
+	// the whole ring is coherent, this is a no-op unless the allocator picked a non coherent type.
+	allocator->flush(ringMemory);
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &batch->transferCommandBuffer;
+	submitInfo.signalSemaphoreCount = 1;
+
+	VkSemaphore timelineSemaphore = VK_NULL_HANDLE;
+	TimelineSubmitInfo timelineInfo;
+	if (timeline != nullptr) {
+		timelineSemaphore = timeline->get();
+		batch->timelineValue = timeline->nextValue();
+		timelineInfo.signalValues.push_back(batch->timelineValue);
+		timelineInfo.attach(submitInfo);
+		submitInfo.pSignalSemaphores = &timelineSemaphore;
+	} else {
+		submitInfo.pSignalSemaphores = &batch->semaphore;
+		vkResetFences(device, 1, &batch->fence);
+	}
+
+	if (vkQueueSubmit(transferQueue, 1, &submitInfo, batch->fence) != VK_SUCCESS) {
+		throw std::runtime_error("failed to submit transfer command buffer!");
+	}
+
+	batch->ringEnd = head;
+	batch->state = BATCH_SUBMITTED;
+	inFlight.push_back(batch);
+}
+
+void Uploader::beginFrame(uint32_t frameSlot) {
+	retireTransfers(false);
+
+	for (auto& batch : batches) {
+		if (batch->state == BATCH_SUBMITTED && batch->consumed && batch->frameSlot == frameSlot) {
+			batch->graphicsDone = true;
+			tryRecycle(batch.get());
+		}
+	}
+}
+
+void Uploader::addFrameWork(uint32_t frameSlot, std::vector<VkSemaphore>& waitSemaphores,
+	std::vector<VkPipelineStageFlags>& waitStages, std::vector<uint64_t>& waitValues,
+	std::vector<VkCommandBuffer>& commandBuffers) {
+	for (auto& batch : batches) {
+		if (batch->state != BATCH_SUBMITTED || batch->consumed) continue;
+
+		// only the stages that read the uploaded buffers wait, the rest of the frame
+		// (e.g. clearing the attachments) can overlap with the copies.
+		if (timeline != nullptr) {
+			waitSemaphores.push_back(timeline->get());
+			waitValues.push_back(batch->timelineValue);
+		} else {
+			waitSemaphores.push_back(batch->semaphore);
+			waitValues.push_back(0);
+		}
+		waitStages.push_back(batch->dstStages);
+		if (!batch->acquireBarriers.empty()) {
+			commandBuffers.push_back(batch->acquireCommandBuffer);
+		}
+		batch->consumed = true;
+		batch->frameSlot = frameSlot;
+	}
+}
+
+Uploader::Batch* Uploader::getFreeBatch() {
+	Batch* batch = nullptr;
+	for (auto& candidate : batches) {
+		if (candidate->state == BATCH_FREE) {
+			batch = candidate.get();
+			break;
+		}
+	}
+
+	if (batch == nullptr) {
+		std::unique_ptr<Batch> newBatch(new Batch());
+
+		VkCommandBufferAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+		allocInfo.commandPool = transferCommandPool;
+		if (vkAllocateCommandBuffers(device, &allocInfo, &newBatch->transferCommandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate transfer command buffer!");
+		}
+		allocInfo.commandPool = acquireCommandPool;
+		if (vkAllocateCommandBuffers(device, &allocInfo, &newBatch->acquireCommandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate acquire command buffer!");
+		}
+
+		// with a timeline, its values take the place of both.
+		VkSemaphoreCreateInfo semaphoreInfo = {};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		VkFenceCreateInfo fenceInfo = {};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		if (timeline == nullptr && (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &newBatch->semaphore) != VK_SUCCESS ||
+			vkCreateFence(device, &fenceInfo, nullptr, &newBatch->fence) != VK_SUCCESS)) {
+			throw std::runtime_error("failed to create synchronization objects for an upload!");
+		}
+
+		batch = newBatch.get();
+		batches.push_back(std::move(newBatch));
+	}
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(batch->transferCommandBuffer, &beginInfo);
+
+	batch->state = BATCH_OPEN;
+	return batch;
+}
+
+// find size bytes in the ring, ringBytes also counts the padding skipped at the end of the ring.
+VkDeviceSize Uploader::allocateStaging(VkDeviceSize size, VkDeviceSize& ringBytes) {
+	size = (size + STAGING_ALIGNMENT - 1) / STAGING_ALIGNMENT * STAGING_ALIGNMENT;
+	if (size > ringSize) {
+		throw std::runtime_error("upload is bigger than the staging ring!");
+	}
+
+	for (;;) {
+		retireTransfers(false);
+		if (ringUsed == 0) {
+			head = tail = 0;
+		}
+
+		// free space: [head, ringSize) + [0, tail) if head >= tail, [head, tail) otherwise.
+		bool fits = false;
+		VkDeviceSize offset = 0;
+		VkDeviceSize padding = 0;
+		if (ringUsed == 0 || head > tail) {
+			if (head + size <= ringSize) {
+				offset = head;
+				fits = true;
+			} else if (size <= tail) {
+				padding = ringSize - head;
+				offset = 0;
+				fits = true;
+			}
+		} else if (head < tail && head + size <= tail) {
+			offset = head;
+			fits = true;
+		}
+
+		if (fits) {
+			head = offset + size;
+			ringUsed += size + padding;
+			ringBytes += size + padding;
+			return offset;
+		}
+
+		// the ring is full, the only way out is waiting for the oldest copies.
+		// That is the stall a bigger ring avoids.
+		if (!inFlight.empty()) {
+			retireTransfers(true);
+		} else if (openBatch != nullptr) {
+			flush();
+		} else {
+			throw std::runtime_error("staging ring is corrupted!");
+		}
+	}
+}
+
+// give the staging memory of finished transfers back to the ring, in submission order.
+void Uploader::retireTransfers(bool waitOldest) {
+	while (!inFlight.empty()) {
+		Batch* batch = inFlight.front();
+		if (waitOldest) {
+			if (timeline != nullptr) {
+				timeline->wait(batch->timelineValue);
+			} else {
+				vkWaitForFences(device, 1, &batch->fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+			}
+			waitOldest = false;
+		} else if (timeline != nullptr ? !timeline->isCompleted(batch->timelineValue) : vkGetFenceStatus(device, batch->fence) != VK_SUCCESS) {
+			break;
+		}
+
+		tail = batch->ringEnd;
+		ringUsed -= batch->ringBytes;
+		batch->transferDone = true;
+		inFlight.pop_front();
+		tryRecycle(batch);
+	}
+}
+
+void Uploader::tryRecycle(Batch* batch) {
+	if (!batch->transferDone || !batch->consumed || !batch->graphicsDone) return;
+
+	batch->state = BATCH_FREE;
+	batch->acquireBarriers.clear();
+	batch->dstStages = 0;
+	batch->ringBytes = 0;
+	batch->ringEnd = 0;
+	batch->timelineValue = 0;
+	batch->transferDone = false;
+	batch->consumed = false;
+	batch->graphicsDone = false;
+}
@@ -0,0 +1,105 @@
+#ifndef __UPLOADER_H__
+#define __UPLOADER_H__
+
+#include "MemoryAllocator.h"
+#include "TimelineSemaphore.h"
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <cstdint>
+
+// Copies data into DEVICE_LOCAL buffers without blocking the rendering.
+//
+// The data is written into a persistently mapped staging ring buffer, and the
+// copies are recorded into a batch that is submitted on the transfer queue.
+// With a transfer-only queue family (a DMA engine on most discrete GPUs) the
+// copies run in parallel to rendering. The buffers are VK_SHARING_MODE_EXCLUSIVE,
+// so their ownership is released by the transfer queue and acquired by the
+// graphics queue, and a semaphore orders the two.
+//
+// The graphics side of a batch is not submitted by itself: addFrameWork() adds the
+// semaphore wait and the acquire command buffer to the next frame's vkQueueSubmit.
+//
+// With a timeline (the transfer queue's TimelineSemaphore), every batch signals the next
+// value of it instead of its own fence and semaphore. The graphics queue waits for that
+// value, and the staging memory is reused as soon as the counter reaches it.
+//
+// usage:
+//		upload(...); upload(...); flush();
+//		per frame:	beginFrame(slot) after the frame's fence, addFrameWork(slot, ...) for its submit.
+class Uploader {
+public:
+	// timeline: signaled by the transfer queue only, nullptr for a fence and a semaphore per batch.
+	void init(VkDevice device, MemoryAllocator* allocator, uint32_t transferFamily, VkQueue transferQueue,
+		uint32_t graphicsFamily, VkDeviceSize ringSize, TimelineSemaphore* timeline = nullptr);
+	// the device must be idle.
+	void destroy();
+
+	// copy size bytes of data to dstBuffer at dstOffset. dstStage/dstAccess describe
+	// how the graphics queue uses the buffer, e.g. VK_PIPELINE_STAGE_VERTEX_INPUT_BIT/VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT.
+	void upload(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size,
+		VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+	// submit the recorded copies on the transfer queue.
+	void flush();
+
+	// frameSlot's previous frame has finished on the GPU.
+	void beginFrame(uint32_t frameSlot);
+	// add the graphics queue work of every flushed batch to the submit of frameSlot.
+	// waitValues: the timeline value of each wait semaphore, 0 for the binary ones.
+	void addFrameWork(uint32_t frameSlot, std::vector<VkSemaphore>& waitSemaphores,
+		std::vector<VkPipelineStageFlags>& waitStages, std::vector<uint64_t>& waitValues,
+		std::vector<VkCommandBuffer>& commandBuffers);
+
+private:
+	enum BatchState {
+		BATCH_FREE,
+		BATCH_OPEN,		// recording copies
+		BATCH_SUBMITTED	// until both queues are done with it
+	};
+
+	struct Batch {
+		BatchState state = BATCH_FREE;
+		VkCommandBuffer transferCommandBuffer = VK_NULL_HANDLE;
+		VkCommandBuffer acquireCommandBuffer = VK_NULL_HANDLE; // graphics queue, ownership acquire.
+		VkSemaphore semaphore = VK_NULL_HANDLE; // transfer -> graphics
+		VkFence fence = VK_NULL_HANDLE; // transfer done, the staging memory can be reused.
+		uint64_t timelineValue = 0; // with a timeline instead of semaphore and fence.
+		std::vector<VkBufferMemoryBarrier> acquireBarriers;
+		VkPipelineStageFlags dstStages = 0;
+		VkDeviceSize ringBytes = 0; // staging bytes incl. the padding at the end of the ring.
+		VkDeviceSize ringEnd = 0;
+		bool transferDone = false;
+		bool consumed = false; // handed to the frame in frameSlot
+		bool graphicsDone = false;
+		uint32_t frameSlot = 0;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	MemoryAllocator* allocator = nullptr;
+	uint32_t transferFamily = 0;
+	uint32_t graphicsFamily = 0;
+	VkQueue transferQueue = VK_NULL_HANDLE;
+	TimelineSemaphore* timeline = nullptr;
+	VkCommandPool transferCommandPool = VK_NULL_HANDLE;
+	VkCommandPool acquireCommandPool = VK_NULL_HANDLE;
+
+	// staging ring: [tail, head) is in use by batches, in submission order.
+	VkBuffer ringBuffer = VK_NULL_HANDLE;
+	MemoryAllocator::Allocation ringMemory;
+	VkDeviceSize ringSize = 0;
+	VkDeviceSize head = 0;
+	VkDeviceSize tail = 0;
+	VkDeviceSize ringUsed = 0;
+
+	std::vector<std::unique_ptr<Batch>> batches;
+	Batch* openBatch = nullptr;
+	std::deque<Batch*> inFlight; // submitted, transfer not done yet, oldest first.
+
+	Batch* getFreeBatch();
+	VkDeviceSize allocateStaging(VkDeviceSize size, VkDeviceSize& ringBytes);
+	void retireTransfers(bool waitOldest);
+	void tryRecycle(Batch* batch);
+};
+
+#endif
@@ -1,18 +1,246 @@
 #include "01HelloTriangle.h"
 #include "01HelloTriangleExt.h"
+#include "01HelloTriangleHeadless.h"
+#include "Benchmark.h"
 
 #include <iostream>
+#include <string>
+#include <cstdlib>
+#include <memory>
+
+static void printUsage() {
+	std::cout << "usage: 01HelloTriangle [options]" << std::endl;
+	std::cout << "\t--frames-in-flight N\tframes the CPU may run ahead of the GPU (default " << MAX_FRAMES_IN_FLIGHT << ")" << std::endl;
+	std::cout << "\t--headless\t\trender offscreen, no window or swap chain" << std::endl;
+	std::cout << "\t--frames N\t\tstop after N frames (headless default 100)" << std::endl;
+	std::cout << "\t--readback\t\theadless: copy every frame back to host memory" << std::endl;
+	std::cout << "\t--dump FILE\t\theadless: write the last frame as a .ppm" << std::endl;
+	std::cout << "\t--device TYPE\t\tdiscrete (default), gpu (any, GPUs first) or cpu" << std::endl;
+	std::cout << "\t--draws N\t\tnumber of draw calls per frame (default 1)" << std::endl;
+	std::cout << "\t--instances N\t\tinstances per draw call, 1 to 1000000 (default 1)" << std::endl;
+	std::cout << "\t--materials N\t\tpipeline variants the draws cycle through, 1 to " << MAX_MATERIALS << " (default 1)" << std::endl;
+	std::cout << "\t--per-draw MODE\t\twhere the transform of a draw comes from: ubo (dynamic offset, default), push (push constants) or ssbo (index into a storage buffer)" << std::endl;
+	std::cout << "\t--msaa N\t\tsamples per pixel, resolved into the swap chain image (default 1)" << std::endl;
+	std::cout << "\t--depth\t\t\tdepth test against a transient depth buffer" << std::endl;
+	std::cout << "\t--render-graph\t\tbuild the frame as a render graph: scheduled barriers and layouts, aliased transient images" << std::endl;
+	std::cout << "\t--hot-reload\t\trecompile and swap the shaders when they are saved (Linux, needs --record frame or threads)" << std::endl;
+	std::cout << "\t--shader-dir DIR\tshader sources for --hot-reload (default shaders)" << std::endl;
+	std::cout << "\t--gpu-cull\t\tcull the instances in a compute shader, drawn with one indirect draw per visible instance" << std::endl;
+	std::cout << "\t--async-compute\t\twith --gpu-cull: cull on the compute queue, overlapped with the previous frame" << std::endl;
+	std::cout << "\t--timeline\t\tretire frames, uploads and cull passes with timeline semaphores instead of fences (VK_KHR_timeline_semaphore)" << std::endl;
+	std::cout << "\t--host-allocs\t\ttrack the host memory the driver allocates (VkAllocationCallbacks), printed per scope at exit" << std::endl;
+	std::cout << "\t--command-arena KB\twith --host-allocs: serve the COMMAND scope allocations from an arena reset every frame" << std::endl;
+	std::cout << "\t--present MODE\t\tlatency (MAILBOX, default), power (FIFO) or uncapped (IMMEDIATE)" << std::endl;
+	std::cout << "\t--fps-limit N\t\tlimit the frame rate, the CPU sleeps before polling the input" << std::endl;
+	std::cout << "\t--record MODE\t\tstatic (pre-recorded, default), frame (every frame) or threads (every frame, secondaries on worker threads)" << std::endl;
+	std::cout << "\t--threads N\t\tworker threads for --record threads (default: one per core)" << std::endl;
+	std::cout << "\t--benchmark NAME\trun headless benchmarks and print a table: record, instances, cull, perdraw, msaa" << std::endl;
+}
+
+static bool parseOptions(int argc, char* argv[], AppOptions& options, std::string& benchmark) {
+	bool deviceGiven = false;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--frames-in-flight" && i + 1 < argc) {
+			options.framesInFlight = atoi(argv[++i]);
+			if (options.framesInFlight < 1) {
+				std::cerr << "--frames-in-flight must be >= 1" << std::endl;
+				return false;
+			}
+		} else if (arg == "--headless") {
+			options.headless = true;
+		} else if (arg == "--frames" && i + 1 < argc) {
+			options.frameCount = atoi(argv[++i]);
+			if (options.frameCount < 1) {
+				std::cerr << "--frames must be >= 1" << std::endl;
+				return false;
+			}
+		} else if (arg == "--readback") {
+			options.readbackEveryFrame = true;
+		} else if (arg == "--dump" && i + 1 < argc) {
+			options.dumpFile = argv[++i];
+		} else if (arg == "--device" && i + 1 < argc) {
+			std::string type = argv[++i];
+			if (type == "discrete") {
+				options.devicePolicy = DEVICE_DISCRETE_ONLY;
+			} else if (type == "gpu") {
+				options.devicePolicy = DEVICE_PREFER_GPU;
+			} else if (type == "cpu") {
+				options.devicePolicy = DEVICE_CPU_ONLY;
+			} else {
+				std::cerr << "unknown device type: " << type << std::endl;
+				return false;
+			}
+			deviceGiven = true;
+		} else if (arg == "--draws" && i + 1 < argc) {
+			options.drawCount = atoi(argv[++i]);
+			if (options.drawCount < 1) {
+				std::cerr << "--draws must be >= 1" << std::endl;
+				return false;
+			}
+		} else if (arg == "--instances" && i + 1 < argc) {
+			options.instanceCount = atoi(argv[++i]);
+			if (options.instanceCount < 1 || options.instanceCount > 1000000) {
+				std::cerr << "--instances must be between 1 and 1000000" << std::endl;
+				return false;
+			}
+		} else if (arg == "--materials" && i + 1 < argc) {
+			options.materialCount = atoi(argv[++i]);
+			if (options.materialCount < 1 || options.materialCount > MAX_MATERIALS) {
+				std::cerr << "--materials must be between 1 and " << MAX_MATERIALS << std::endl;
+				return false;
+			}
+		} else if (arg == "--per-draw" && i + 1 < argc) {
+			std::string mode = argv[++i];
+			if (mode == "ubo") {
+				options.perDrawMode = PER_DRAW_UNIFORM_BUFFER;
+			} else if (mode == "push") {
+				options.perDrawMode = PER_DRAW_PUSH_CONSTANTS;
+			} else if (mode == "ssbo") {
+				options.perDrawMode = PER_DRAW_STORAGE_BUFFER;
+			} else {
+				std::cerr << "unknown per draw mode: " << mode << std::endl;
+				return false;
+			}
+		} else if (arg == "--msaa" && i + 1 < argc) {
+			options.sampleCount = atoi(argv[++i]);
+			if (options.sampleCount < 1 || options.sampleCount > 64 || (options.sampleCount & (options.sampleCount - 1)) != 0) {
+				std::cerr << "--msaa must be a power of two between 1 and 64" << std::endl;
+				return false;
+			}
+		} else if (arg == "--depth") {
+			options.depthBuffer = true;
+		} else if (arg == "--render-graph") {
+			options.renderGraph = true;
+		} else if (arg == "--hot-reload") {
+			options.hotReload = true;
+		} else if (arg == "--shader-dir" && i + 1 < argc) {
+			options.shaderDirectory = argv[++i];
+		} else if (arg == "--gpu-cull") {
+			options.gpuCulling = true;
+		} else if (arg == "--async-compute") {
+			options.asyncCompute = true;
+		} else if (arg == "--timeline") {
+			options.timelineSemaphores = true;
+		} else if (arg == "--host-allocs") {
+			options.trackHostAllocations = true;
+		} else if (arg == "--command-arena" && i + 1 < argc) {
+			int kilobytes = atoi(argv[++i]);
+			if (kilobytes < 1) {
+				std::cerr << "--command-arena must be >= 1" << std::endl;
+				return false;
+			}
+			options.commandArenaSize = static_cast<size_t>(kilobytes) * 1024;
+		} else if (arg == "--present" && i + 1 < argc) {
+			std::string mode = argv[++i];
+			if (mode == "latency") {
+				options.presentPolicy = PRESENT_LOW_LATENCY;
+			} else if (mode == "power") {
+				options.presentPolicy = PRESENT_POWER_SAVING;
+			} else if (mode == "uncapped") {
+				options.presentPolicy = PRESENT_UNCAPPED;
+			} else {
+				std::cerr << "unknown present mode: " << mode << std::endl;
+				return false;
+			}
+		} else if (arg == "--fps-limit" && i + 1 < argc) {
+			options.frameRateLimit = atof(argv[++i]);
+			if (options.frameRateLimit <= 0.0) {
+				std::cerr << "--fps-limit must be > 0" << std::endl;
+				return false;
+			}
+		} else if (arg == "--record" && i + 1 < argc) {
+			std::string mode = argv[++i];
+			if (mode == "static") {
+				options.recordMode = RECORD_STATIC;
+			} else if (mode == "frame") {
+				options.recordMode = RECORD_PER_FRAME;
+			} else if (mode == "threads") {
+				options.recordMode = RECORD_THREADED;
+			} else {
+				std::cerr << "unknown record mode: " << mode << std::endl;
+				return false;
+			}
+		} else if (arg == "--benchmark" && i + 1 < argc) {
+			benchmark = argv[++i];
+			options.headless = true;
+		} else if (arg == "--threads" && i + 1 < argc) {
+			options.recordThreads = atoi(argv[++i]);
+			if (options.recordThreads < 1) {
+				std::cerr << "--threads must be >= 1" << std::endl;
+				return false;
+			}
+		} else {
+			std::cerr << "unknown option: " << arg << std::endl;
+			return false;
+		}
+	}
+	// headless machines rarely have a discrete GPU, take whatever is there.
+	if (options.headless && !deviceGiven) {
+		options.devicePolicy = DEVICE_PREFER_GPU;
+	}
+	if (!options.headless && (options.readbackEveryFrame || !options.dumpFile.empty())) {
+		std::cerr << "--readback and --dump need --headless" << std::endl;
+		return false;
+	}
+	if (options.asyncCompute && !options.gpuCulling) {
+		std::cerr << "--async-compute needs --gpu-cull" << std::endl;
+		return false;
+	}
+	if (options.commandArenaSize > 0 && !options.trackHostAllocations) {
+		std::cerr << "--command-arena needs --host-allocs" << std::endl;
+		return false;
+	}
+	// pre-recorded command buffers would keep using the old pipelines.
+	if (options.hotReload && options.recordMode == RECORD_STATIC) {
+		std::cerr << "--hot-reload needs --record frame or threads" << std::endl;
+		return false;
+	}
+	// the indirect draws are a single call, there is nothing to split over threads.
+	if (options.gpuCulling && options.recordMode == RECORD_THREADED) {
+		std::cerr << "--gpu-cull can't be used with --record threads" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char* argv[]) {
+	AppOptions options;
+	std::string benchmark;
+	if (!parseOptions(argc, argv, options, benchmark)) {
+		printUsage();
+		return EXIT_FAILURE;
+	}
+
+	if (!benchmark.empty()) {
+		try {
+			if (!Benchmark(options).run(benchmark)) {
+				std::cerr << "unknown benchmark: " << benchmark << std::endl;
+				printUsage();
+				return EXIT_FAILURE;
+			}
+		} catch (const std::runtime_error& e) {
+			std::cerr << e.what() << std::endl;
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
 
-int main() {
 	//HelloTriangle app;
-	HelloTriangleExt app;
+	std::unique_ptr<HelloTriangle> app;
+	if (options.headless) {
+		app.reset(new HelloTriangleHeadless());
+	} else {
+		app.reset(new HelloTriangleExt());
+	}
+	app->setOptions(options);
 
 	try {
-		app.run();
+		app->run();
 	} catch (const std::runtime_error& e) {
 		std::cerr << e.what() << std::endl;
 		//printf(e.what());
 		return EXIT_FAILURE;
 	}
 	return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
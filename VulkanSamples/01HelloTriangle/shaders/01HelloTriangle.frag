@@ -9,7 +9,19 @@ layout(location = 0) out vec4 outColor;
 // receive the input from VS, as in
 // 通过location连接, 名字可以不一样.
 layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragLocalPosition;
+
+// set per pipeline, see SPEC_SHADING_MODEL. The branch on it is resolved when the 
+// pipeline is compiled, each variant only contains its own shading.
+//		0: the vertex color
+//		1: lit by a spot light in the center of the triangle
+layout(constant_id = 0) const int SHADING_MODEL = 0;
 
 void main() {
-    outColor = vec4(fragColor, 1.0);
+    vec3 color = fragColor;
+    if (SHADING_MODEL == 1) {
+        float light = clamp(1.2 - 2.0 * length(fragLocalPosition), 0.2, 1.0);
+        color *= light;
+    }
+    outColor = vec4(color, 1.0);
 }
\ No newline at end of file
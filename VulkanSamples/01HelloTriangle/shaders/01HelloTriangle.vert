@@ -3,30 +3,51 @@
 // is required for Vulkan shaders to work.
 #extension GL_ARB_separate_shader_objects : enable
 
+// from the vertex buffer, see Vertex::getAttributeDescriptions.
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
+// per instance (binding 1), see InstanceData::getAttributeDescriptions.
+layout(location = 2) in mat4 inModel;
+
+// where the per draw transform comes from, see PerDrawMode.
+layout(constant_id = 0) const int PER_DRAW_SOURCE = 0;
+
+// PER_DRAW_UNIFORM_BUFFER: per draw, bound with a dynamic offset, see ObjectUniforms.
+layout(set = 0, binding = 0) uniform ObjectUniforms {
+    mat4 transform;
+} object;
+
+// PER_DRAW_STORAGE_BUFFER: the ObjectUniforms of all the draws, indexed by perDraw.objectIndex.
+layout(std430, set = 0, binding = 1) readonly buffer ObjectBuffer {
+    mat4 transforms[];
+} objects;
+
+// PER_DRAW_PUSH_CONSTANTS: pushed before every draw, see PerDrawConstants.
+layout(push_constant) uniform PerDraw {
+    mat4 transform;
+    uint objectIndex;
+} perDraw;
+
 // pass to FS, as out
 layout(location = 0) out vec3 fragColor;
+// the position inside the triangle, for the spot light of SHADING_SPOT.
+layout(location = 1) out vec2 fragLocalPosition;
 
 out gl_PerVertex {
     vec4 gl_Position;
 };
 
-vec2 positions[3] = vec2[](
-    vec2(0.0, -0.5),
-    vec2(0.5, 0.5),
-    vec2(-0.5, 0.5)
-);
-
-vec3 colors[3] = vec3[](
-    vec3(1.0, 0.0, 0.0),
-    vec3(0.0, 1.0, 0.0),
-    vec3(0.0, 0.0, 1.0)
-);
-
 void main() {
-	// The built-in gl_VertexIndex variable contains the 
-	// index of the current vertex. This is usually an index 
-	// into the vertex buffer, but in our case it will be an 
-	// index into a hardcoded array of vertex data.
-    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-	fragColor = colors[gl_VertexIndex];
+    // a constant after specialization, the other branches are dead code.
+    mat4 transform;
+    if (PER_DRAW_SOURCE == 1) {
+        transform = perDraw.transform;
+    } else if (PER_DRAW_SOURCE == 2) {
+        transform = objects.transforms[perDraw.objectIndex];
+    } else {
+        transform = object.transform;
+    }
+    gl_Position = transform * inModel * vec4(inPosition, 0.0, 1.0);
+	fragColor = inColor;
+	fragLocalPosition = inPosition;
 }
\ No newline at end of file
@@ -1,7 +1,9 @@
 :: just double click this file and it will generates the spir-v for you.
-%VULKAN_SDK%/Bin/glslangValidator.exe -V 01HelloTriangle.vert -o 01HelloTriangleVert.spv
-%VULKAN_SDK%/Bin/glslangValidator.exe -V 01HelloTriangle.frag -o 01HelloTriangleFrag.spv
-
-%VULKAN_SDK%/Bin/glslangValidator.exe -V 01HelloTriangleExt.vert -o 01HelloTriangleExtVert.spv
-%VULKAN_SDK%/Bin/glslangValidator.exe -V 01HelloTriangleExt.frag -o 01HelloTriangleExtFrag.spv
-pause
\ No newline at end of file
+:: the SPIR-V goes into generated/*.h as uint32_t arrays, embedded into the executable.
+:: Also run as the pre-build event of the project (with "nopause"), so the headers are never stale.
+@cd /d "%~dp0"
+@if not exist generated mkdir generated
+%VULKAN_SDK%/Bin/glslangValidator.exe -V 01HelloTriangle.vert --vn HelloTriangleVertSpv -o generated/HelloTriangleVertSpv.h || exit /b 1
+%VULKAN_SDK%/Bin/glslangValidator.exe -V 01HelloTriangle.frag --vn HelloTriangleFragSpv -o generated/HelloTriangleFragSpv.h || exit /b 1
+%VULKAN_SDK%/Bin/glslangValidator.exe -V 01HelloTriangleCull.comp --vn HelloTriangleCullCompSpv -o generated/HelloTriangleCullCompSpv.h || exit /b 1
+@if not "%1"=="nopause" pause
@@ -0,0 +1,23 @@
+#!/bin/sh
+# compile the shaders into generated/*.h, included by the sample: the SPIR-V is 
+# embedded in the executable as a uint32_t array, nothing is read from disk at startup.
+# run it before building, and after every shader change.
+set -e
+cd "$(dirname "$0")"
+
+if [ -n "$VULKAN_SDK" ]; then
+	GLSLANG="$VULKAN_SDK/bin/glslangValidator"
+else
+	GLSLANG=glslangValidator
+fi
+
+mkdir -p generated
+
+# source, array name
+compile() {
+	"$GLSLANG" -V "$1" --vn "$2" -o "generated/$2.h"
+}
+
+compile 01HelloTriangle.vert HelloTriangleVertSpv
+compile 01HelloTriangle.frag HelloTriangleFragSpv
+compile 01HelloTriangleCull.comp HelloTriangleCullCompSpv